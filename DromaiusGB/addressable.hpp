@@ -22,5 +22,10 @@ namespace dromaiusgb
 		virtual void Set(bus_address_t, byte) =0;
 		virtual byte Get(bus_address_t) const =0;
 		virtual byte *GetBlock(bus_address_t) { return nullptr; }
+
+		// host memory the bus may access directly instead of calling Get/Set.
+		// only valid until the next Bus::Remap
+		virtual byte *GetReadBlock(bus_address_t) { return nullptr; }
+		virtual byte *GetWriteBlock(bus_address_t) { return nullptr; }
 	};
 }
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "bg_cache.hpp"
+
+#include <cstring>
+
+
+namespace dromaiusgb
+{
+
+	BackgroundCache::BackgroundCache()
+	{
+		signed_tiles.fill(false);
+		InvalidateAll();
+	}
+
+	// tiles 0-255 are at 0x8000, the signed tile numbers of 0x9000 are 256 + n
+	word BackgroundCache::GetTileIndex(byte tile_number, bool signed_tiles)
+	{
+		return signed_tiles ? 256 + (sbyte)tile_number : tile_number;
+	}
+
+	void BackgroundCache::Invalidate(const entry_set_t &entries_written, const TileCache::tile_set_t &tiles_written, const byte *vram)
+	{
+		for (byte map = 0; map < 2 && entries_written.any(); map++) {
+			for (word entry = 0; entry < entry_count / 2; entry++) {
+				if (entries_written[map * entry_count / 2 + entry])
+					dirty[map].set(entry);
+			}
+		}
+
+		if (tiles_written.none())
+			return;
+
+		// entries showing a tile that changed, as the map was drawn
+		for (byte map = 0; map < 2; map++) {
+			const byte *entries = vram + 0x1800 + map * 0x400;
+			for (word entry = 0; entry < entry_count / 2; entry++) {
+				if (tiles_written[GetTileIndex(entries[entry], signed_tiles[map])])
+					dirty[map].set(entry);
+			}
+		}
+	}
+
+	void BackgroundCache::InvalidateAll()
+	{
+		dirty[0].set();
+		dirty[1].set();
+	}
+
+	const byte *BackgroundCache::Get(byte map, bool signed_tiles, const byte *vram, const TileCache &tile_cache)
+	{
+		byte *bitmap = bitmaps[map].data();
+
+		if (signed_tiles != this->signed_tiles[map]) {
+			this->signed_tiles[map] = signed_tiles;
+			dirty[map].set();
+		}
+
+		if (dirty[map].none())
+			return bitmap;
+
+		const byte *entries = vram + 0x1800 + map * 0x400;
+		for (word entry = 0; entry < entry_count / 2; entry++) {
+			if (!dirty[map][entry])
+				continue;
+
+			const decoded_tile_t &tile = tile_cache.Get(GetTileIndex(entries[entry], signed_tiles));
+			byte *top_left = bitmap + (entry / 32) * 8 * 256 + (entry % 32) * 8;
+
+			for (unsigned int y = 0; y < 8; y++)
+				memcpy(top_left + y * 256, tile.rows[y], 8);
+		}
+
+		dirty[map].reset();
+		return bitmap;
+	}
+}
\ No newline at end of file
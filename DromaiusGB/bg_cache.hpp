@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+
+#include "types.hpp"
+#include "tile_cache.hpp"
+
+
+namespace dromaiusgb
+{
+
+	// both tile maps drawn out in full, 256x256 colour indices each, so a line of the bg or window is
+	// read straight out of them at the scroll. an entry of a map is drawn again once it or the tile it
+	// shows was written to, or when the tile data the maps select is switched
+	class BackgroundCache
+	{
+	public:
+		// the entries of the map at 0x9800 then those of the one at 0x9C00
+		static const word entry_count = 0x800;
+
+		typedef std::bitset<entry_count> entry_set_t;
+
+	private:
+		std::array<std::array<byte, 256 * 256>, 2> bitmaps;
+		std::array<std::bitset<entry_count / 2>, 2> dirty;
+		std::array<bool, 2> signed_tiles;
+
+	private:
+		static word GetTileIndex(byte, bool);
+
+	public:
+		BackgroundCache();
+
+		// the map entries and tiles written to since, with vram (from 0x8000) as it is now
+		void Invalidate(const entry_set_t &, const TileCache::tile_set_t &, const byte *);
+		void InvalidateAll();
+
+		// the bitmap of either map, from a tile cache that is up to date
+		const byte *Get(byte, bool, const byte *, const TileCache &);
+	};
+}
\ No newline at end of file
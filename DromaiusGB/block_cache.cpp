@@ -0,0 +1,93 @@
+#include "block_cache.hpp"
+
+
+namespace dromaiusgb
+{
+
+	BlockCache::BlockCache(Bus &bus) : bus(bus)
+	{
+		mapped_code.fill(nullptr);
+		mapped_pages.fill(nullptr);
+
+		bus.AddWatcher(this);
+	}
+
+	BlockCache::~BlockCache()
+	{
+		bus.RemoveWatcher(this);
+
+		for (auto &entry : code_pages) {
+			if (entry.second->watched)
+				bus.UnwatchWrites(entry.first);
+		}
+	}
+
+	basic_block_t *BlockCache::Insert(code_page_t &page, address_t addr, basic_block_t &&block)
+	{
+		byte offset = addr & 0xFF;
+
+		unsigned int end = offset;
+		for (const instruction_t &instruction : block.instructions) {
+			for (unsigned int i = 0; i < instruction.length; i++) {
+				page.decoded[end + i] = true;
+			}
+			end += instruction.length;
+		}
+
+		// code in ram has to be thrown away when it is written to
+		if (!page.watched && bus.IsPageWritable(addr)) {
+			bus.WatchWrites(page.code);
+			page.watched = true;
+		}
+
+		page.blocks[offset] = std::make_unique<basic_block_t>(std::move(block));
+		return page.blocks[offset].get();
+	}
+
+	// blocks are only dropped once the write is done
+	void BlockCache::Writing(const byte *, byte, byte)
+	{
+	}
+
+	void BlockCache::Written(const byte *code, byte offset)
+	{
+		auto entry = code_pages.find(code);
+		if (entry == code_pages.end() || !entry->second->decoded[offset])
+			return;
+
+		Retire(entry);
+	}
+
+	void BlockCache::Reloaded()
+	{
+		for (auto entry = code_pages.begin(); entry != code_pages.end(); ) {
+			auto next = std::next(entry);
+			if (entry->second->watched)
+				Retire(entry);
+			entry = next;
+		}
+	}
+
+	void BlockCache::Retire(std::unordered_map<const byte *, std::unique_ptr<code_page_t>>::iterator entry)
+	{
+		// drop every block in the page. the running block may be one of them, so keep it alive until
+		// the cpu asks for its next block
+		code_page_t *page = entry->second.get();
+		for (unsigned int index = 0; index < 0x100; index++) {
+			if (mapped_pages[index] == page) {
+				mapped_code[index] = nullptr;
+				mapped_pages[index] = nullptr;
+			}
+		}
+
+		bus.UnwatchWrites(entry->first);
+		retired_pages.push_back(std::move(entry->second));
+		code_pages.erase(entry);
+		generation++;
+	}
+
+	void BlockCache::Remapped()
+	{
+		generation++;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "types.hpp"
+#include "bus.hpp"
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+namespace dromaiusgb
+{
+
+	class CPU;
+	typedef dword (*opcode_handler_t)(CPU &);
+	typedef void (*jit_code_t)(CPU *, dword);
+
+	// an instruction with its operand already fetched. for CB prefixed instructions the operand is the
+	// second opcode byte
+	struct instruction_t
+	{
+		opcode_handler_t handler;
+		word operand;
+		byte length;
+		opcode_t opcode;
+	};
+
+	// straight line code up to and including the next jump, call or return
+	struct basic_block_t
+	{
+		std::vector<instruction_t> instructions;
+
+		// only reads memory and jumps back to its own start, see CPU::RunBlocks
+		bool idle_loop = false;
+		byte idle_loop_misses = 0;
+
+#ifdef DROMAIUSGB_JIT
+		// native code, compiled once the block is hot. see jit.hpp
+		jit_code_t native = nullptr;
+		address_t native_address = 0;
+		dword executions = 0;
+#endif
+	};
+
+	// the blocks decoded from one 256 byte page of host memory. keying on host memory rather than
+	// on the address means switched rom banks, the boot rom and mirrored ram each get their own blocks
+	struct code_page_t
+	{
+		const byte *code;
+		std::array<std::unique_ptr<basic_block_t>, 0x100> blocks;
+		std::bitset<0x100> decoded; // bytes covered by a cached instruction
+		bool watched;
+	};
+
+	class BlockCache : public BusWatcher
+	{
+	private:
+		Bus &bus;
+
+		std::unordered_map<const byte *, std::unique_ptr<code_page_t>> code_pages;
+		std::vector<std::unique_ptr<code_page_t>> retired_pages;
+
+		// the code page last seen at each page of the address map
+		std::array<const byte *, 0x100> mapped_code;
+		std::array<code_page_t *, 0x100> mapped_pages;
+
+		dword generation = 0;
+
+	private:
+		void Retire(std::unordered_map<const byte *, std::unique_ptr<code_page_t>>::iterator);
+
+	public:
+		BlockCache(Bus &);
+		~BlockCache();
+
+		code_page_t *GetPage(address_t);
+		basic_block_t *Insert(code_page_t &, address_t, basic_block_t &&);
+
+		// changes whenever a cached block may have become stale
+		dword Generation() const { return generation; }
+
+		void Writing(const byte *, byte, byte);
+		void Written(const byte *, byte);
+		void Remapped();
+
+		// drops the blocks decoded from any writable memory, for when all of it may have changed at once
+		void Reloaded();
+	};
+
+	// nullptr when code at addr isn't plain memory and can't be cached
+	inline code_page_t *BlockCache::GetPage(address_t addr)
+	{
+		byte index = addr >> 8;
+		const byte *code = bus.GetPageReadBlock(addr);
+
+		if (code != mapped_code[index]) {
+			// only now is it safe to free pages thrown away while their blocks were running
+			retired_pages.clear();
+
+			code_page_t *page = nullptr;
+			if (code) {
+				std::unique_ptr<code_page_t> &entry = code_pages[code];
+				if (!entry) {
+					entry = std::make_unique<code_page_t>();
+					entry->code = code;
+					entry->watched = false;
+				}
+				page = entry.get();
+			}
+
+			mapped_code[index] = code;
+			mapped_pages[index] = page;
+		}
+
+		return mapped_pages[index];
+	}
+}
\ No newline at end of file
@@ -5,36 +5,154 @@
 namespace dromaiusgb
 {
 
-	void Bus::Set(address_t addr, byte val)
+	Bus::Bus()
+	{
+		for (page_t &page : pages) {
+			page = { nullptr, nullptr, nullptr, nullptr, nullptr };
+		}
+	}
+
+	// addressables may still unwatch memory as they go, so they go first
+	Bus::~Bus()
+	{
+		address_spaces.clear();
+	}
+
+	const address_space_t *Bus::FindAddressSpace(address_t addr) const
 	{
 		for (auto &space : address_spaces) {
-			if (space.contains(addr) && space.addressable->Enabled()) {
-				bus_address_t baddr{ addr, address_t(addr - space.start) };
-				space.addressable->Set(baddr, val);
-				return;
-			}
+			if (space.contains(addr) && space.addressable->Enabled())
+				return &space;
 		}
+
+		return nullptr;
 	}
 
-	byte Bus::Get(address_t addr) const
+	void Bus::MapPage(byte index)
 	{
+		address_t page_start = index << 8;
+		address_t page_end = page_start | 0xFF;
+		page_t &page = pages[index];
+		page = { nullptr, nullptr, nullptr, nullptr, nullptr };
+
+		// the first enabled space touching the page owns it, if it covers the whole page
+		const address_space_t *owner = nullptr;
 		for (auto &space : address_spaces) {
-			if (space.contains(addr) && space.addressable->Enabled()) {
-				bus_address_t baddr{ addr, address_t(addr - space.start) };
-				return space.addressable->Get(baddr);
+			if (space.end >= page_start && space.start <= page_end && space.addressable->Enabled()) {
+				owner = &space;
+				break;
+			}
+		}
+
+		if (!owner)
+			return;
+
+		if (owner->start <= page_start && owner->end >= page_end) {
+			bus_address_t baddr{ page_start, address_t(page_start - owner->start) };
+			page.read = owner->addressable->GetReadBlock(baddr);
+			page.write = owner->addressable->GetWriteBlock(baddr);
+			page.space = owner;
+
+			// writes to watched memory take the slow path so the watcher sees them
+			if (page.write && std::find(watched_pages.begin(), watched_pages.end(), page.write) != watched_pages.end()) {
+				page.watched_write = page.write;
+				page.write = nullptr;
+			}
+			return;
+		}
+
+		// otherwise the page is shared, so resolve every address in it
+		if (!page_slots[index])
+			page_slots[index] = std::make_unique<page_slot_t[]>(0x100);
+
+		page.slots = page_slots[index].get();
+
+		for (unsigned int i = 0; i < 0x100; i++) {
+			address_t addr = page_start + i;
+			page_slot_t &slot = page.slots[i];
+			slot = { nullptr, nullptr, nullptr, FindAddressSpace(addr) };
+
+			if (slot.space) {
+				bus_address_t baddr{ addr, address_t(addr - slot.space->start) };
+				slot.read = slot.space->addressable->GetReadBlock(baddr);
+				slot.write = slot.space->addressable->GetWriteBlock(baddr);
+			}
+
+			// watched memory may start a page it shares with other spaces
+			if (slot.write && std::find(watched_pages.begin(), watched_pages.end(), slot.write - i) != watched_pages.end()) {
+				slot.watched_write = slot.write;
+				slot.write = nullptr;
 			}
 		}
+	}
+
+	void Bus::SetFromHandler(address_t addr, byte val)
+	{
+		const page_t &page = pages[addr >> 8];
+		const address_space_t *space = page.space;
+
+		if (page.watched_write) {
+			for (BusWatcher *watcher : watchers)
+				watcher->Writing(page.watched_write, addr & 0xFF, val);
+			page.watched_write[addr & 0xFF] = val;
+			for (BusWatcher *watcher : watchers)
+				watcher->Written(page.watched_write, addr & 0xFF);
+			return;
+		}
+
+		if (page.slots) {
+			const page_slot_t &slot = page.slots[addr & 0xFF];
+			if (slot.write) {
+				*slot.write = val;
+				return;
+			}
+
+			if (slot.watched_write) {
+				for (BusWatcher *watcher : watchers)
+					watcher->Writing(slot.watched_write - (addr & 0xFF), addr & 0xFF, val);
+				*slot.watched_write = val;
+				for (BusWatcher *watcher : watchers)
+					watcher->Written(slot.watched_write - (addr & 0xFF), addr & 0xFF);
+				return;
+			}
+
+			space = slot.space;
+		}
+
+		if (space) {
+			bus_address_t baddr{ addr, address_t(addr - space->start) };
+			space->addressable->Set(baddr, val);
+		}
+	}
+
+	byte Bus::GetFromHandler(address_t addr) const
+	{
+		const page_t &page = pages[addr >> 8];
+		const address_space_t *space = page.space;
+
+		if (page.slots) {
+			const page_slot_t &slot = page.slots[addr & 0xFF];
+			if (slot.read)
+				return *slot.read;
+
+			space = slot.space;
+		}
+
+		if (space) {
+			bus_address_t baddr{ addr, address_t(addr - space->start) };
+			return space->addressable->Get(baddr);
+		}
 
 		return 0xFF;
 	}
 
 	byte *Bus::GetBlock(address_t addr) const
 	{
-		for (auto &space : address_spaces) {
-			if (space.contains(addr) && space.addressable->Enabled()) {
-				bus_address_t baddr{ addr, address_t(addr - space.start) };
-				return space.addressable->GetBlock(baddr);
-			}
+		const address_space_t *space = FindAddressSpace(addr);
+
+		if (space) {
+			bus_address_t baddr{ addr, address_t(addr - space->start) };
+			return space->addressable->GetBlock(baddr);
 		}
 
 		return nullptr;
@@ -43,5 +161,81 @@ namespace dromaiusgb
 	void Bus::RegisterAddressSpace(address_t start, address_t end, std::shared_ptr<Addressable> addressable)
 	{
 		address_spaces.push_back({ start, end, addressable });
+
+		// the page table holds pointers in to address_spaces, which may have moved
+		Remap();
+	}
+
+	void Bus::Remap()
+	{
+		Remap(0x0000, 0xFFFF);
+	}
+
+	void Bus::Remap(address_t start, address_t end)
+	{
+		for (unsigned int index = start >> 8; index <= (unsigned int)(end >> 8); index++) {
+			MapPage(index);
+		}
+
+		for (BusWatcher *watcher : watchers)
+			watcher->Remapped();
+	}
+
+	void Bus::AddWatcher(BusWatcher *watcher)
+	{
+		watchers.push_back(watcher);
+	}
+
+	void Bus::RemoveWatcher(BusWatcher *watcher)
+	{
+		watchers.erase(std::remove(watchers.begin(), watchers.end(), watcher), watchers.end());
+	}
+
+	// route writes to the page of host memory starting at block, wherever it is mapped, through the watchers
+	void Bus::WatchWrites(const byte *block)
+	{
+		watched_pages.push_back(block);
+
+		for (page_t &page : pages) {
+			if (page.write == block) {
+				page.watched_write = page.write;
+				page.write = nullptr;
+			}
+
+			for (unsigned int i = 0; page.slots && i < 0x100; i++) {
+				page_slot_t &slot = page.slots[i];
+				if (slot.write && slot.write - i == block) {
+					slot.watched_write = slot.write;
+					slot.write = nullptr;
+				}
+			}
+		}
+	}
+
+	void Bus::UnwatchWrites(const byte *block)
+	{
+		// the page stays watched while anyone else is still watching it
+		auto watched = std::find(watched_pages.begin(), watched_pages.end(), block);
+		if (watched == watched_pages.end())
+			return;
+
+		watched_pages.erase(watched);
+		if (std::find(watched_pages.begin(), watched_pages.end(), block) != watched_pages.end())
+			return;
+
+		for (page_t &page : pages) {
+			if (page.watched_write == block) {
+				page.write = page.watched_write;
+				page.watched_write = nullptr;
+			}
+
+			for (unsigned int i = 0; page.slots && i < 0x100; i++) {
+				page_slot_t &slot = page.slots[i];
+				if (slot.watched_write && slot.watched_write - i == block) {
+					slot.write = slot.watched_write;
+					slot.watched_write = nullptr;
+				}
+			}
+		}
 	}
 }
\ No newline at end of file
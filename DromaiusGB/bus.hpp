@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <memory>
+#include <array>
+#include <algorithm>
 #include "addressable.hpp"
 
 
@@ -20,17 +22,104 @@ namespace dromaiusgb
 		}
 	};
 
+	// a single address in a page shared by several address spaces
+	struct page_slot_t
+	{
+		byte *read;
+		byte *write;
+		byte *watched_write;
+		const address_space_t *space;
+	};
+
+	// one 256 byte page of the address map. read/write point directly at host memory
+	// when the page can be accessed without going through its addressable.
+	// watched_write replaces write for memory the bus was asked to watch
+	struct page_t
+	{
+		byte *read;
+		byte *write;
+		byte *watched_write;
+		const address_space_t *space;
+		page_slot_t *slots;
+	};
+
+	// told about writes to watched host memory, just before and after they happen, and about every
+	// change to the address map. every watcher hears about every watched write, not just the ones to
+	// memory it asked to watch
+	class BusWatcher
+	{
+	public:
+		virtual ~BusWatcher() {}
+
+		virtual void Writing(const byte *page, byte offset, byte value) =0;
+		virtual void Written(const byte *page, byte offset) =0;
+		virtual void Remapped() =0;
+	};
+
 	class Bus
 	{
 	private:
 		std::vector<address_space_t> address_spaces;
+		std::array<page_t, 0x100> pages;
+		std::array<std::unique_ptr<page_slot_t[]>, 0x100> page_slots;
+		std::vector<const byte *> watched_pages; // once for every time a page is watched
+		std::vector<BusWatcher *> watchers;
+
+	private:
+		const address_space_t *FindAddressSpace(address_t) const;
+		void MapPage(byte);
+
+		void SetFromHandler(address_t, byte);
+		byte GetFromHandler(address_t) const;
 
 	public:
+		Bus();
+		~Bus();
+
 		void Set(address_t, byte);
 		byte Get(address_t) const;
 
 		byte *GetBlock(address_t) const;
+		const byte *GetPageReadBlock(address_t) const;
+		bool IsPageWritable(address_t) const;
+
+		void AddWatcher(BusWatcher *);
+		void RemoveWatcher(BusWatcher *);
+		void WatchWrites(const byte *);
+		void UnwatchWrites(const byte *);
 
 		void RegisterAddressSpace(address_t, address_t, std::shared_ptr<Addressable>);
+		void Remap();
+		void Remap(address_t, address_t);
 	};
+
+	inline void Bus::Set(address_t addr, byte val)
+	{
+		const page_t &page = pages[addr >> 8];
+		if (page.write)
+			page.write[addr & 0xFF] = val;
+		else
+			SetFromHandler(addr, val);
+	}
+
+	inline byte Bus::Get(address_t addr) const
+	{
+		const page_t &page = pages[addr >> 8];
+		if (page.read)
+			return page.read[addr & 0xFF];
+
+		return GetFromHandler(addr);
+	}
+
+	// host memory behind the whole page holding addr, if it is read directly
+	inline const byte *Bus::GetPageReadBlock(address_t addr) const
+	{
+		return pages[addr >> 8].read;
+	}
+
+	inline bool Bus::IsPageWritable(address_t addr) const
+	{
+		const page_t &page = pages[addr >> 8];
+		return page.write || page.watched_write;
+	}
 }
\ No newline at end of file
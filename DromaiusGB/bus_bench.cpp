@@ -0,0 +1,203 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bus.hpp"
+#include "cartridge.hpp"
+#include "interrupts.hpp"
+#include "joypad.hpp"
+#include "lcd.hpp"
+#include "link.hpp"
+#include "ram.hpp"
+#include "rom.hpp"
+#include "scheduler.hpp"
+#include "timer.hpp"
+
+
+// wires up the game boy's address map with a rom and the boot rom switched off, then reads and writes
+// the same addresses through the page table and through the scan of every address space the bus did
+// before it, and reports the time per access of each
+//   bus_bench <rom> [--repeat n]
+
+struct region_t
+{
+	const char *name;
+	dromaiusgb::word address;
+	dromaiusgb::word mask; // of the addresses after it taken in turn
+	bool written;
+};
+
+// writes to rom are mbc control writes and video memory is watched by the lcd, neither of which the scan knew
+static const region_t regions[] = {
+	{ "rom0", 0x0150, 0x0F, false },
+	{ "romX", 0x4000, 0x0F, false },
+	{ "vram", 0x8000, 0x0F, false },
+	{ "sram", 0xA000, 0x0F, false },
+	{ "wram", 0xC000, 0x0F, true },
+	{ "echo", 0xE000, 0x0F, true },
+	{ "oam", 0xFE00, 0x0F, false },
+	{ "joyp", 0xFF00, 0x00, false },
+	{ "pal", 0xFF47, 0x03, true },
+	{ "hram", 0xFF80, 0x0F, true },
+	{ "ie", 0xFFFF, 0x00, true },
+};
+
+// Bus::Get and Bus::Set as they were before the page table
+class LinearBus
+{
+private:
+	std::vector<dromaiusgb::address_space_t> address_spaces;
+
+public:
+	void RegisterAddressSpace(dromaiusgb::address_t start, dromaiusgb::address_t end, std::shared_ptr<dromaiusgb::Addressable> addressable)
+	{
+		address_spaces.push_back({ start, end, addressable });
+	}
+
+	void Set(dromaiusgb::address_t addr, dromaiusgb::byte val)
+	{
+		for (auto &space : address_spaces) {
+			if (space.contains(addr) && space.addressable->Enabled()) {
+				dromaiusgb::bus_address_t baddr{ addr, dromaiusgb::address_t(addr - space.start) };
+				space.addressable->Set(baddr, val);
+				return;
+			}
+		}
+	}
+
+	dromaiusgb::byte Get(dromaiusgb::address_t addr) const
+	{
+		for (auto &space : address_spaces) {
+			if (space.contains(addr) && space.addressable->Enabled()) {
+				dromaiusgb::bus_address_t baddr{ addr, dromaiusgb::address_t(addr - space.start) };
+				return space.addressable->Get(baddr);
+			}
+		}
+
+		return 0xFF;
+	}
+};
+
+// a different address each time where the region has more than one, so neither loop can keep what it read
+template <typename B>
+static double TimeReads(const B &bus, const region_t &region, unsigned long repeat, unsigned long &sum)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned long i = 0; i < repeat; i++)
+		sum += bus.Get(region.address + (i & region.mask));
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() * 1e9 / repeat;
+}
+
+template <typename B>
+static double TimeWrites(B &bus, const region_t &region, unsigned long repeat)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned long i = 0; i < repeat; i++)
+		bus.Set(region.address + (i & region.mask), dromaiusgb::byte(i));
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() * 1e9 / repeat;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <rom> [--repeat n]" << std::endl;
+		return -1;
+	}
+
+	std::string rom = argv[1];
+	unsigned long repeat = 50000000;
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+			repeat = std::strtoul(argv[++i], nullptr, 10);
+		else {
+			std::cerr << "unknown argument: " << argv[i] << std::endl;
+			return -1;
+		}
+	}
+
+	dromaiusgb::Bus bus;
+	dromaiusgb::Scheduler scheduler;
+	LinearBus linear_bus;
+
+	auto boot_rom = std::make_shared<dromaiusgb::ROM<0x100>>(bus);
+	auto boot_rom_switch = std::make_shared<dromaiusgb::ROMSwitch<0x100>>(bus, boot_rom);
+	auto cartridge = std::make_shared<dromaiusgb::Cartridge>(bus);
+	auto vram = std::make_shared<dromaiusgb::RAM<0x2000>>(bus);
+	auto wram = std::make_shared<dromaiusgb::RAM<0x2000>>(bus);
+	auto oam = std::make_shared<dromaiusgb::RAM<0x00A0>>(bus);
+	auto interrupt_controller = std::make_shared<dromaiusgb::InterruptController>(bus);
+	auto timer = std::make_shared<dromaiusgb::Timer>(bus, scheduler, *interrupt_controller);
+	auto lcd = std::make_shared<dromaiusgb::LCD>(bus, scheduler, *interrupt_controller);
+	auto linkport = std::make_shared<dromaiusgb::LinkPort>(bus, *interrupt_controller);
+	auto joypad = std::make_shared<dromaiusgb::Joypad>(bus, scheduler, *interrupt_controller);
+	auto hram = std::make_shared<dromaiusgb::RAM<0x007E>>(bus);
+
+	try {
+		cartridge->LoadFromFile(rom);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	// the same map as the game boy's, in the same order
+	auto map = [&](dromaiusgb::address_t start, dromaiusgb::address_t end, std::shared_ptr<dromaiusgb::Addressable> addressable) {
+		bus.RegisterAddressSpace(start, end, addressable);
+		linear_bus.RegisterAddressSpace(start, end, addressable);
+	};
+
+	map(0x0000, 0x00FF, boot_rom);
+	map(0xFF50, 0xFF50, boot_rom_switch);
+	map(0x0000, 0x7FFF, cartridge);
+	map(0x8000, 0x9FFF, vram);
+	map(0xA000, 0xBFFF, cartridge);
+	map(0xC000, 0xDFFF, wram);
+	map(0xE000, 0xFDFF, wram);
+	map(0xFE00, 0xFE9F, oam);
+	map(0xFF00, 0xFF00, joypad);
+	map(0xFF01, 0xFF02, linkport);
+	map(0xFF04, 0xFF07, timer);
+	map(0xFF0F, 0xFF0F, interrupt_controller);
+	map(0xFF40, 0xFF4B, lcd);
+	map(0xFF80, 0xFFFE, hram);
+	map(0xFFFF, 0xFFFF, interrupt_controller);
+
+	// as after the boot rom is done, so every scan skips past it first
+	bus.Set(0xFF50, 1);
+
+	unsigned long sum = 0;
+	std::cout << std::dec << repeat << " accesses each" << std::endl;
+
+	for (const region_t &region : regions) {
+		double linear = TimeReads(linear_bus, region, repeat, sum);
+		double paged = TimeReads(bus, region, repeat, sum);
+
+		std::cout << std::left << std::setw(5) << region.name << std::right << std::fixed << std::setprecision(1)
+			<< " read:  scan " << std::setw(5) << linear << " ns, page table " << std::setw(5) << paged << " ns" << std::endl;
+
+		if (!region.written)
+			continue;
+
+		linear = TimeWrites(linear_bus, region, repeat);
+		paged = TimeWrites(bus, region, repeat);
+
+		std::cout << std::left << std::setw(5) << region.name << std::right << std::fixed << std::setprecision(1)
+			<< " write: scan " << std::setw(5) << linear << " ns, page table " << std::setw(5) << paged << " ns" << std::endl;
+	}
+
+	// so the reads can't be left out
+	std::cout << "checksum: " << std::hex << sum << std::dec << std::endl;
+
+	return 0;
+}
\ No newline at end of file
@@ -16,6 +16,12 @@ namespace dromaiusgb
 	void Cartridge::Set(bus_address_t addr, byte val)
 	{
 		mbc->Set(addr, val);
+
+		// writes to rom are MBC control writes, the banks mapped on the bus may have changed
+		if (addr.address <= 0x7FFF) {
+			bus.Remap(0x0000, 0x7FFF);
+			bus.Remap(0xA000, 0xBFFF);
+		}
 	}
 
 	byte Cartridge::Get(bus_address_t addr) const
@@ -28,6 +34,34 @@ namespace dromaiusgb
 		return mbc->GetBlock(addr);
 	}
 
+	byte *Cartridge::GetReadBlock(bus_address_t addr)
+	{
+		if (!mbc)
+			return nullptr;
+
+		return mbc->GetReadBlock(addr);
+	}
+
+	byte *Cartridge::GetWriteBlock(bus_address_t addr)
+	{
+		if (!mbc)
+			return nullptr;
+
+		return mbc->GetWriteBlock(addr);
+	}
+
+	void Cartridge::SaveState(State &state) const
+	{
+		if (mbc)
+			mbc->SaveState(state);
+	}
+
+	void Cartridge::LoadState(State &state)
+	{
+		if (mbc)
+			mbc->LoadState(state);
+	}
+
 	void Cartridge::LoadFromFile(std::string filename)
 	{
 		std::ifstream input(filename, std::ios::binary);
@@ -63,5 +97,6 @@ namespace dromaiusgb
 
 		// load the ROM in to the MBC
 		mbc->LoadROM(input);
+		bus.Remap();
 	}
 }
\ No newline at end of file
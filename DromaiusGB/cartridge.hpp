@@ -41,7 +41,12 @@ namespace dromaiusgb
 		void Set(bus_address_t, byte);
 		byte Get(bus_address_t) const;
 		byte *GetBlock(bus_address_t);
+		byte *GetReadBlock(bus_address_t);
+		byte *GetWriteBlock(bus_address_t);
 
 		void LoadFromFile(std::string filename);
+
+		void SaveState(State &) const;
+		void LoadState(State &);
 	};
 }
\ No newline at end of file
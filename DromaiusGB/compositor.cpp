@@ -0,0 +1,29 @@
+#include "compositor.hpp"
+
+
+namespace dromaiusgb
+{
+
+	void LineCompositor::Composite(byte *line, byte priority_shift) const
+	{
+		// 8 pixels at a time, skipping those no sprite covers. a multiply gathers one bit of each byte
+		// into a byte of bits
+		for (unsigned int bit = margin; bit < margin + 160; bit += 8) {
+			byte sprites_covered = byte(covered[bit / 64] >> (bit % 64));
+			if (!sprites_covered)
+				continue;
+
+			std::uint64_t pixels, sprites;
+			byte *group = line + bit - margin;
+			memcpy(&pixels, group, 8);
+			memcpy(&sprites, sprite_pixels + bit, 8);
+
+			byte bg_opaque = (((pixels >> priority_shift) & 0x0101010101010101) * 0x0102040810204080) >> 56;
+			byte shown = sprites_covered & ~(byte(behind[bit / 64] >> (bit % 64)) & bg_opaque);
+
+			std::uint64_t mask = SpreadBits(shown);
+			pixels = (pixels & ~mask) | (sprites & mask);
+			memcpy(group, &pixels, 8);
+		}
+	}
+}
\ No newline at end of file
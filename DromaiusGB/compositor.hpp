@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "types.hpp"
+
+
+namespace dromaiusgb
+{
+
+	// lays the sprites of a line over its bg. which pixels sprites cover, and which of those are behind
+	// the bg, are bit masks of the line, so a sprite is added and the line composited without testing
+	// pixel by pixel. the masks start 8 pixels left of the screen, where sprites may start
+	class LineCompositor
+	{
+	private:
+		static const int margin = 8;
+
+		typedef std::uint64_t line_mask_t[3];
+
+		line_mask_t covered;
+		line_mask_t behind;
+		byte sprite_pixels[margin + 160 + 8];
+
+	private:
+		// the 8 bits from the given pixel on
+		static byte GetBits(const line_mask_t &mask, unsigned int position)
+		{
+			unsigned int word = position / 64, shift = position % 64;
+			std::uint64_t bits = mask[word] >> shift;
+			if (shift > 56)
+				bits |= mask[word + 1] << (64 - shift);
+
+			return byte(bits);
+		}
+
+		static void SetBits(line_mask_t &mask, unsigned int position, byte bits)
+		{
+			unsigned int word = position / 64, shift = position % 64;
+			mask[word] |= std::uint64_t(bits) << shift;
+			if (shift > 56)
+				mask[word + 1] |= std::uint64_t(bits) >> (64 - shift);
+		}
+
+		// a byte of bits to a byte of 0xFF for every bit set, the first bit the first byte
+		static std::uint64_t SpreadBits(byte bits)
+		{
+			std::uint64_t spread = (bits * 0x0101010101010101) & 0x8040201008040201;
+			return ((((spread + 0x7F7F7F7F7F7F7F7F) | spread) & 0x8080808080808080) >> 7) * 0xFF;
+		}
+
+	public:
+		void Clear()
+		{
+			memset(covered, 0, sizeof(covered));
+			memset(behind, 0, sizeof(behind));
+		}
+
+		// x is as in oam, 8 more than on screen, up to 167. opaque has a bit for every one of the 8
+		// pixels to draw, the leftmost in bit 0. sprites added before keep their pixels
+		void AddSprite(byte x, byte opaque, const byte *pixels, bool behind_bg)
+		{
+			byte fresh = opaque & ~GetBits(covered, x);
+			SetBits(covered, x, fresh);
+			SetBits(behind, x, behind_bg ? fresh : 0);
+
+			std::uint64_t mask = SpreadBits(fresh), sprites, row;
+			memcpy(&sprites, sprite_pixels + x, 8);
+			memcpy(&row, pixels, 8);
+
+			sprites = (sprites & ~mask) | (row & mask);
+			memcpy(sprite_pixels + x, &sprites, 8);
+		}
+
+		// the line as drawn with the bg and window only. pixels are as in Renderer, the bg's opaque
+		// pixels are those with a priority of 1
+		void Composite(byte *, byte) const;
+	};
+}
\ No newline at end of file
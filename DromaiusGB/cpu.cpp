@@ -6,23 +6,12 @@
 namespace dromaiusgb
 {
 
-	CPU::CPU(Bus &bus, LCD &lcd, Timer &timer, InterruptController &interrupt_controller) 
-		: bus(bus), lcd(lcd), timer(timer), interrupt_controller(interrupt_controller), running(false), halted(false)
-	{
-		registers[0] = &BC.hi; // B
-		registers[1] = &BC.lo; // C
-		registers[2] = &DE.hi; // D
-		registers[3] = &DE.lo; // E
-		registers[4] = &HL.hi; // H
-		registers[5] = &HL.lo; // L
-		registers[6] = &AF.lo; // F
-		registers[7] = &AF.hi; // A
-
-		wregisters[0] = &BC.value;
-		wregisters[1] = &DE.value;
-		wregisters[2] = &HL.value;
-		wregisters[3] = &SP;
-
+	CPU::CPU(Bus &bus, Scheduler &scheduler, InterruptController &interrupt_controller) 
+		: bus(bus), scheduler(scheduler), interrupt_controller(interrupt_controller), running(false), halted(false), block_cache(bus)
+#ifdef DROMAIUSGB_JIT
+		, jit(*this)
+#endif
+	{
 		// initial register values
 		AF = 0x01B0;
 		BC = 0x0013;
@@ -30,854 +19,768 @@ namespace dromaiusgb
 		HL = 0x014D;
 		PC = 0;
 		SP = 0xFFFE;
+		operand = 0;
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		lazy_flags.op = lazy_flags_none;
+#endif
 		interrupt_master_enable_flag = true;
 		next_fetch_is_halt_bug = false;
-	};
-
-	dword CPU::HandleCBPrefixOpcode()
-	{
-		opcode_t opcode = bus.Get(PC);
-
-		if (next_fetch_is_halt_bug)
-			next_fetch_is_halt_bug = false;
-		else
-			PC += 1;
-
-		switch (opcode) {
-			case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x07: // rlc reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::rotate_left_through_carry(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x06: // rlc (HL)
-			{
-				byte v = util::rotate_left_through_carry(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x08: case 0x09: case 0x0A: case 0x0B: case 0x0C: case 0x0D: case 0x0F: // rrc reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::rotate_right_through_carry(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x0E: // rrc (HL)
-			{
-				byte v = util::rotate_right_through_carry(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x17: // rl reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::rotate_left(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x16: // rl (HL)
-			{
-				byte v = util::rotate_left(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x18: case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1F: // rr reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::rotate_right(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x1E: // rr (HL)
-			{
-				byte v = util::rotate_right(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x27: // sla reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::shift_left_arithmetic(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x26: // sla (HL)
-			{
-				byte v = util::shift_left_arithmetic(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x28: case 0x29: case 0x2A: case 0x2B: case 0x2C: case 0x2D: case 0x2F: // sra reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::shift_right_arithmetic(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x2E: // sra (HL)
-			{
-				byte v = util::shift_right_arithmetic(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x37: // swap reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::swap_nibbles(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x36: // swap (HL)
-			{
-				byte v = util::swap_nibbles(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-				
-			}
-
-			case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x3C: case 0x3D: case 0x3F: // srl reg
-			{
-				byte &dst = *registers[opcode & 0x07];
-				dst = util::shift_right_logical(dst, AF.flags);
-				return 8;
-			}
-
-			case 0x3E: // srl (HL)
-			{
-				byte v = util::shift_right_logical(bus.Get(HL), AF.flags);
-				bus.Set(HL, v);
-				return 16;
-			}
-
-			case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x47: // bit 0, reg
-			case 0x48: case 0x49: case 0x4A: case 0x4B: case 0x4C: case 0x4D: case 0x4F: // bit 1, reg
-			case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x57: // bit 2, reg
-			case 0x58: case 0x59: case 0x5A: case 0x5B: case 0x5C: case 0x5D: case 0x5F: // bit 3, reg
-			case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x67: // bit 4, reg
-			case 0x68: case 0x69: case 0x6A: case 0x6B: case 0x6C: case 0x6D: case 0x6F: // bit 5, reg
-			case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x77: // bit 6, reg
-			case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7F: // bit 7, reg
-			{
-				byte v = *registers[opcode & 0x07];
-				byte bit = opcode >> 3 & 0x07;
-				util::test_bit(v, bit, AF.flags);
-				return 8;
-			}
-
-			case 0x46: case 0x4E: case 0x56: case 0x5E: case 0x66: case 0x6E: case 0x76: case 0x7E: // bit b, (HL)
-			{
-				byte v = bus.Get(HL);
-				byte bit = opcode >> 3 & 0x07;
-				util::test_bit(v, bit, AF.flags);
-				return 12;
-			}
 
-			case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x87: // res 0, reg
-			case 0x88: case 0x89: case 0x8A: case 0x8B: case 0x8C: case 0x8D: case 0x8F: // res 1, reg
-			case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x97: // res 2, reg
-			case 0x98: case 0x99: case 0x9A: case 0x9B: case 0x9C: case 0x9D: case 0x9F: // res 3, reg
-			case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: case 0xA5: case 0xA7: // res 4, reg
-			case 0xA8: case 0xA9: case 0xAA: case 0xAB: case 0xAC: case 0xAD: case 0xAF: // res 5, reg
-			case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB7: // res 6, reg
-			case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBF: // res 7, reg
-			{
-				byte &v = *registers[opcode & 0x07];
-				byte bit = opcode >> 3 & 0x07;
-				v = util::reset_bit(v, bit);
-				return 8;
-			}
+		scheduler.Register(Event::Stop, this);
+	};
 
-			case 0x86: case 0x8E: case 0x96: case 0x9E: case 0xA6: case 0xAE: case 0xB6: case 0xBE: // res b, (HL)
-			{
-				byte v = bus.Get(HL);
-				byte bit = opcode >> 3 & 0x07;
-				bus.Set(HL, util::reset_bit(v, bit));
-				return 16;
-			}
+	// ================================================
+	// =============== Operand decoding ===============
+	// ================================================
 
-			case 0xC0: case 0xC1: case 0xC2: case 0xC3: case 0xC4: case 0xC5: case 0xC7: // set 0, reg
-			case 0xC8: case 0xC9: case 0xCA: case 0xCB: case 0xCC: case 0xCD: case 0xCF: // set 1, reg
-			case 0xD0: case 0xD1: case 0xD2: case 0xD3: case 0xD4: case 0xD5: case 0xD7: // set 2, reg
-			case 0xD8: case 0xD9: case 0xDA: case 0xDB: case 0xDC: case 0xDD: case 0xDF: // set 3, reg
-			case 0xE0: case 0xE1: case 0xE2: case 0xE3: case 0xE4: case 0xE5: case 0xE7: // set 4, reg
-			case 0xE8: case 0xE9: case 0xEA: case 0xEB: case 0xEC: case 0xED: case 0xEF: // set 5, reg
-			case 0xF0: case 0xF1: case 0xF2: case 0xF3: case 0xF4: case 0xF5: case 0xF7: // set 6, reg
-			case 0xF8: case 0xF9: case 0xFA: case 0xFB: case 0xFC: case 0xFD: case 0xFF: // set 7, reg
-			{
-				byte &v = *registers[opcode & 0x07];
-				byte bit = opcode >> 3 & 0x07;
-				v = util::set_bit(v, bit);
-				return 8;
-			}
-
-			case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // set b, (HL)
-			{
-				byte v = bus.Get(HL);
-				byte bit = opcode >> 3 & 0x07;
-				bus.Set(HL, util::set_bit(v, bit));
-				return 16;
-			}
+	template <byte R>
+	inline byte CPU::Read()
+	{
+		switch (R) {
+			case 0: return BC.hi;
+			case 1: return BC.lo;
+			case 2: return DE.hi;
+			case 3: return DE.lo;
+			case 4: return HL.hi;
+			case 5: return HL.lo;
+			case 6: return bus.Get(HL);
+			case 7: default: return AF.hi;
+		}
+	}
 
-			default:
-			{
-				std::cout << "Undefined opcode: 0xcb " << std::hex << (int)opcode << " at " << PC << std::endl;
-				return 0;
-			}
+	template <byte R>
+	inline void CPU::Write(byte val)
+	{
+		switch (R) {
+			case 0: BC.hi = val; break;
+			case 1: BC.lo = val; break;
+			case 2: DE.hi = val; break;
+			case 3: DE.lo = val; break;
+			case 4: HL.hi = val; break;
+			case 5: HL.lo = val; break;
+			case 6: bus.Set(HL, val); break;
+			case 7: default: AF.hi = val; break;
 		}
 	}
 
-	dword CPU::Step()
+	template <byte RR>
+	inline word &CPU::WordRegister()
 	{
-		opcode_t opcode = bus.Get(PC);
-		PC += 1;
+		switch (RR) {
+			case 0: return BC.value;
+			case 1: return DE.value;
+			case 2: return HL.value;
+			case 3: default: return SP;
+		}
+	}
 
-		switch (opcode) {
-			// ================================================
-			//  ================= 8-bit LOADS =================
-			// ================================================
-
-			case 0x02: // ld (BC), A
-			{
-				bus.Set(BC, AF.hi);
-				return 8;
-			}
+	inline bool CPU::ZeroFlag() const
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		if (lazy_flags.op != lazy_flags_none)
+			return byte(lazy_flags.result) == 0;
+#endif
+		return AF.flags.zf;
+	}
 
-			case 0x12: // ld (DE), A
-			{
-				bus.Set(DE, AF.hi);
-				return 8;
-			}
+	inline bool CPU::CarryFlag() const
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		if (lazy_flags.op != lazy_flags_none)
+			return lazy_flags.result >> 8;
+#endif
+		return AF.flags.cy;
+	}
 
-			case 0x22: // ldi (HL), A
-			{
-				bus.Set(HL, AF.hi);
-				HL = HL + 1;
-				return 8;
-			}
+#ifdef DROMAIUSGB_LAZY_FLAGS
+	// runs the pending operation through the same helpers the eager path uses
+	flags_t CPU::PendingFlags() const
+	{
+		const lazy_flags_t &l = lazy_flags;
+		flags_t flags = AF.flags;
+		switch (l.op) {
+			case 0: case 1: util::add_with_carry(l.a, l.b, l.carry, flags); break;
+			case 2: case 3: case 7: util::sub_with_carry(l.a, l.b, l.carry, flags); break;
+			case 4: util::logical_and(l.a, l.b, flags); break;
+			case 5: util::logical_xor(l.a, l.b, flags); break;
+			case 6: util::logical_or(l.a, l.b, flags); break;
+			case lazy_flags_inc: util::increment_byte(l.a, flags); flags.cy = l.result >> 8; break;
+			case lazy_flags_dec: util::decrement_byte(l.a, flags); flags.cy = l.result >> 8; break;
+		}
+		return flags;
+	}
 
-			case 0x32: // ldd (HL), A
-			{
-				bus.Set(HL, AF.hi);
-				HL = HL - 1;
-				return 8;
-			}
+	void CPU::MaterializeFlags()
+	{
+		AF.flags = PendingFlags();
+		lazy_flags.op = lazy_flags_none;
+	}
+#endif
 
-			case 0x0A: // ld A, (BC)
-			{
-				AF.hi = bus.Get(BC);
-				return 8;
-			}
+	template <byte CC>
+	inline bool CPU::Condition() const
+	{
+		switch (CC) {
+			case 0: return !ZeroFlag(); // NZ
+			case 1: return ZeroFlag(); // Z
+			case 2: return !CarryFlag(); // NC
+			case 3: default: return CarryFlag(); // C
+		}
+	}
 
-			case 0x1A: // ld A, (DE)
-			{
-				AF.hi = bus.Get(DE);
-				return 8;
-			}
+	template <byte Op>
+	inline void CPU::ALU(byte v)
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		byte a = AF.hi;
+		byte carry = (Op == 1 || Op == 3) ? CarryFlag() : 0;
+		word r;
+		switch (Op) {
+			case 0: case 1: r = a + v + carry; break; // add/adc
+			case 2: case 3: case 7: r = (a - v - carry) & 0x1FF; break; // sub/sbc/cp, bit 8 is the borrow
+			case 4: r = a & v; break; // and
+			case 5: r = a ^ v; break; // xor
+			case 6: default: r = a | v; break; // or
+		}
+		lazy_flags = { Op, a, v, carry, r };
+		if (Op != 7)
+			AF.hi = byte(r);
+#else
+		switch (Op) {
+			case 0: AF.hi = util::add_with_carry(AF.hi, v, 0, AF.flags); break; // add
+			case 1: AF.hi = util::add_with_carry(AF.hi, v, AF.flags.cy, AF.flags); break; // adc
+			case 2: AF.hi = util::sub_with_carry(AF.hi, v, 0, AF.flags); break; // sub
+			case 3: AF.hi = util::sub_with_carry(AF.hi, v, AF.flags.cy, AF.flags); break; // sbc
+			case 4: AF.hi = util::logical_and(AF.hi, v, AF.flags); break; // and
+			case 5: AF.hi = util::logical_xor(AF.hi, v, AF.flags); break; // xor
+			case 6: AF.hi = util::logical_or(AF.hi, v, AF.flags); break; // or
+			case 7: default: util::compare(AF.hi, v, AF.flags); break; // cp
+		}
+#endif
+	}
 
-			case 0x2A: // ldi A, (HL)
-			{
-				AF.hi = bus.Get(HL);
-				HL = HL + 1;
-				return 8;
-			}
+	// ================================================
+	//  ================= 8-bit LOADS =================
+	// ================================================
 
-			case 0x3A: // ldd A, (HL)
-			{
-				AF.hi = bus.Get(HL);
-				HL = HL - 1;
-				return 8;
-			}
+	template <byte R, byte S>
+	dword CPU::LD_r_r() // ld reg,reg / ld reg,(HL) / ld (HL),reg
+	{
+		Write<R>(Read<S>());
+		return (R == 6 || S == 6) ? 8 : 4;
+	}
 
-			case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // ld reg, n
-			{
-				byte &dst = *registers[opcode >> 3 & 0x07];
-				dst = util::get_immediate_byte(PC, bus);
-				return 8;
-			}
+	template <byte R>
+	dword CPU::LD_r_n() // ld reg,n / ld (HL),n
+	{
+		Write<R>(byte(operand));
+		return R == 6 ? 12 : 8;
+	}
 
-			case 0x36: //ld (HL), n
-			{
-				bus.Set(HL, util::get_immediate_byte(PC, bus));
-				return 12;
-			}
+	template <byte RR>
+	dword CPU::LD_mrr_A() // ld (BC),A / ld (DE),A
+	{
+		bus.Set(WordRegister<RR>(), AF.hi);
+		return 8;
+	}
 
-			case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x47: // ld b,reg
-			case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4f: // ld c,reg
-			case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x57: // ld d,reg
-			case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5f: // ld e,reg
-			case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x67: // ld h,reg
-			case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6f: // ld l,reg
-			case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7f: // ld a,reg
-			{
-				byte &dst = *registers[opcode >> 3 & 0x07];
-				byte src = *registers[opcode & 0x07];
-				dst = src;
-				return 4;
-			}
+	template <byte RR>
+	dword CPU::LD_A_mrr() // ld A,(BC) / ld A,(DE)
+	{
+		AF.hi = bus.Get(WordRegister<RR>());
+		return 8;
+	}
 
-			case 0x46: case 0x4E: case 0x56: case 0x5E: case 0x66: case 0x6E: case 0x7E: // ld reg,(HL)
-			{
-				byte &dst = *registers[opcode >> 3 & 0x07];
-				byte src = bus.Get(HL);
-				dst = src;
-				return 8;
-			}
+	template <int Delta>
+	dword CPU::LD_mHL_A() // ldi (HL),A / ldd (HL),A
+	{
+		bus.Set(HL, AF.hi);
+		HL = HL + Delta;
+		return 8;
+	}
 
-			case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x77: // ld (HL),reg
-			{
-				byte src = *registers[opcode & 0x07];
-				bus.Set(HL, src);
-				return 8;
-			}
+	template <int Delta>
+	dword CPU::LD_A_mHL() // ldi A,(HL) / ldd A,(HL)
+	{
+		AF.hi = bus.Get(HL);
+		HL = HL + Delta;
+		return 8;
+	}
 
-			case 0xE0: // ld ($FF00 + n), A
-			{
-				address_t addr = 0xFF00 + util::get_immediate_byte(PC, bus);
-				bus.Set(addr, AF.hi);
-				return 12;
-			}
+	dword CPU::LDH_n_A() // ld ($FF00 + n), A
+	{
+		address_t addr = 0xFF00 + byte(operand);
+		bus.Set(addr, AF.hi);
+		return 12;
+	}
 
-			case 0xF0: // ld A, ($FF00 + n)
-			{
-				address_t addr = 0xFF00 + util::get_immediate_byte(PC, bus);
-				AF.hi = bus.Get(addr);
-				return 12;
-			}
+	dword CPU::LDH_A_n() // ld A, ($FF00 + n)
+	{
+		address_t addr = 0xFF00 + byte(operand);
+		AF.hi = bus.Get(addr);
+		return 12;
+	}
 
-			case 0xE2: // ld ($FF00 + C), A
-			{
-				bus.Set(0xFF00 + BC.lo, AF.hi);
-				return 8;
-			}
+	dword CPU::LDH_C_A() // ld ($FF00 + C), A
+	{
+		bus.Set(0xFF00 + BC.lo, AF.hi);
+		return 8;
+	}
 
-			case 0xF2: // ld A, ($FF00 + C)
-			{
-				AF.hi = bus.Get(0xFF00 + BC.lo);
-				return 8;
-			}
+	dword CPU::LDH_A_C() // ld A, ($FF00 + C)
+	{
+		AF.hi = bus.Get(0xFF00 + BC.lo);
+		return 8;
+	}
 
-			case 0xEA: // ld (nn), A
-			{
-				word immediate = util::get_immediate_word(PC, bus);
-				bus.Set(immediate, AF.hi);
-				return 16;
-			}
+	dword CPU::LD_nn_A() // ld (nn), A
+	{
+		word immediate = operand;
+		bus.Set(immediate, AF.hi);
+		return 16;
+	}
 
-			case 0xFA: // ld A, (nn)
-			{
-				word immediate = util::get_immediate_word(PC, bus);
-				AF.hi = bus.Get(immediate);
-				return 16;
-			}
+	dword CPU::LD_A_nn() // ld A, (nn)
+	{
+		word immediate = operand;
+		AF.hi = bus.Get(immediate);
+		return 16;
+	}
 
-			// ================================================
-			// ================= 16-bit LOADS =================
-			// ================================================
+	// ================================================
+	// ================= 16-bit LOADS =================
+	// ================================================
 
-			case 0x01: case 0x11: case 0x21: case 0x31: // ld wreg, nn
-			{
-				word &dst = *wregisters[opcode >> 4 & 0x03];
-				dst = util::get_immediate_word(PC, bus);
-				return 12;
-			}
+	template <byte RR>
+	dword CPU::LD_rr_nn() // ld wreg, nn
+	{
+		WordRegister<RR>() = operand;
+		return 12;
+	}
 
-			case 0x08: // ld (nn), SP
-			{
-				word immediate = util::get_immediate_word(PC, bus);
-				bus.Set(immediate, SP & 0xFF);
-				bus.Set(immediate + 1, (SP >> 8) & 0xFF);
-				return 20;
-			}
+	dword CPU::LD_nn_SP() // ld (nn), SP
+	{
+		word immediate = operand;
+		bus.Set(immediate, SP & 0xFF);
+		bus.Set(immediate + 1, (SP >> 8) & 0xFF);
+		return 20;
+	}
 
-			case 0xF8: // ld HL, SP+r8
-			{
-				sbyte immediate = util::get_immediate_sbyte(PC, bus);
-				HL = util::add_word_and_sbyte(SP, immediate, AF.flags);
-				return 12;
-			}
+	dword CPU::LD_HL_SPn() // ld HL, SP+r8
+	{
+		sbyte immediate = sbyte(operand);
+		HL = util::add_word_and_sbyte(SP, immediate, Flags());
+		return 12;
+	}
 
-			case 0xF9: // ld SP, HL
-			{
-				SP = HL;
-				return 8;
-			}
+	dword CPU::LD_SP_HL() // ld SP, HL
+	{
+		SP = HL;
+		return 8;
+	}
 
-			case 0xC1: case 0xD1: case 0xE1: // POP wreg (excluding AF)
-			{
-				word &dst = *wregisters[opcode >> 4 & 0x03];
-				dst = util::pop(SP, bus);
-				return 12;
-			}
+	template <byte RR>
+	dword CPU::POP_rr() // POP wreg (excluding AF)
+	{
+		WordRegister<RR>() = util::pop(SP, bus);
+		return 12;
+	}
 
-			case 0xF1: // POP AF
-			{
-				word v = util::pop(SP, bus);
-				AF = util::mask_AF(v);
-				return 12;
-			}
+	dword CPU::POP_AF()
+	{
+		word v = util::pop(SP, bus);
+		AF = util::mask_AF(v);
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		lazy_flags.op = lazy_flags_none;
+#endif
+		return 12;
+	}
 
-			case 0xC5: case 0xD5: case 0xE5: // PUSH wreg (excluding AF)
-			{
-				word val = *wregisters[opcode >> 4 & 0x03];
-				util::push(val, SP, bus);
-				return 16;
-			}
+	template <byte RR>
+	dword CPU::PUSH_rr() // PUSH wreg (excluding AF)
+	{
+		util::push(WordRegister<RR>(), SP, bus);
+		return 16;
+	}
 
-			case 0xF5: // PUSH AF
-			{
-				util::push(AF, SP, bus);
-				return 16;
-			}
+	dword CPU::PUSH_AF()
+	{
+		util::push(AF.hi << 8 | Flags(), SP, bus);
+		return 16;
+	}
 
-			// ================================================
-			// =========== 8-bit arithmetic/logical ===========
-			// ================================================
+	// ================================================
+	// =========== 8-bit arithmetic/logical ===========
+	// ================================================
 
-			case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x87: // add a,reg
-			case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8f: // adc a,reg
-			{
-				byte carry = (opcode >> 3 & 0x01) & AF.flags.cy;
-				AF.hi = util::add_with_carry(AF.hi, *registers[opcode & 0x07], carry, AF.flags);
-				return 4;
-			}
+	template <byte Op, byte S>
+	dword CPU::ALU_r() // add/adc/sub/sbc/and/xor/or/cp a,reg / a,(HL)
+	{
+		ALU<Op>(Read<S>());
+		return S == 6 ? 8 : 4;
+	}
 
-			case 0x86: // add a,(HL)
-			case 0x8E: // adc a,(HL)
-			{
-				byte carry = (opcode >> 3 & 0x01) & AF.flags.cy;
-				AF.hi = util::add_with_carry(AF.hi, bus.Get(HL), carry, AF.flags);
-				return 8;
-			}
+	template <byte Op>
+	dword CPU::ALU_n() // add/adc/sub/sbc/and/xor/or/cp a,n
+	{
+		ALU<Op>(byte(operand));
+		return 8;
+	}
 
-			case 0xC6: // add a,n
-			case 0xCE: // adc a,n
-			{
-				byte carry = (opcode >> 3 & 0x01) & AF.flags.cy;
-				AF.hi = util::add_with_carry(AF.hi, util::get_immediate_byte(PC, bus), carry, AF.flags);
-				return 8;
-			}
+	template <byte R>
+	dword CPU::INC_r() // inc reg / inc (HL)
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		byte v = Read<R>();
+		lazy_flags = { lazy_flags_inc, v, 1, 0, word(CarryFlag() << 8 | byte(v + 1)) };
+		Write<R>(v + 1);
+#else
+		Write<R>(util::increment_byte(Read<R>(), AF.flags));
+#endif
+		return R == 6 ? 12 : 4;
+	}
 
-			case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x97: // sub a,reg
-			case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9f: // sbc a,reg
-			{
-				byte carry = (opcode >> 3 & 0x01) & AF.flags.cy;
-				AF.hi = util::sub_with_carry(AF.hi, *registers[opcode & 0x07], carry, AF.flags);
-				return 4;
-			}
+	template <byte R>
+	dword CPU::DEC_r() // dec reg / dec (HL)
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		byte v = Read<R>();
+		lazy_flags = { lazy_flags_dec, v, 1, 0, word(CarryFlag() << 8 | byte(v - 1)) };
+		Write<R>(v - 1);
+#else
+		Write<R>(util::decrement_byte(Read<R>(), AF.flags));
+#endif
+		return R == 6 ? 12 : 4;
+	}
 
-			case 0x96: // sub a,(HL)
-			case 0x9E: // sbc a,(HL)
-			{
-				byte carry = (opcode >> 3 & 0x01) & AF.flags.cy;
-				AF.hi = util::sub_with_carry(AF.hi, bus.Get(HL), carry, AF.flags);
-				return 8;
-			}
+	dword CPU::DAA()
+	{
+		AF.hi = util::bcd_correction(AF.hi, Flags());
+		return 4;
+	}
 
-			case 0xD6: // sub a,n
-			case 0xDE: // sbc a,n
-			{
-				byte carry = (opcode >> 3 & 0x01) & AF.flags.cy;
-				AF.hi = util::sub_with_carry(AF.hi, util::get_immediate_byte(PC, bus), carry, AF.flags);
-				return 8;
-			}
+	dword CPU::SCF()
+	{
+		flags_t &flags = Flags();
+		flags.cy = 1;
+		flags.h = 0;
+		flags.n = 0;
+		return 4;
+	}
 
-			case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: case 0xA5: case 0xA7: // and a,reg
-			{
-				byte r = *registers[opcode & 0x07];
-				AF.hi = util::logical_and(AF.hi, r, AF.flags);
-				return 4;
-			}
+	dword CPU::CPL()
+	{
+		flags_t &flags = Flags();
+		AF.hi = AF.hi ^ 0xFF;
+		flags.n = 1;
+		flags.h = 1;
+		return 4;
+	}
 
-			case 0xA6: // and a,(HL)
-			{
-				AF.hi = util::logical_and(AF.hi, bus.Get(HL), AF.flags);
-				return 8;
-			}
+	dword CPU::CCF()
+	{
+		flags_t &flags = Flags();
+		flags.cy = flags.cy ^ 0x01;
+		flags.h = 0;
+		flags.n = 0;
+		return 4;
+	}
 
-			case 0xE6: // and a,n
-			{
-				AF.hi = util::logical_and(AF.hi, util::get_immediate_byte(PC, bus), AF.flags);
-				return 8;
-			}
+	// ================================================
+	// ========== 16-bit arithmetic/logical ===========
+	// ================================================
 
-			case 0xA8: case 0xA9: case 0xAA: case 0xAB: case 0xAC: case 0xAD: case 0xAF: // xor a,reg
-			{
-				byte r = *registers[opcode & 0x07];
-				AF.hi = util::logical_xor(AF.hi, r, AF.flags);
-				return 4;
-			}
+	template <byte RR>
+	dword CPU::INC_rr()
+	{
+		word &dst = WordRegister<RR>();
+		dst = util::increment_word(dst);
+		return 8;
+	}
 
-			case 0xAE: // xor a,(HL)
-			{
-				AF.hi = util::logical_xor(AF.hi, bus.Get(HL), AF.flags);
-				return 8;
-			}
+	template <byte RR>
+	dword CPU::DEC_rr()
+	{
+		word &dst = WordRegister<RR>();
+		dst = util::decrement_word(dst);
+		return 8;
+	}
 
-			case 0xEE: // xor a,n
-			{
-				AF.hi = util::logical_xor(AF.hi, util::get_immediate_byte(PC, bus), AF.flags);
-				return 8;
-			}
+	template <byte RR>
+	dword CPU::ADD_HL_rr()
+	{
+		HL = util::add_words(HL, WordRegister<RR>(), Flags());
+		return 8;
+	}
 
-			case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB7: // or a,reg
-			{
-				byte r = *registers[opcode & 0x07];
-				AF.hi = util::logical_or(AF.hi, r, AF.flags);
-				return 4;
-			}
+	dword CPU::ADD_SP_n() // add SP, r8
+	{
+		sbyte immediate = sbyte(operand);
+		SP = util::add_word_and_sbyte(SP, immediate, Flags());
+		return 16;
+	}
 
-			case 0xB6: // or a,(HL)
-			{
-				AF.hi = util::logical_or(AF.hi, bus.Get(HL), AF.flags);
-				return 8;
-			}
+	// ================================================
+	// =============== Jumps and Calls ================
+	// ================================================
 
-			case 0xF6: // or a,n
-			{
-				AF.hi = util::logical_or(AF.hi, util::get_immediate_byte(PC, bus), AF.flags);
-				return 8;
-			}
+	dword CPU::JR_n() // jr r8
+	{
+		sbyte offset = sbyte(operand);
+		PC += offset;
+		return 12;
+	}
 
-			case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBF: // cp reg
-			{
-				byte r = *registers[opcode & 0x07];
-				util::compare(AF.hi, r, AF.flags);
-				return 4;
-			}
+	template <byte CC>
+	dword CPU::JR_cc_n() // jr NZ/Z/NC/C r8
+	{
+		sbyte immediate = sbyte(operand);
+		if (Condition<CC>()) {
+			PC += immediate;
+			return 12;
+		}
+		return 8;
+	}
 
-			case 0xBE: // cp (HL)
-			{
-				util::compare(AF.hi, bus.Get(HL), AF.flags);
-				return 8;
-			}
+	dword CPU::JP_nn() // jp a16
+	{
+		word immediate = operand;
+		PC = immediate;
+		return 16;
+	}
 
-			case 0xFE: // cp n
-			{
-				util::compare(AF.hi, util::get_immediate_byte(PC, bus), AF.flags);
-				return 8;
-			}
+	template <byte CC>
+	dword CPU::JP_cc_nn() // jp NZ/Z/NC/C, a16
+	{
+		word immediate = operand;
+		if (Condition<CC>()) {
+			PC = immediate;
+			return 16;
+		}
+		return 12;
+	}
 
-			case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // inc r
-			{
-				byte &r = *registers[opcode >> 3 & 0x07];
-				r = util::increment_byte(r, AF.flags);
-				return 4;
-			}
+	dword CPU::JP_HL() // jp (HL)
+	{
+		PC = HL;
+		return 4;
+	}
 
-			case 0x34: // inc (HL)
-			{
-				bus.Set(HL, util::increment_byte(bus.Get(HL), AF.flags));
-				return 12;
-			}
+	dword CPU::CALL_nn() // call a16
+	{
+		word addr = operand;
+		util::call(addr, SP, PC, bus);
+		return 24;
+	}
 
-			case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // dec r
-			{
-				byte &r = *registers[opcode >> 3 & 0x07];
-				r = util::decrement_byte(r, AF.flags);
-				return 4;
-			}
+	template <byte CC>
+	dword CPU::CALL_cc_nn() // call NZ/Z/NC/C, a16
+	{
+		word immediate = operand;
+		if (Condition<CC>()) {
+			util::call(immediate, SP, PC, bus);
+			return 24;
+		}
+		return 12;
+	}
 
-			case 0x35: // dec (HL)
-			{
-				bus.Set(HL, util::decrement_byte(bus.Get(HL), AF.flags));
-				return 12;
-			}
+	dword CPU::RET()
+	{
+		util::ret(PC, SP, bus);
+		return 16;
+	}
 
-			case 0x27: // daa
-			{
-				AF.hi = util::bcd_correction(AF.hi, AF.flags);
-				return 4;
-			}
+	template <byte CC>
+	dword CPU::RET_cc() // ret NZ/Z/NC/C
+	{
+		if (Condition<CC>()) {
+			util::ret(PC, SP, bus);
+			return 20;
+		}
+		return 8;
+	}
 
-			case 0x37: // scf
-			{
-				AF.flags.cy = 1;
-				AF.flags.h = 0;
-				AF.flags.n = 0;
-				return 4;
-			}
+	dword CPU::RETI()
+	{
+		util::ret(PC, SP, bus);
+		interrupt_master_enable_flag = true;
+		return 16;
+	}
 
-			case 0x2F: // cpl
-			{
-				AF.hi = AF.hi ^ 0xFF;
-				AF.flags.n = 1;
-				AF.flags.h = 1;
-				return 4;
-			}
+	template <word Addr>
+	dword CPU::RST()
+	{
+		util::call(Addr, SP, PC, bus);
+		return 16;
+	}
 
-			case 0x3F: // ccf
-			{
-				AF.flags.cy = AF.flags.cy ^ 0x01;
-				AF.flags.h = 0;
-				AF.flags.n = 0;
-				return 4;
-			}
+	// ================================================
+	// =========== 8-bit Bit Instructions =============
+	// ================================================
 
-			// ================================================
-			// ========== 16-bit arithmetic/logical ===========
-			// ================================================
+	dword CPU::RLCA()
+	{
+		flags_t &flags = Flags();
+		AF.hi = util::rotate_left_through_carry(AF.hi, flags);
+		flags.zf = 0;
+		return 4;
+	}
 
-			case 0x03: case 0x13: case 0x23: case 0x33: // inc wreg
-			{
-				word &dst = *wregisters[opcode >> 4 & 0x03];
-				dst = util::increment_word(dst);
-				return 8;
-			}
+	dword CPU::RRCA()
+	{
+		flags_t &flags = Flags();
+		AF.hi = util::rotate_right_through_carry(AF.hi, flags);
+		flags.zf = 0;
+		return 4;
+	}
 
-			case 0x0B: case 0x1B: case 0x2B: case 0x3B: // dec wreg
-			{
-				word &dst = *wregisters[opcode >> 4 & 0x03];
-				dst = util::decrement_word(dst);
-				return 8;
-			}
+	dword CPU::RLA()
+	{
+		flags_t &flags = Flags();
+		AF.hi = util::rotate_left(AF.hi, flags);
+		flags.zf = 0;
+		return 4;
+	}
 
-			case 0x09: case 0x19: case 0x29: case 0x39: // add HL, wreg
-			{
-				word b = *wregisters[opcode >> 4 & 0x03];
-				HL = util::add_words(HL, b, AF.flags);
-				return 8;
-			}
+	dword CPU::RRA()
+	{
+		flags_t &flags = Flags();
+		AF.hi = util::rotate_right(AF.hi, flags);
+		flags.zf = 0;
+		return 4;
+	}
 
-			case 0xE8: // add SP, r8
-			{
-				sbyte immediate = util::get_immediate_sbyte(PC, bus);
-				SP = util::add_word_and_sbyte(SP, immediate, AF.flags);
-				return 16;
-			}
+	// ================================================
+	// =================== Control ====================
+	// ================================================
 
-			// ================================================
-			// =============== Jumps and Calls ================
-			// ================================================
+	dword CPU::NOP()
+	{
+		return 4;
+	}
 
-			case 0x18: // jp r8
-			{
-				sbyte offset = util::get_immediate_sbyte(PC, bus);
-				PC += offset;
-				return 12;
-			}
+	dword CPU::HALT()
+	{
+		if (!interrupt_master_enable_flag && interrupt_controller.InterruptPending()) {
+			// HALT BUG
+			next_fetch_is_halt_bug = true;
+		} else {
+			halted = true;
+		}
 
-			case 0x20: case 0x28: // jp NZ/Z r8
-			{
-				byte zero_check = opcode >> 3 & 0x01;
-				sbyte immediate = util::get_immediate_sbyte(PC, bus);
-				if (AF.flags.zf == zero_check) {
-					PC += immediate;
-					return 12;
-				}
-				return 8;
-			}
+		return 4;
+	}
 
-			case 0x30: case 0x38: // jp NC/C r8
-			{
-				byte carry_check = opcode >> 3 & 0x01;
-				sbyte immediate = util::get_immediate_sbyte(PC, bus);
-				if (AF.flags.cy == carry_check) {
-					PC += immediate;
-					return 12;
-				}
-				return 8;
-			}
+	dword CPU::STOP()
+	{
+		return 4;
+	}
 
-			case 0xC0: case 0xC8: // ret NZ/Z
-			{
-				byte zero_check = opcode >> 3 & 0x01;
-				if (AF.flags.zf == zero_check) {
-					util::ret(PC, SP, bus);
-					return 20;
-				}
-				return 8;
-			}
+	template <bool Enable>
+	dword CPU::DI_EI()
+	{
+		interrupt_master_enable_flag = Enable;
+		return 4;
+	}
 
-			case 0xD0: case 0xD8: // ret NC/C
-			{
-				byte carry_check = opcode >> 3 & 0x01;
-				if (AF.flags.cy == carry_check) {
-					util::ret(PC, SP, bus);
-					return 20;
-				}
-				return 8;
-			}
+	dword CPU::UNDEFINED()
+	{
+		std::cout << "Undefined opcode: " << std::hex << (int)bus.Get(PC - 1) << " at " << PC << std::endl;
+		system("pause");
+		return 0;
+	}
 
-			case 0xC2: case 0xCA: // JP NZ/Z, a16
-			{
-				byte zero_check = opcode >> 3 & 0x01;
-				word immediate = util::get_immediate_word(PC, bus);
-				if (AF.flags.zf == zero_check) {
-					PC = immediate;
-					return 16;
-				}
-				return 12;
-			}
+	// ================================================
+	// ================= CB Prefixed ==================
+	// ================================================
 
-			case 0xD2: case 0xDA: // JP NC/C, a16
-			{
-				byte carry_check = opcode >> 3 & 0x01;
-				word immediate = util::get_immediate_word(PC, bus);
-				if (AF.flags.cy == carry_check) {
-					PC = immediate;
-					return 16;
-				}
-				return 12;
-			}
+	template <opcode_t Opcode>
+	dword CPU::CB()
+	{
+		constexpr byte r = Opcode & 0x07;
+		constexpr byte bit = Opcode >> 3 & 0x07;
+		constexpr dword cycles = (r == 6) ? 16 : 8;
+
+		switch (Opcode >> 3) {
+			case 0x00: Write<r>(util::rotate_left_through_carry(Read<r>(), Flags())); return cycles; // rlc
+			case 0x01: Write<r>(util::rotate_right_through_carry(Read<r>(), Flags())); return cycles; // rrc
+			case 0x02: Write<r>(util::rotate_left(Read<r>(), Flags())); return cycles; // rl
+			case 0x03: Write<r>(util::rotate_right(Read<r>(), Flags())); return cycles; // rr
+			case 0x04: Write<r>(util::shift_left_arithmetic(Read<r>(), Flags())); return cycles; // sla
+			case 0x05: Write<r>(util::shift_right_arithmetic(Read<r>(), Flags())); return cycles; // sra
+			case 0x06: Write<r>(util::swap_nibbles(Read<r>(), Flags())); return cycles; // swap
+			case 0x07: Write<r>(util::shift_right_logical(Read<r>(), Flags())); return cycles; // srl
+		}
 
-			case 0xC3: // jp a16
-			{
-				word immediate = util::get_immediate_word(PC, bus);
-				PC = immediate;
-				return 16;
-			}
+		switch (Opcode >> 6) {
+			case 0x01: // bit b, reg
+				util::test_bit(Read<r>(), bit, Flags());
+				return (r == 6) ? 12 : 8;
 
-			case 0xC4: case 0xCC: // call NZ/Z, a16
-			{
-				byte zero_check = opcode >> 3 & 0x01;
-				word immediate = util::get_immediate_word(PC, bus);
-				if (AF.flags.zf == zero_check) {
-					util::call(immediate, SP, PC, bus);
-					return 24;
-				}
-				return 12;
-			}
+			case 0x02: // res b, reg
+				Write<r>(util::reset_bit(Read<r>(), bit));
+				return cycles;
 
-			case 0xD4: case 0xDC: // call NC/C, a16
-			{
-				byte carry_check = opcode >> 3 & 0x01;
-				word immediate = util::get_immediate_word(PC, bus);
-				if (AF.flags.cy == carry_check) {
-					util::call(immediate, SP, PC, bus);
-					return 24;
-				}
-				return 12;
-			}
+			case 0x03: default: // set b, reg
+				Write<r>(util::set_bit(Read<r>(), bit));
+				return cycles;
+		}
+	}
 
-			case 0xC7: case 0xD7: case 0xE7: case 0xF7: case 0xCF: case 0xDF: case 0xEF: case 0xFF: // rst
-			{
-				word addr = opcode & 0x30;
-				byte offset = opcode & 0x08;
-				util::call(addr + offset, SP, PC, bus);
-				return 16;
-			}
+	// the tables hold plain function pointers, calling through a member function pointer is much slower
+	template <dword (CPU::*Handler)()>
+	dword CPU::Op(CPU &cpu)
+	{
+		return (cpu.*Handler)();
+	}
 
-			case 0xC9: // ret
-			{
-				util::ret(PC, SP, bus);
-				return 16;
-			}
+	template <std::size_t... Opcodes>
+	constexpr std::array<opcode_handler_t, 256> CPU::MakeCBOpcodeTable(std::index_sequence<Opcodes...>)
+	{
+		return {{ &Op<&CPU::CB<Opcodes>>... }};
+	}
 
-			case 0xD9: // reti
-			{
-				util::ret(PC, SP, bus);
-				interrupt_master_enable_flag = true;
-				return 16;
-			}
+	const std::array<opcode_handler_t, 256> CPU::cb_opcode_table = CPU::MakeCBOpcodeTable(std::make_index_sequence<256>());
 
-			case 0xE9: // jp (HL)
-			{
-				PC = HL;
-				return 4;
-			}
+	// ================================================
+	// ================ Opcode table ==================
+	// ================================================
 
-			case 0xCD: // call addr
-			{
-				word addr = util::get_immediate_word(PC, bus);
-				util::call(addr, SP, PC, bus);
-				return 24;
-			}
+	// operand encodings used by the table below
+	namespace
+	{
+		enum : byte { B = 0, C = 1, D = 2, E = 3, H = 4, L = 5, mHL = 6, A = 7 };
+		enum : byte { rBC = 0, rDE = 1, rHL = 2, rSP = 3 };
+		enum : byte { NZ = 0, Z = 1, NC = 2, CY = 3 };
+		enum : byte { ADD = 0, ADC = 1, SUB = 2, SBC = 3, AND = 4, XOR = 5, OR = 6, CP = 7 };
+	}
 
-			// ================================================
-			// =========== 8-bit Bit Instructions =============
-			// ================================================
+	const std::array<opcode_handler_t, 256> CPU::opcode_table = {{
+		/* 0x00 */ &Op<&CPU::NOP>, &Op<&CPU::LD_rr_nn<rBC>>, &Op<&CPU::LD_mrr_A<rBC>>, &Op<&CPU::INC_rr<rBC>>, &Op<&CPU::INC_r<B>>, &Op<&CPU::DEC_r<B>>, &Op<&CPU::LD_r_n<B>>, &Op<&CPU::RLCA>,
+		/* 0x08 */ &Op<&CPU::LD_nn_SP>, &Op<&CPU::ADD_HL_rr<rBC>>, &Op<&CPU::LD_A_mrr<rBC>>, &Op<&CPU::DEC_rr<rBC>>, &Op<&CPU::INC_r<C>>, &Op<&CPU::DEC_r<C>>, &Op<&CPU::LD_r_n<C>>, &Op<&CPU::RRCA>,
+		/* 0x10 */ &Op<&CPU::STOP>, &Op<&CPU::LD_rr_nn<rDE>>, &Op<&CPU::LD_mrr_A<rDE>>, &Op<&CPU::INC_rr<rDE>>, &Op<&CPU::INC_r<D>>, &Op<&CPU::DEC_r<D>>, &Op<&CPU::LD_r_n<D>>, &Op<&CPU::RLA>,
+		/* 0x18 */ &Op<&CPU::JR_n>, &Op<&CPU::ADD_HL_rr<rDE>>, &Op<&CPU::LD_A_mrr<rDE>>, &Op<&CPU::DEC_rr<rDE>>, &Op<&CPU::INC_r<E>>, &Op<&CPU::DEC_r<E>>, &Op<&CPU::LD_r_n<E>>, &Op<&CPU::RRA>,
+		/* 0x20 */ &Op<&CPU::JR_cc_n<NZ>>, &Op<&CPU::LD_rr_nn<rHL>>, &Op<&CPU::LD_mHL_A<1>>, &Op<&CPU::INC_rr<rHL>>, &Op<&CPU::INC_r<H>>, &Op<&CPU::DEC_r<H>>, &Op<&CPU::LD_r_n<H>>, &Op<&CPU::DAA>,
+		/* 0x28 */ &Op<&CPU::JR_cc_n<Z>>, &Op<&CPU::ADD_HL_rr<rHL>>, &Op<&CPU::LD_A_mHL<1>>, &Op<&CPU::DEC_rr<rHL>>, &Op<&CPU::INC_r<L>>, &Op<&CPU::DEC_r<L>>, &Op<&CPU::LD_r_n<L>>, &Op<&CPU::CPL>,
+		/* 0x30 */ &Op<&CPU::JR_cc_n<NC>>, &Op<&CPU::LD_rr_nn<rSP>>, &Op<&CPU::LD_mHL_A<-1>>, &Op<&CPU::INC_rr<rSP>>, &Op<&CPU::INC_r<mHL>>, &Op<&CPU::DEC_r<mHL>>, &Op<&CPU::LD_r_n<mHL>>, &Op<&CPU::SCF>,
+		/* 0x38 */ &Op<&CPU::JR_cc_n<CY>>, &Op<&CPU::ADD_HL_rr<rSP>>, &Op<&CPU::LD_A_mHL<-1>>, &Op<&CPU::DEC_rr<rSP>>, &Op<&CPU::INC_r<A>>, &Op<&CPU::DEC_r<A>>, &Op<&CPU::LD_r_n<A>>, &Op<&CPU::CCF>,
+
+		/* 0x40 */ &Op<&CPU::LD_r_r<B, B>>, &Op<&CPU::LD_r_r<B, C>>, &Op<&CPU::LD_r_r<B, D>>, &Op<&CPU::LD_r_r<B, E>>, &Op<&CPU::LD_r_r<B, H>>, &Op<&CPU::LD_r_r<B, L>>, &Op<&CPU::LD_r_r<B, mHL>>, &Op<&CPU::LD_r_r<B, A>>,
+		/* 0x48 */ &Op<&CPU::LD_r_r<C, B>>, &Op<&CPU::LD_r_r<C, C>>, &Op<&CPU::LD_r_r<C, D>>, &Op<&CPU::LD_r_r<C, E>>, &Op<&CPU::LD_r_r<C, H>>, &Op<&CPU::LD_r_r<C, L>>, &Op<&CPU::LD_r_r<C, mHL>>, &Op<&CPU::LD_r_r<C, A>>,
+		/* 0x50 */ &Op<&CPU::LD_r_r<D, B>>, &Op<&CPU::LD_r_r<D, C>>, &Op<&CPU::LD_r_r<D, D>>, &Op<&CPU::LD_r_r<D, E>>, &Op<&CPU::LD_r_r<D, H>>, &Op<&CPU::LD_r_r<D, L>>, &Op<&CPU::LD_r_r<D, mHL>>, &Op<&CPU::LD_r_r<D, A>>,
+		/* 0x58 */ &Op<&CPU::LD_r_r<E, B>>, &Op<&CPU::LD_r_r<E, C>>, &Op<&CPU::LD_r_r<E, D>>, &Op<&CPU::LD_r_r<E, E>>, &Op<&CPU::LD_r_r<E, H>>, &Op<&CPU::LD_r_r<E, L>>, &Op<&CPU::LD_r_r<E, mHL>>, &Op<&CPU::LD_r_r<E, A>>,
+		/* 0x60 */ &Op<&CPU::LD_r_r<H, B>>, &Op<&CPU::LD_r_r<H, C>>, &Op<&CPU::LD_r_r<H, D>>, &Op<&CPU::LD_r_r<H, E>>, &Op<&CPU::LD_r_r<H, H>>, &Op<&CPU::LD_r_r<H, L>>, &Op<&CPU::LD_r_r<H, mHL>>, &Op<&CPU::LD_r_r<H, A>>,
+		/* 0x68 */ &Op<&CPU::LD_r_r<L, B>>, &Op<&CPU::LD_r_r<L, C>>, &Op<&CPU::LD_r_r<L, D>>, &Op<&CPU::LD_r_r<L, E>>, &Op<&CPU::LD_r_r<L, H>>, &Op<&CPU::LD_r_r<L, L>>, &Op<&CPU::LD_r_r<L, mHL>>, &Op<&CPU::LD_r_r<L, A>>,
+		/* 0x70 */ &Op<&CPU::LD_r_r<mHL, B>>, &Op<&CPU::LD_r_r<mHL, C>>, &Op<&CPU::LD_r_r<mHL, D>>, &Op<&CPU::LD_r_r<mHL, E>>, &Op<&CPU::LD_r_r<mHL, H>>, &Op<&CPU::LD_r_r<mHL, L>>, &Op<&CPU::HALT>, &Op<&CPU::LD_r_r<mHL, A>>,
+		/* 0x78 */ &Op<&CPU::LD_r_r<A, B>>, &Op<&CPU::LD_r_r<A, C>>, &Op<&CPU::LD_r_r<A, D>>, &Op<&CPU::LD_r_r<A, E>>, &Op<&CPU::LD_r_r<A, H>>, &Op<&CPU::LD_r_r<A, L>>, &Op<&CPU::LD_r_r<A, mHL>>, &Op<&CPU::LD_r_r<A, A>>,
+
+		/* 0x80 */ &Op<&CPU::ALU_r<ADD, B>>, &Op<&CPU::ALU_r<ADD, C>>, &Op<&CPU::ALU_r<ADD, D>>, &Op<&CPU::ALU_r<ADD, E>>, &Op<&CPU::ALU_r<ADD, H>>, &Op<&CPU::ALU_r<ADD, L>>, &Op<&CPU::ALU_r<ADD, mHL>>, &Op<&CPU::ALU_r<ADD, A>>,
+		/* 0x88 */ &Op<&CPU::ALU_r<ADC, B>>, &Op<&CPU::ALU_r<ADC, C>>, &Op<&CPU::ALU_r<ADC, D>>, &Op<&CPU::ALU_r<ADC, E>>, &Op<&CPU::ALU_r<ADC, H>>, &Op<&CPU::ALU_r<ADC, L>>, &Op<&CPU::ALU_r<ADC, mHL>>, &Op<&CPU::ALU_r<ADC, A>>,
+		/* 0x90 */ &Op<&CPU::ALU_r<SUB, B>>, &Op<&CPU::ALU_r<SUB, C>>, &Op<&CPU::ALU_r<SUB, D>>, &Op<&CPU::ALU_r<SUB, E>>, &Op<&CPU::ALU_r<SUB, H>>, &Op<&CPU::ALU_r<SUB, L>>, &Op<&CPU::ALU_r<SUB, mHL>>, &Op<&CPU::ALU_r<SUB, A>>,
+		/* 0x98 */ &Op<&CPU::ALU_r<SBC, B>>, &Op<&CPU::ALU_r<SBC, C>>, &Op<&CPU::ALU_r<SBC, D>>, &Op<&CPU::ALU_r<SBC, E>>, &Op<&CPU::ALU_r<SBC, H>>, &Op<&CPU::ALU_r<SBC, L>>, &Op<&CPU::ALU_r<SBC, mHL>>, &Op<&CPU::ALU_r<SBC, A>>,
+		/* 0xA0 */ &Op<&CPU::ALU_r<AND, B>>, &Op<&CPU::ALU_r<AND, C>>, &Op<&CPU::ALU_r<AND, D>>, &Op<&CPU::ALU_r<AND, E>>, &Op<&CPU::ALU_r<AND, H>>, &Op<&CPU::ALU_r<AND, L>>, &Op<&CPU::ALU_r<AND, mHL>>, &Op<&CPU::ALU_r<AND, A>>,
+		/* 0xA8 */ &Op<&CPU::ALU_r<XOR, B>>, &Op<&CPU::ALU_r<XOR, C>>, &Op<&CPU::ALU_r<XOR, D>>, &Op<&CPU::ALU_r<XOR, E>>, &Op<&CPU::ALU_r<XOR, H>>, &Op<&CPU::ALU_r<XOR, L>>, &Op<&CPU::ALU_r<XOR, mHL>>, &Op<&CPU::ALU_r<XOR, A>>,
+		/* 0xB0 */ &Op<&CPU::ALU_r<OR, B>>, &Op<&CPU::ALU_r<OR, C>>, &Op<&CPU::ALU_r<OR, D>>, &Op<&CPU::ALU_r<OR, E>>, &Op<&CPU::ALU_r<OR, H>>, &Op<&CPU::ALU_r<OR, L>>, &Op<&CPU::ALU_r<OR, mHL>>, &Op<&CPU::ALU_r<OR, A>>,
+		/* 0xB8 */ &Op<&CPU::ALU_r<CP, B>>, &Op<&CPU::ALU_r<CP, C>>, &Op<&CPU::ALU_r<CP, D>>, &Op<&CPU::ALU_r<CP, E>>, &Op<&CPU::ALU_r<CP, H>>, &Op<&CPU::ALU_r<CP, L>>, &Op<&CPU::ALU_r<CP, mHL>>, &Op<&CPU::ALU_r<CP, A>>,
+
+		/* 0xC0 */ &Op<&CPU::RET_cc<NZ>>, &Op<&CPU::POP_rr<rBC>>, &Op<&CPU::JP_cc_nn<NZ>>, &Op<&CPU::JP_nn>, &Op<&CPU::CALL_cc_nn<NZ>>, &Op<&CPU::PUSH_rr<rBC>>, &Op<&CPU::ALU_n<ADD>>, &Op<&CPU::RST<0x00>>,
+		/* 0xC8 */ &Op<&CPU::RET_cc<Z>>, &Op<&CPU::RET>, &Op<&CPU::JP_cc_nn<Z>>, &Op<&CPU::HandleCBPrefixOpcode>, &Op<&CPU::CALL_cc_nn<Z>>, &Op<&CPU::CALL_nn>, &Op<&CPU::ALU_n<ADC>>, &Op<&CPU::RST<0x08>>,
+		/* 0xD0 */ &Op<&CPU::RET_cc<NC>>, &Op<&CPU::POP_rr<rDE>>, &Op<&CPU::JP_cc_nn<NC>>, &Op<&CPU::UNDEFINED>, &Op<&CPU::CALL_cc_nn<NC>>, &Op<&CPU::PUSH_rr<rDE>>, &Op<&CPU::ALU_n<SUB>>, &Op<&CPU::RST<0x10>>,
+		/* 0xD8 */ &Op<&CPU::RET_cc<CY>>, &Op<&CPU::RETI>, &Op<&CPU::JP_cc_nn<CY>>, &Op<&CPU::UNDEFINED>, &Op<&CPU::CALL_cc_nn<CY>>, &Op<&CPU::UNDEFINED>, &Op<&CPU::ALU_n<SBC>>, &Op<&CPU::RST<0x18>>,
+		/* 0xE0 */ &Op<&CPU::LDH_n_A>, &Op<&CPU::POP_rr<rHL>>, &Op<&CPU::LDH_C_A>, &Op<&CPU::UNDEFINED>, &Op<&CPU::UNDEFINED>, &Op<&CPU::PUSH_rr<rHL>>, &Op<&CPU::ALU_n<AND>>, &Op<&CPU::RST<0x20>>,
+		/* 0xE8 */ &Op<&CPU::ADD_SP_n>, &Op<&CPU::JP_HL>, &Op<&CPU::LD_nn_A>, &Op<&CPU::UNDEFINED>, &Op<&CPU::UNDEFINED>, &Op<&CPU::UNDEFINED>, &Op<&CPU::ALU_n<XOR>>, &Op<&CPU::RST<0x28>>,
+		/* 0xF0 */ &Op<&CPU::LDH_A_n>, &Op<&CPU::POP_AF>, &Op<&CPU::LDH_A_C>, &Op<&CPU::DI_EI<false>>, &Op<&CPU::UNDEFINED>, &Op<&CPU::PUSH_AF>, &Op<&CPU::ALU_n<OR>>, &Op<&CPU::RST<0x30>>,
+		/* 0xF8 */ &Op<&CPU::LD_HL_SPn>, &Op<&CPU::LD_SP_HL>, &Op<&CPU::LD_A_nn>, &Op<&CPU::DI_EI<true>>, &Op<&CPU::UNDEFINED>, &Op<&CPU::UNDEFINED>, &Op<&CPU::ALU_n<CP>>, &Op<&CPU::RST<0x38>>,
+	}};
+
+	// instruction lengths in bytes. CB prefixed opcodes fetch their second byte themselves
+	const std::array<byte, 256> CPU::opcode_lengths = {{
+		/* 0x00 */ 1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+		/* 0x10 */ 1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+		/* 0x20 */ 2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+		/* 0x30 */ 2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+		/* 0x40 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0x50 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0x60 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0x70 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0x80 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0x90 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0xA0 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0xB0 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		/* 0xC0 */ 1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,
+		/* 0xD0 */ 1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+		/* 0xE0 */ 2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+		/* 0xF0 */ 2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+	}};
 
-			case 0x07: // rlca
-			{
-				AF.hi = util::rotate_left_through_carry(AF.hi, AF.flags);
-				AF.flags.zf = 0;
-				return 4;
-			}
+	dword CPU::HandleCBPrefixOpcode()
+	{
+		opcode_t opcode = bus.Get(PC);
+		PC += 1;
 
-			case 0x0F: // rrca
-			{
-				AF.hi = util::rotate_right_through_carry(AF.hi, AF.flags);
-				AF.flags.zf = 0;
-				return 4;
-			}
+		return cb_opcode_table[opcode](*this);
+	}
 
-			case 0x17: // rla
-			{
-				AF.hi = util::rotate_left(AF.hi, AF.flags);
-				AF.flags.zf = 0;
-				return 4;
-			}
+	// reads the next opcode and its operand, leaving PC at the following instruction. after the halt bug
+	// PC stays put once, so the byte after halt is read twice
+	inline opcode_t CPU::Fetch()
+	{
+		opcode_t opcode = bus.Get(PC);
 
-			case 0x1F: // rra
-			{
-				AF.hi = util::rotate_right(AF.hi, AF.flags);
-				AF.flags.zf = 0;
-				return 4;
-			}
+		if (next_fetch_is_halt_bug)
+			next_fetch_is_halt_bug = false;
+		else
+			PC += 1;
 
-			// ================================================
-			// =================== Control ====================
-			// ================================================
+		switch (opcode_lengths[opcode]) {
+			case 2: operand = util::get_immediate_byte(PC, bus); break;
+			case 3: operand = util::get_immediate_word(PC, bus); break;
+		}
 
-			case 0x00: // noop
-			{
-				return 4;
-			}
+		return opcode;
+	}
 
-			case 0x76: // halt
-			{
-				if (!interrupt_master_enable_flag && (interrupt_controller.interrupt_flags & interrupt_controller.interrupt_enable)) {
-					// HALT BUG
-					next_fetch_is_halt_bug = true;
-				} else {
-					halted = true;
-				}
+	dword CPU::Step()
+	{
+		opcode_t opcode = Fetch();
+		return opcode_table[opcode](*this);
+	}
 
-				return 4;
-			}
+	// the work done between two instructions.
+	// cycles is replaced with the cycles spent handling interrupts before the next instruction
+	bool CPU::FinishInstruction(dword &cycles)
+	{
+		scheduler.Advance(cycles);
 
-			case 0x10: // stop
-			{
-				return 4;
-			}
+		if (!running)
+			return false;
 
-			case 0xF3: case 0xFB: // DI/EI
-			{
-				interrupt_master_enable_flag = (opcode >> 3) & 0x01;
-				return 4;
-			}
+		cycles = HandleInterrupts();
+		return true;
+	}
 
-			case 0xCB: // prefix CB
-			{
-				return HandleCBPrefixOpcode();
-			}
+	// halted, the cpu does nothing but spend 4 cycles at a time until an interrupt is pending. only an event
+	// can raise one, so skip to the first of those 4 cycle steps that reaches the next event
+	dword CPU::GetHaltedCycles(dword cycles) const
+	{
+		cycle_t now = scheduler.Now() + cycles;
+		cycle_t next_event = scheduler.NextEvent();
 
-			default:
-			{
-				std::cout << "Undefined opcode: " << std::hex << (int)opcode << " at " << PC << std::endl;
-				system("pause");
-				return 0;
-			}
-		}
+		if (next_event == Scheduler::never || next_event <= now + 4)
+			return 4;
 
-		return true;
+		return dword(next_event - now + 3) & ~3;
 	}
 
 	dword CPU::HandleInterrupts()
 	{
+		// nearly always nothing is both enabled and requested
+		if (!interrupt_controller.InterruptPending())
+			return 0;
+
 		dword cycles = 0;
 
-		interrupt_flags_t interrupt_enable = interrupt_controller.interrupt_enable;
-		interrupt_flags_t &interrupt_flags = interrupt_controller.interrupt_flags;
-		interrupt_flags_t interrupts_to_execute = interrupt_enable & interrupt_flags;
+		interrupt_flags_t interrupts_to_execute = interrupt_controller.interrupt_enable & interrupt_controller.interrupt_flags;
 
 		if (halted && interrupts_to_execute) {
 			halted = false;
@@ -890,7 +793,7 @@ namespace dromaiusgb
 		// check V-Blank
 		if (interrupts_to_execute.vblank)
 		{
-			interrupt_flags.vblank = 0;
+			interrupt_controller.AcknowledgeInterrupt(InterruptFlags::VBlank);
 			interrupt_master_enable_flag = false;
 
 			util::call(0x40, SP, PC, bus);
@@ -900,7 +803,7 @@ namespace dromaiusgb
 		// check LCD STAT
 		else if (interrupts_to_execute.lcd_stat)
 		{
-			interrupt_flags.lcd_stat = 0;
+			interrupt_controller.AcknowledgeInterrupt(InterruptFlags::LCDStat);
 			interrupt_master_enable_flag = false;
 
 			util::call(0x48, SP, PC, bus);
@@ -910,7 +813,7 @@ namespace dromaiusgb
 		// check Timer
 		else if (interrupts_to_execute.timer)
 		{
-			interrupt_flags.timer = 0;
+			interrupt_controller.AcknowledgeInterrupt(InterruptFlags::Timer);
 			interrupt_master_enable_flag = false;
 
 			util::call(0x50, SP, PC, bus);
@@ -920,7 +823,7 @@ namespace dromaiusgb
 		// check Serial
 		else if (interrupts_to_execute.serial)
 		{
-			interrupt_flags.serial = 0;
+			interrupt_controller.AcknowledgeInterrupt(InterruptFlags::Serial);
 			interrupt_master_enable_flag = false;
 
 			util::call(0x58, SP, PC, bus);
@@ -930,7 +833,7 @@ namespace dromaiusgb
 		// check Joypad
 		else if (interrupts_to_execute.joypad)
 		{
-			interrupt_flags.joypad = 0;
+			interrupt_controller.AcknowledgeInterrupt(InterruptFlags::Joypad);
 			interrupt_master_enable_flag = false;
 
 			util::call(0x60, SP, PC, bus);
@@ -940,46 +843,465 @@ namespace dromaiusgb
 		return cycles;
 	}
 
-	void CPU::Start()
+#ifdef __GNUC__
+
+	// every opcode, as the hex digits of its encoding
+	#define DROMAIUSGB_OPCODES(X) \
+		X(00) X(01) X(02) X(03) X(04) X(05) X(06) X(07) X(08) X(09) X(0A) X(0B) X(0C) X(0D) X(0E) X(0F) \
+		X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(1A) X(1B) X(1C) X(1D) X(1E) X(1F) \
+		X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(2A) X(2B) X(2C) X(2D) X(2E) X(2F) \
+		X(30) X(31) X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(3A) X(3B) X(3C) X(3D) X(3E) X(3F) \
+		X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) X(49) X(4A) X(4B) X(4C) X(4D) X(4E) X(4F) \
+		X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(5A) X(5B) X(5C) X(5D) X(5E) X(5F) \
+		X(60) X(61) X(62) X(63) X(64) X(65) X(66) X(67) X(68) X(69) X(6A) X(6B) X(6C) X(6D) X(6E) X(6F) \
+		X(70) X(71) X(72) X(73) X(74) X(75) X(76) X(77) X(78) X(79) X(7A) X(7B) X(7C) X(7D) X(7E) X(7F) \
+		X(80) X(81) X(82) X(83) X(84) X(85) X(86) X(87) X(88) X(89) X(8A) X(8B) X(8C) X(8D) X(8E) X(8F) \
+		X(90) X(91) X(92) X(93) X(94) X(95) X(96) X(97) X(98) X(99) X(9A) X(9B) X(9C) X(9D) X(9E) X(9F) \
+		X(A0) X(A1) X(A2) X(A3) X(A4) X(A5) X(A6) X(A7) X(A8) X(A9) X(AA) X(AB) X(AC) X(AD) X(AE) X(AF) \
+		X(B0) X(B1) X(B2) X(B3) X(B4) X(B5) X(B6) X(B7) X(B8) X(B9) X(BA) X(BB) X(BC) X(BD) X(BE) X(BF) \
+		X(C0) X(C1) X(C2) X(C3) X(C4) X(C5) X(C6) X(C7) X(C8) X(C9) X(CA) X(CB) X(CC) X(CD) X(CE) X(CF) \
+		X(D0) X(D1) X(D2) X(D3) X(D4) X(D5) X(D6) X(D7) X(D8) X(D9) X(DA) X(DB) X(DC) X(DD) X(DE) X(DF) \
+		X(E0) X(E1) X(E2) X(E3) X(E4) X(E5) X(E6) X(E7) X(E8) X(E9) X(EA) X(EB) X(EC) X(ED) X(EE) X(EF) \
+		X(F0) X(F1) X(F2) X(F3) X(F4) X(F5) X(F6) X(F7) X(F8) X(F9) X(FA) X(FB) X(FC) X(FD) X(FE) X(FF)
+
+	// repeated at the end of every opcode body so each one has its own indirect jump to the next opcode
+	#define DROMAIUSGB_DISPATCH() \
+		if (!FinishInstruction(cycles)) \
+			return; \
+		if (halted) { \
+			cycles += GetHaltedCycles(cycles); \
+			goto halted_loop; \
+		} \
+		opcode = Fetch(); \
+		goto *opcode_labels[opcode];
+
+	#define DROMAIUSGB_OPCODE_LABEL(n) &&opcode_##n,
+	#define DROMAIUSGB_CB_OPCODE_LABEL(n) &&cb_opcode_##n,
+
+	#define DROMAIUSGB_OPCODE_BODY(n) \
+		opcode_##n: \
+			if (0x##n == 0xCB) \
+				goto prefix_cb; \
+			cycles += opcode_table[0x##n](*this); \
+			DROMAIUSGB_DISPATCH()
+
+	#define DROMAIUSGB_CB_OPCODE_BODY(n) \
+		cb_opcode_##n: \
+			cycles += cb_opcode_table[0x##n](*this); \
+			DROMAIUSGB_DISPATCH()
+
+	void CPU::RunThreaded()
 	{
-		if (running)
+		static void *const opcode_labels[256] = { DROMAIUSGB_OPCODES(DROMAIUSGB_OPCODE_LABEL) };
+		static void *const cb_opcode_labels[256] = { DROMAIUSGB_OPCODES(DROMAIUSGB_CB_OPCODE_LABEL) };
+
+		dword cycles = 0;
+		opcode_t opcode;
+
+		// enter through the halted path with no cycles spent, as if an instruction just finished
+		if (!running)
 			return;
 
-		running = true;
+		cycles = HandleInterrupts();
+		if (!halted) {
+			opcode = Fetch();
+			goto *opcode_labels[opcode];
+		}
+
+		cycles += GetHaltedCycles(cycles);
+
+	halted_loop:
+		DROMAIUSGB_DISPATCH()
+
+	prefix_cb:
+		opcode = bus.Get(PC);
+		PC += 1;
+		goto *cb_opcode_labels[opcode];
+
+		DROMAIUSGB_OPCODES(DROMAIUSGB_OPCODE_BODY)
+		DROMAIUSGB_OPCODES(DROMAIUSGB_CB_OPCODE_BODY)
+	}
 
-		// start a thread to Step the cpu
-		thread = std::thread([&] {
-			while (running) {
-				dword cycles = HandleInterrupts();
+	#undef DROMAIUSGB_OPCODES
+	#undef DROMAIUSGB_DISPATCH
+	#undef DROMAIUSGB_OPCODE_LABEL
+	#undef DROMAIUSGB_CB_OPCODE_LABEL
+	#undef DROMAIUSGB_OPCODE_BODY
+	#undef DROMAIUSGB_CB_OPCODE_BODY
 
-				if (halted)
-					cycles += 4;
-				else
-					cycles += Step();
+#endif
 
-				// tick the internal timer
-				timer.Tick(cycles);
+	// ================================================
+	// ================= Block cache ==================
+	// ================================================
 
-				// tick LCD driver
-				lcd.Tick(cycles);
+	bool CPU::EndsBlock(opcode_t opcode)
+	{
+		switch (opcode) {
+			case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // jr
+			case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // jp
+			case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // call
+			case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // ret, reti
+			case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // rst
+			case 0x10: case 0x76: // stop, halt
+			case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD: // undefined
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	// decodes from code[offset] up to the end of the block or of the page, whichever comes first
+	basic_block_t CPU::DecodeBlock(const byte *code, byte offset) const
+	{
+		basic_block_t block;
+
+		for (unsigned int i = offset; i < 0x100; ) {
+			opcode_t opcode = code[i];
+			instruction_t instruction{ opcode_table[opcode], 0, opcode_lengths[opcode], opcode };
+
+			if (opcode == 0xCB) {
+				if (i + 1 >= 0x100)
+					break;
+
+				instruction = { cb_opcode_table[code[i + 1]], code[i + 1], 2, opcode };
+			}
+
+			// an instruction running over in to the next page is left to Step
+			if (i + instruction.length > 0x100)
+				break;
+
+			if (instruction.length == 2 && opcode != 0xCB)
+				instruction.operand = code[i + 1];
+			else if (instruction.length == 3)
+				instruction.operand = code[i + 1] | (code[i + 2] << 8);
+
+			block.instructions.push_back(instruction);
+			i += instruction.length;
+
+			if (EndsBlock(opcode))
+				break;
+		}
+
+		return block;
+	}
+
+	// loops that poll memory, like ldh a,(0x44); cp 0x90; jr nz. whether one really is idle is only known
+	// once it runs, this rules out anything that writes memory, uses the stack or leaves the loop
+	bool CPU::IsIdleLoop(const basic_block_t &block, address_t start)
+	{
+		word next = start;
+
+		for (const instruction_t &instruction : block.instructions) {
+			opcode_t opcode = instruction.opcode;
+			next += instruction.length;
+
+			if (&instruction == &block.instructions.back()) {
+				switch (opcode) {
+					case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // jr
+						return word(next + sbyte(instruction.operand)) == start;
+
+					case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // jp
+						return instruction.operand == start;
+
+					default:
+						return false;
+				}
+			}
+
+			if (opcode == 0xCB) {
+				// only bit reads (HL), everything else writes it back
+				if ((instruction.operand & 0x07) == 6 && (instruction.operand & 0xC0) != 0x40)
+					return false;
+
+				continue;
+			}
+
+			if (opcode >= 0x40 && opcode < 0xC0) {
+				// ld (HL),r and halt
+				if (opcode >= 0x70 && opcode < 0x78)
+					return false;
+
+				continue;
 			}
-		});
+
+			switch (opcode) {
+				case 0x00: // nop
+				case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // ld r,n
+				case 0x0A: case 0x1A: case 0xF0: case 0xF2: case 0xFA: // ld a,(rr) / ldh a,(n) / ldh a,(C) / ld a,(nn)
+				case 0x04: case 0x05: case 0x0C: case 0x0D: case 0x14: case 0x15: case 0x1C: case 0x1D: // inc/dec r
+				case 0x24: case 0x25: case 0x2C: case 0x2D: case 0x3C: case 0x3D:
+				case 0x03: case 0x0B: case 0x13: case 0x1B: case 0x23: case 0x2B: // inc/dec rr
+				case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x27: case 0x2F: case 0x37: case 0x3F: // rotates on A, daa, cpl, scf, ccf
+				case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // alu a,n
+					continue;
+
+				default:
+					return false;
+			}
+		}
+
+		return false;
+	}
+
+	// whether everything the block reads only changes at scheduler events or by cpu writes. the joypad is
+	// changed by the ui thread, and div and tima count up between events
+	bool CPU::ReadsSteadyMemory(const basic_block_t &block) const
+	{
+		for (const instruction_t &instruction : block.instructions) {
+			opcode_t opcode = instruction.opcode;
+			address_t addr;
+
+			switch (opcode) {
+				case 0xF0: addr = 0xFF00 + byte(instruction.operand); break;
+				case 0xF2: addr = 0xFF00 + BC.lo; break;
+				case 0xFA: addr = instruction.operand; break;
+				case 0x0A: addr = BC; break;
+				case 0x1A: addr = DE; break;
+
+				default:
+				{
+					bool reads_HL = (opcode == 0xCB) ? (instruction.operand & 0x07) == 6 : (opcode >= 0x40 && opcode < 0xC0 && (opcode & 0x07) == 6);
+					if (!reads_HL)
+						continue;
+
+					addr = HL;
+					break;
+				}
+			}
+
+			if (addr == 0xFF00 || (addr >= 0xFF04 && addr <= 0xFF07))
+				return false;
+		}
+
+		return true;
 	}
 
-	void CPU::Stop()
+	// a pass over an idle loop left the registers as the previous pass did. every pass until the next event
+	// reads the same memory and does the same thing, so skip all the passes that end before it
+	void CPU::SkipIdleLoop(dword pass_cycles)
 	{
+		cycle_t now = scheduler.Now();
+		cycle_t next_event = scheduler.NextEvent();
+
+		if (next_event == Scheduler::never || next_event <= now + pass_cycles)
+			return;
+
+		dword skipped = dword((next_event - 1 - now) / pass_cycles) * pass_cycles;
+		idle_cycles_skipped += skipped;
+		scheduler.Advance(skipped);
+	}
+
+	void CPU::RunBlocks()
+	{
+		// passes over a loop candidate in a row that changed the registers before it is given up on
+		const byte idle_loop_max_misses = 4;
+
 		if (!running)
 			return;
 
-		running = false;
-		thread.join();
+		dword cycles = HandleInterrupts();
+
+		// the idle loop candidate whose pass just ended back at its start, and the registers it left
+		const basic_block_t *idle_pass = nullptr;
+		std::array<word, 5> idle_registers;
+
+		while (true) {
+			basic_block_t *block = nullptr;
+			const basic_block_t *previous_pass = idle_pass;
+			idle_pass = nullptr;
+
+			// the halt bug re-reads a byte, which only Step knows how to do
+			if (!halted && !next_fetch_is_halt_bug) {
+				code_page_t *page = block_cache.GetPage(PC);
+				if (page) {
+					block = page->blocks[PC & 0xFF].get();
+					if (!block) {
+						block = block_cache.Insert(*page, PC, DecodeBlock(page->code, PC & 0xFF));
+						block->idle_loop = IsIdleLoop(*block, PC);
+					}
+				}
+			}
+
+			if (!block || block->instructions.empty()) {
+				cycles += halted ? GetHaltedCycles(cycles) : Step();
+
+				if (!FinishInstruction(cycles))
+					return;
+
+				continue;
+			}
+
+#ifdef DROMAIUSGB_JIT
+			// hot blocks from rom run as native code, except for loops that may turn out to be idle
+			if (!block->native && !(block->idle_loop && idle_loop_detection) && ++block->executions == Jit::threshold && !bus.IsPageWritable(PC)) {
+				block->native = jit.Compile(*block, PC);
+				block->native_address = PC;
+			}
+
+			if (block->native && block->native_address == PC) {
+				jit.Run(*block, cycles);
+
+				if (!running)
+					return;
+
+				cycles = HandleInterrupts();
+				continue;
+			}
+#endif
+
+			// interrupts, writes to the block's own code and bank switches all leave the block early
+			dword generation = block_cache.Generation();
+			word start = PC;
+			word next = PC;
+			dword pass_cycles = 0;
+			cycle_t pass_event = scheduler.NextEvent();
+
+			for (const instruction_t &instruction : block->instructions) {
+				operand = instruction.operand;
+				next += instruction.length;
+				PC = next;
+
+				dword instruction_cycles = instruction.handler(*this);
+				cycles += instruction_cycles;
+				pass_cycles += instruction_cycles;
+
+				if (!FinishInstruction(cycles))
+					return;
+
+				if (PC != next || halted || block_cache.Generation() != generation)
+					break;
+			}
+
+			// back at the top of a loop candidate without an interrupt being taken
+			if (block->idle_loop && idle_loop_detection && PC == start && cycles == 0) {
+				std::array<word, 5> registers = { word(AF.hi << 8 | Flags()), BC, DE, HL, SP };
+
+				if (previous_pass == block && registers == idle_registers) {
+					if (!ReadsSteadyMemory(*block)) {
+						block->idle_loop = false;
+					} else if (scheduler.NextEvent() == pass_event) {
+						// only a pass no event ran during has read what every pass up to the next event will
+						SkipIdleLoop(pass_cycles);
+						block->idle_loop_misses = 0;
+					}
+				} else if (previous_pass == block && ++block->idle_loop_misses == idle_loop_max_misses) {
+					// still changing state, so it counts or waits on something of its own
+					block->idle_loop = false;
+				}
+
+				idle_pass = block;
+				idle_registers = registers;
+			}
+		}
 	}
 
-	void CPU::Toggle()
+	void CPU::Run()
 	{
-		if (running)
-			Stop();
+#ifdef __GNUC__
+		if (threaded_interpreter)
+			RunThreaded();
 		else
-			Start();
+			RunBlocks();
+#else
+		RunBlocks();
+#endif
+		// leave F up to date for anyone looking at the stopped cpu
+		Flags();
+	}
+
+	// the stop event ends the run at the first instruction boundary at or after it
+	void CPU::RunCycles(cycle_t cycles)
+	{
+		if (running)
+			return;
+
+		running = true;
+		scheduler.Schedule(Event::Stop, scheduler.Now() + cycles);
+		Run();
+		scheduler.Schedule(Event::Stop, Scheduler::never);
+		running = false;
+	}
+
+	void CPU::CatchUp()
+	{
+		running = false;
+	}
+
+	void CPU::SaveState(State &state) const
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		// F as it reads, not the pending operation, so the state doesn't depend on when flags were last worked out
+		register_t af = AF;
+		af.flags = PendingFlags();
+		state.Write(af);
+#else
+		state.Write(AF);
+#endif
+		state.Write(BC);
+		state.Write(DE);
+		state.Write(HL);
+		state.Write(SP);
+		state.Write(PC);
+		state.Write(interrupt_master_enable_flag);
+		state.Write(halted.load());
+		state.Write(next_fetch_is_halt_bug);
+	}
+
+	void CPU::LoadState(State &state)
+	{
+		bool was_halted;
+
+		state.Read(AF);
+		state.Read(BC);
+		state.Read(DE);
+		state.Read(HL);
+		state.Read(SP);
+		state.Read(PC);
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		lazy_flags.op = lazy_flags_none;
+#endif
+		state.Read(interrupt_master_enable_flag);
+		state.Read(was_halted);
+		state.Read(next_fetch_is_halt_bug);
+		halted = was_halted;
+
+		block_cache.Reloaded();
+	}
+
+	void CPU::SetIdleLoopDetection(bool enable)
+	{
+		idle_loop_detection = enable;
+	}
+
+	cycle_t CPU::GetIdleCyclesSkipped() const
+	{
+		return idle_cycles_skipped;
+	}
+
+	// stays off where it isn't built
+	void CPU::SetThreadedInterpreter(bool enable)
+	{
+#ifdef __GNUC__
+		threaded_interpreter = enable;
+#endif
+	}
+
+	bool CPU::IsThreadedInterpreter() const
+	{
+		return threaded_interpreter;
+	}
+
+#ifdef DROMAIUSGB_JIT
+	void CPU::SetJitLockstep(bool enable)
+	{
+		jit.SetLockstep(enable);
+	}
+
+	dword CPU::GetJitLockstepMismatches() const
+	{
+		return jit.GetLockstepMismatches();
 	}
+#endif
 }
\ No newline at end of file
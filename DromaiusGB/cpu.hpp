@@ -1,19 +1,23 @@
 #pragma once
 
-#include "lcd.hpp"
-#include "timer.hpp"
+#include "scheduler.hpp"
 #include "interrupts.hpp"
+#include "block_cache.hpp"
+#include "jit.hpp"
+#include "state.hpp"
 
+#include <array>
 #include <atomic>
-#include <thread>
-#include <SFML/Window.hpp>
+#include <utility>
+
+#if defined(DROMAIUSGB_THREADED_INTERPRETER) && !defined(__GNUC__)
+#error "the threaded interpreter needs computed goto (GCC or Clang)"
+#endif
 
 
 namespace dromaiusgb
 {
 
-	typedef byte opcode_t;
-
 	union flags_t
 	{
 		byte value;
@@ -26,7 +30,6 @@ namespace dromaiusgb
 			byte zf : 1;
 		};
 
-		flags_t(int i) : value(i) {}
 		operator byte() const { return value; }
 	};
 
@@ -47,7 +50,7 @@ namespace dromaiusgb
 		operator word() const { return value; }
 	};
 
-	class CPU
+	class CPU : public Scheduled
 	{
 	private:
 		register_t AF;
@@ -57,8 +60,27 @@ namespace dromaiusgb
 		word SP;
 		word PC;
 
-		byte *registers[8];
-		word *wregisters[4];
+		// the immediate byte or word of the current instruction, fetched before its handler runs
+		word operand;
+
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		// the last 8-bit alu operation. its flags are only worked out once something reads F.
+		// result keeps the carry out in bit 8, so zf and cy, which most readers want, are cheap
+		struct lazy_flags_t
+		{
+			byte op;
+			byte a;
+			byte b;
+			byte carry;
+			word result;
+		};
+
+		// op is an alu operation (0-7), inc, dec or none when F is up to date
+		static const byte lazy_flags_inc = 8;
+		static const byte lazy_flags_dec = 9;
+		static const byte lazy_flags_none = 0xFF;
+		lazy_flags_t lazy_flags;
+#endif
 
 	private:
 		const dword clock_speed = 4194304;
@@ -66,25 +88,180 @@ namespace dromaiusgb
 	private:
 		bool interrupt_master_enable_flag = true;
 		Bus &bus;
-		LCD &lcd;
-		Timer &timer;
+		Scheduler &scheduler;
 		InterruptController &interrupt_controller;
 
-		std::thread thread;
 		std::atomic<bool> running;
 		std::atomic<bool> halted;
 		bool next_fetch_is_halt_bug;
 
+		BlockCache block_cache;
+
+#ifdef DROMAIUSGB_JIT
+		friend class Jit;
+		Jit jit;
+#endif
+
+		bool idle_loop_detection = true;
+		cycle_t idle_cycles_skipped = 0;
+
+#ifdef DROMAIUSGB_THREADED_INTERPRETER
+		bool threaded_interpreter = true;
+#else
+		bool threaded_interpreter = false;
+#endif
+
+	private:
+		static const std::array<opcode_handler_t, 256> opcode_table;
+		static const std::array<opcode_handler_t, 256> cb_opcode_table;
+		static const std::array<byte, 256> opcode_lengths;
+
+		template <dword (CPU::*Handler)()>
+		static dword Op(CPU &);
+
+		template <std::size_t... Opcodes>
+		static constexpr std::array<opcode_handler_t, 256> MakeCBOpcodeTable(std::index_sequence<Opcodes...>);
+
+	private:
+		// operand encodings: R is B,C,D,E,H,L,(HL),A; RR is BC,DE,HL,SP; CC is NZ,Z,NC,C
+		template <byte R> byte Read();
+		template <byte R> void Write(byte);
+		template <byte RR> word &WordRegister();
+		template <byte CC> bool Condition() const;
+		template <byte Op> void ALU(byte);
+
+		// F with any pending lazy flags evaluated
+		flags_t &Flags();
+		bool ZeroFlag() const;
+		bool CarryFlag() const;
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		flags_t PendingFlags() const;
+		void MaterializeFlags();
+#endif
+
+		// 8-bit loads
+		template <byte R, byte S> dword LD_r_r();
+		template <byte R> dword LD_r_n();
+		template <byte RR> dword LD_mrr_A();
+		template <byte RR> dword LD_A_mrr();
+		template <int Delta> dword LD_mHL_A();
+		template <int Delta> dword LD_A_mHL();
+		dword LDH_n_A();
+		dword LDH_A_n();
+		dword LDH_C_A();
+		dword LDH_A_C();
+		dword LD_nn_A();
+		dword LD_A_nn();
+
+		// 16-bit loads
+		template <byte RR> dword LD_rr_nn();
+		dword LD_nn_SP();
+		dword LD_HL_SPn();
+		dword LD_SP_HL();
+		template <byte RR> dword POP_rr();
+		dword POP_AF();
+		template <byte RR> dword PUSH_rr();
+		dword PUSH_AF();
+
+		// 8-bit arithmetic/logical
+		template <byte Op, byte S> dword ALU_r();
+		template <byte Op> dword ALU_n();
+		template <byte R> dword INC_r();
+		template <byte R> dword DEC_r();
+		dword DAA();
+		dword SCF();
+		dword CPL();
+		dword CCF();
+
+		// 16-bit arithmetic/logical
+		template <byte RR> dword INC_rr();
+		template <byte RR> dword DEC_rr();
+		template <byte RR> dword ADD_HL_rr();
+		dword ADD_SP_n();
+
+		// jumps and calls
+		dword JR_n();
+		template <byte CC> dword JR_cc_n();
+		dword JP_nn();
+		template <byte CC> dword JP_cc_nn();
+		dword JP_HL();
+		dword CALL_nn();
+		template <byte CC> dword CALL_cc_nn();
+		dword RET();
+		template <byte CC> dword RET_cc();
+		dword RETI();
+		template <word Addr> dword RST();
+
+		// rotates on A
+		dword RLCA();
+		dword RRCA();
+		dword RLA();
+		dword RRA();
+
+		// control
+		dword NOP();
+		dword HALT();
+		dword STOP();
+		template <bool Enable> dword DI_EI();
+		dword UNDEFINED();
+
+		// CB prefixed rotates, shifts and bit operations
+		template <opcode_t Opcode> dword CB();
+
 	private:
+		dword GetHaltedCycles(dword) const;
 		dword HandleInterrupts();
 		dword HandleCBPrefixOpcode();
+		opcode_t Fetch();
 		dword Step();
+		bool FinishInstruction(dword &);
+
+		static bool EndsBlock(opcode_t);
+		basic_block_t DecodeBlock(const byte *, byte) const;
+		static bool IsIdleLoop(const basic_block_t &, address_t);
+		bool ReadsSteadyMemory(const basic_block_t &) const;
+		void SkipIdleLoop(dword);
+		void RunBlocks();
+
+#ifdef __GNUC__
+		void RunThreaded();
+#endif
+
+		void Run();
 
 	public:
-		CPU(Bus &, LCD &, Timer &, InterruptController &);
+		CPU(Bus &, Scheduler &, InterruptController &);
+
+		// runs on the calling thread until the given number of cycles have passed
+		void RunCycles(cycle_t);
+		void CatchUp();
+
+		// only between runs. loading drops the blocks decoded from ram, which the state overwrote
+		void SaveState(State &) const;
+		void LoadState(State &);
 
-		void Start();
-		void Stop();
-		void Toggle();
+		// skipping idle loops can be turned off to check that it changes nothing
+		void SetIdleLoopDetection(bool);
+		cycle_t GetIdleCyclesSkipped() const;
+
+		// the threaded interpreter is built wherever computed goto is, so it can be timed against the
+		// block cache. DROMAIUSGB_THREADED_INTERPRETER makes it the default
+		void SetThreadedInterpreter(bool);
+		bool IsThreadedInterpreter() const;
+
+#ifdef DROMAIUSGB_JIT
+		// re-run every natively translated instruction in the interpreter and report differences
+		void SetJitLockstep(bool);
+		dword GetJitLockstepMismatches() const;
+#endif
 	};
+
+	inline flags_t &CPU::Flags()
+	{
+#ifdef DROMAIUSGB_LAZY_FLAGS
+		if (lazy_flags.op != lazy_flags_none)
+			MaterializeFlags();
+#endif
+		return AF.flags;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "gameboy.hpp"
+
+
+namespace dromaiusgb
+{
+
+	GameBoy::GameBoy() : thread_running(false), run_ahead(0), threaded_rendering(false), frame_skip(0), frames_skipped(0), framebuffer(new std::uint32_t[screen_width * screen_height]), framebuffer_converted(false)
+	{
+		boot_rom = std::make_shared<ROM<0x100>>(address_bus);
+		boot_rom_switch = std::make_shared<ROMSwitch<0x100>>(address_bus, boot_rom);
+		cartridge = std::make_shared<Cartridge>(address_bus);
+		vram = std::make_shared<RAM<0x2000>>(address_bus);
+		wram = std::make_shared<RAM<0x2000>>(address_bus);
+		oam = std::make_shared<RAM<0x00A0>>(address_bus);
+		interrupt_controller = std::make_shared<InterruptController>(address_bus);
+		timer = std::make_shared<Timer>(address_bus, scheduler, *interrupt_controller);
+		lcd = std::make_shared<LCD>(address_bus, scheduler, *interrupt_controller);
+		linkport = std::make_shared<LinkPort>(address_bus, *interrupt_controller);
+		joypad = std::make_shared<Joypad>(address_bus, scheduler, *interrupt_controller);
+		hram = std::make_shared<RAM<0x007E>>(address_bus);
+
+		address_bus.RegisterAddressSpace(0x0000, 0x00FF, boot_rom);
+		address_bus.RegisterAddressSpace(0xFF50, 0xFF50, boot_rom_switch);
+		address_bus.RegisterAddressSpace(0x0000, 0x7FFF, cartridge); // cartridge rom
+		address_bus.RegisterAddressSpace(0x8000, 0x9FFF, vram);
+		address_bus.RegisterAddressSpace(0xA000, 0xBFFF, cartridge); // cartridge ram
+		address_bus.RegisterAddressSpace(0xC000, 0xDFFF, wram);
+		address_bus.RegisterAddressSpace(0xE000, 0xFDFF, wram);
+		address_bus.RegisterAddressSpace(0xFE00, 0xFE9F, oam);
+		address_bus.RegisterAddressSpace(0xFF00, 0xFF00, joypad);
+		address_bus.RegisterAddressSpace(0xFF01, 0xFF02, linkport);
+		address_bus.RegisterAddressSpace(0xFF04, 0xFF07, timer);
+		address_bus.RegisterAddressSpace(0xFF0F, 0xFF0F, interrupt_controller);
+		address_bus.RegisterAddressSpace(0xFF40, 0xFF4B, lcd);
+		address_bus.RegisterAddressSpace(0xFF80, 0xFFFE, hram);
+		address_bus.RegisterAddressSpace(0xFFFF, 0xFFFF, interrupt_controller);
+
+		cpu = std::make_unique<CPU>(address_bus, scheduler, *interrupt_controller);
+	}
+
+	GameBoy::~GameBoy()
+	{
+		Stop();
+	}
+
+	void GameBoy::LoadBootROM(const std::string &filename)
+	{
+		boot_rom->LoadFromFile(filename);
+		address_bus.Remap();
+	}
+
+	void GameBoy::LoadCartridge(const std::string &filename)
+	{
+		cartridge->LoadFromFile(filename);
+		address_bus.Remap();
+	}
+
+	// queued input is picked up as every run starts
+	void GameBoy::RunCycles(cycle_t cycles)
+	{
+		joypad->ProcessInput();
+		cpu->RunCycles(cycles);
+	}
+
+	// runs up to the end of the frame being drawn, so the framebuffer holds a frame the call finished
+	void GameBoy::RunFrame()
+	{
+		joypad->ProcessInput();
+		lcd->SetThreadedRendering(threaded_rendering);
+
+		// an undrawn frame is run for real, there is nothing to run ahead for
+		if (!IsFrameDrawn()) {
+			lcd->SetRendering(false);
+			RunToVBlank();
+			lcd->SetRendering(true);
+			return;
+		}
+
+		dword frames = run_ahead;
+		if (!frames) {
+			RunToVBlank();
+			lcd->FinishRendering();
+			return;
+		}
+
+		// run the frame for real but don't draw it, then draw the frame run ahead and go back
+		lcd->SetRendering(false);
+		RunToVBlank();
+
+		run_ahead_state.Clear();
+		SaveState(run_ahead_state);
+		linkport->SetOutput(false);
+
+		for (dword frame = 1; frame <= frames; frame++) {
+			lcd->SetRendering(frame == frames);
+			RunToVBlank();
+		}
+
+		run_ahead_state.Rewind();
+		LoadState(run_ahead_state);
+		linkport->SetOutput(true);
+		lcd->SetRendering(true);
+		lcd->FinishRendering();
+	}
+
+	void GameBoy::RunPacedFrame()
+	{
+		cycle_t start = scheduler.Now();
+		dword frames = lcd->GetFrameCount();
+
+		RunFrame();
+		pacer.Wait(scheduler.Now() - start, lcd->GetFrameCount() - frames);
+	}
+
+	void GameBoy::RunToVBlank()
+	{
+		cpu->RunCycles(lcd->GetCyclesToVBlank());
+	}
+
+	// counts the frames left undrawn in a row
+	bool GameBoy::IsFrameDrawn()
+	{
+		dword skip = frame_skip;
+
+		bool drawn;
+		if (skip == adaptive_frame_skip)
+			drawn = pacer.IsFrameWanted() || (pacer.GetSpeed() != FramePacer::uncapped && frames_skipped >= max_adaptive_skip);
+		else
+			drawn = frames_skipped >= skip;
+
+		frames_skipped = drawn ? 0 : frames_skipped + 1;
+		return drawn;
+	}
+
+	void GameBoy::SaveState(State &state) const
+	{
+		scheduler.SaveState(state);
+		boot_rom->SaveState(state);
+		cartridge->SaveState(state);
+		vram->SaveState(state);
+		wram->SaveState(state);
+		oam->SaveState(state);
+		interrupt_controller->SaveState(state);
+		timer->SaveState(state);
+		lcd->SaveState(state);
+		linkport->SaveState(state);
+		joypad->SaveState(state);
+		hram->SaveState(state);
+		cpu->SaveState(state);
+	}
+
+	void GameBoy::LoadState(State &state)
+	{
+		scheduler.LoadState(state);
+		boot_rom->LoadState(state);
+		cartridge->LoadState(state);
+		vram->LoadState(state);
+		wram->LoadState(state);
+		oam->LoadState(state);
+		interrupt_controller->LoadState(state);
+		timer->LoadState(state);
+		lcd->LoadState(state);
+		linkport->LoadState(state);
+		joypad->LoadState(state);
+		hram->LoadState(state);
+		cpu->LoadState(state);
+
+		// the boot rom and the cartridge's banks may be mapped differently now
+		address_bus.Remap();
+	}
+
+	void GameBoy::SetRunAhead(dword frames)
+	{
+		run_ahead = frames;
+	}
+
+	dword GameBoy::GetRunAhead() const
+	{
+		return run_ahead;
+	}
+
+	// takes effect from the next frame
+	void GameBoy::SetFrameSkip(dword frames)
+	{
+		frame_skip = frames;
+	}
+
+	dword GameBoy::GetFrameSkip() const
+	{
+		return frame_skip;
+	}
+
+	// takes effect from the next frame
+	void GameBoy::SetThreadedRendering(bool enable)
+	{
+		threaded_rendering = enable;
+	}
+
+	bool GameBoy::GetThreadedRendering() const
+	{
+		return threaded_rendering;
+	}
+
+	void GameBoy::Start()
+	{
+		if (thread_running)
+			return;
+
+		thread_running = true;
+
+		thread = std::thread([&] {
+			pacer.Reset();
+
+			while (thread_running)
+				RunPacedFrame();
+		});
+	}
+
+	// the thread stops at the end of the frame it is running
+	void GameBoy::Stop()
+	{
+		if (!thread_running)
+			return;
+
+		thread_running = false;
+		thread.join();
+	}
+
+	void GameBoy::Toggle()
+	{
+		if (thread_running)
+			Stop();
+		else
+			Start();
+	}
+
+	bool GameBoy::IsRunning() const
+	{
+		return thread_running;
+	}
+
+	// a multiplier of the real frame rate, or FramePacer::uncapped
+	void GameBoy::SetSpeed(dword multiplier)
+	{
+		pacer.SetSpeed(multiplier);
+	}
+
+	const FramePacer &GameBoy::GetPacer() const
+	{
+		return pacer;
+	}
+
+	bool GameBoy::UpdateFramebuffer()
+	{
+		if (!lcd->UpdateScreenBuffer())
+			return false;
+
+		framebuffer_converted = false;
+		return true;
+	}
+
+	const std::uint32_t *GameBoy::GetFramebuffer() const
+	{
+		if (!framebuffer_converted) {
+			palette.ToRGBA(lcd->GetScreenBuffer(), framebuffer.get(), screen_width * screen_height);
+			framebuffer_converted = true;
+		}
+
+		return framebuffer.get();
+	}
+
+	const byte *GameBoy::GetShades() const
+	{
+		return lcd->GetScreenBuffer();
+	}
+
+	void GameBoy::SetPalette(const ScreenPalette &palette)
+	{
+		this->palette = palette;
+		framebuffer_converted = false;
+	}
+
+	const ScreenPalette &GameBoy::GetPalette() const
+	{
+		return palette;
+	}
+
+	dword GameBoy::GetFrameCount() const
+	{
+		return lcd->GetFrameCount();
+	}
+
+	cycle_t GameBoy::GetCycles() const
+	{
+		return scheduler.Now();
+	}
+
+	Bus &GameBoy::GetBus()
+	{
+		return address_bus;
+	}
+
+	CPU &GameBoy::GetCPU()
+	{
+		return *cpu;
+	}
+
+	Joypad &GameBoy::GetJoypad()
+	{
+		return *joypad;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "types.hpp"
+#include "bus.hpp"
+#include "scheduler.hpp"
+#include "rom.hpp"
+#include "ram.hpp"
+#include "cartridge.hpp"
+
+#include "cpu.hpp"
+#include "lcd.hpp"
+#include "timer.hpp"
+#include "link.hpp"
+#include "joypad.hpp"
+#include "interrupts.hpp"
+#include "pacer.hpp"
+#include "state.hpp"
+#include "screen_palette.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+
+namespace dromaiusgb
+{
+
+	// the whole machine with its address map wired up. it has no window or clock of its own, front-ends
+	// either run it in steps on their own thread or start the cpu thread and read the screen as it goes
+	class GameBoy
+	{
+	public:
+		static const dword screen_width = 160;
+		static const dword screen_height = 144;
+
+		// frame skip that leaves frames undrawn only while they aren't wanted, see FramePacer
+		static const dword adaptive_frame_skip = ~dword(0);
+
+	private:
+		Bus address_bus;
+		Scheduler scheduler;
+
+		std::shared_ptr<ROM<0x100>> boot_rom;
+		std::shared_ptr<ROMSwitch<0x100>> boot_rom_switch;
+		std::shared_ptr<Cartridge> cartridge;
+		std::shared_ptr<RAM<0x2000>> vram;
+		std::shared_ptr<RAM<0x2000>> wram;
+		std::shared_ptr<RAM<0x00A0>> oam;
+		std::shared_ptr<InterruptController> interrupt_controller;
+		std::shared_ptr<Timer> timer;
+		std::shared_ptr<LCD> lcd;
+		std::shared_ptr<LinkPort> linkport;
+		std::shared_ptr<Joypad> joypad;
+		std::shared_ptr<RAM<0x007E>> hram;
+
+		std::unique_ptr<CPU> cpu;
+
+		// runs frames paced to the real frame rate while started
+		std::thread thread;
+		std::atomic<bool> thread_running;
+		FramePacer pacer;
+
+		// frames run ahead of the one that counts, and where to go back to after showing the last of them
+		std::atomic<dword> run_ahead;
+		State run_ahead_state;
+
+		std::atomic<bool> threaded_rendering;
+
+		// frames left undrawn before each drawn one, and how many in a row have been so far. adaptive frame
+		// skip at a capped speed still draws one now and then
+		const dword max_adaptive_skip = 9;
+		std::atomic<dword> frame_skip;
+		dword frames_skipped;
+
+		// the frame taken last in host colours, converted the first time it is asked for
+		ScreenPalette palette;
+		std::unique_ptr<std::uint32_t[]> framebuffer;
+		mutable bool framebuffer_converted;
+
+	private:
+		void RunToVBlank();
+		bool IsFrameDrawn();
+
+	public:
+		GameBoy();
+		~GameBoy();
+
+		void LoadBootROM(const std::string &);
+		void LoadCartridge(const std::string &);
+
+		void RunCycles(cycle_t);
+		void RunFrame();
+
+		// a frame, then a wait until it is due at the speed set, as the thread does
+		void RunPacedFrame();
+
+		// a snapshot of the whole machine, taken and restored between runs
+		void SaveState(State &) const;
+		void LoadState(State &);
+
+		// shows the frame this many frames after the one being run, hiding as many frames of input lag
+		// from games that take that long to react. each frame run ahead costs about one frame of time
+		void SetRunAhead(dword);
+		dword GetRunAhead() const;
+
+		// frames run but not drawn before each drawn one, to fast-forward. they are timed like any other, so
+		// games can't tell them apart
+		void SetFrameSkip(dword);
+		dword GetFrameSkip() const;
+
+		// draws the screen on a second thread, while the frame is still being run
+		void SetThreadedRendering(bool);
+		bool GetThreadedRendering() const;
+
+		// run on a thread of its own at the real frame rate times the speed multiplier
+		void Start();
+		void Stop();
+		void Toggle();
+		bool IsRunning() const;
+
+		void SetSpeed(dword);
+		const FramePacer &GetPacer() const;
+
+		// takes the newest finished frame, if there is a new one. frames are handed over without locking,
+		// so only one thread may take them. the frame stays valid until that thread takes the next one
+		bool UpdateFramebuffer();
+
+		// 160x144 RGBA pixels of the frame taken last, in the colours of the palette
+		const std::uint32_t *GetFramebuffer() const;
+
+		// the frame taken last as it was drawn, for converting to other formats with the palette or
+		// not at all. see ScreenPalette for the pixels
+		const byte *GetShades() const;
+
+		// from the thread that takes frames
+		void SetPalette(const ScreenPalette &);
+		const ScreenPalette &GetPalette() const;
+		dword GetFrameCount() const;
+		cycle_t GetCycles() const;
+
+		Bus &GetBus();
+		CPU &GetCPU();
+		Joypad &GetJoypad();
+	};
+}
\ No newline at end of file
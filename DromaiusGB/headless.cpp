@@ -0,0 +1,176 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "gameboy.hpp"
+
+
+// runs a rom without a window, as fast as possible unless a speed multiplier is given, then reports the
+// speed and a hash of the last frame. --bench runs it from power on with the block cache and with the
+// threaded interpreter in turn, and reports the best time of each
+//   headless <rom> [--frames n] [--speed n] [--boot bootstrap.bin] [--no-idle-skip] [--run-ahead n] [--render-thread] [--frame-skip n|auto] [--bench] [--repeat n]
+
+static uint64_t HashFramebuffer(const std::uint32_t *pixels)
+{
+	// 64-bit fnv-1a
+	const dromaiusgb::byte *bytes = (const dromaiusgb::byte *)pixels;
+	uint64_t hash = 14695981039346656037ull;
+
+	for (std::size_t i = 0; i < dromaiusgb::GameBoy::screen_width * dromaiusgb::GameBoy::screen_height * sizeof(std::uint32_t); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// the interpreters take turns, so both see the same noise from the rest of the machine
+template <typename Start>
+static int Bench(Start start_gameboy, unsigned long frames, unsigned long repeat)
+{
+	const char *names[] = { "block cache", "threaded" };
+	bool built[] = { true, true };
+	double best[] = { 0, 0 };
+	dromaiusgb::cycle_t cycles[] = { 0, 0 };
+	uint64_t hashes[] = { 0, 0 };
+
+	for (unsigned long run = 0; run < repeat; run++) {
+		for (int threaded = 0; threaded < 2; threaded++) {
+			std::unique_ptr<dromaiusgb::GameBoy> gameboy = start_gameboy();
+
+			gameboy->GetCPU().SetThreadedInterpreter(threaded);
+			if (gameboy->GetCPU().IsThreadedInterpreter() != bool(threaded)) {
+				built[threaded] = false;
+				continue;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+
+			for (unsigned long i = 0; i < frames; i++)
+				gameboy->RunPacedFrame();
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			gameboy->UpdateFramebuffer();
+
+			if (!run || elapsed.count() < best[threaded])
+				best[threaded] = elapsed.count();
+			cycles[threaded] = gameboy->GetCycles();
+			hashes[threaded] = HashFramebuffer(gameboy->GetFramebuffer());
+		}
+	}
+
+	std::cout << std::dec << frames << " frames, best of " << repeat << std::endl;
+
+	for (int threaded = 0; threaded < 2; threaded++) {
+		if (!built[threaded]) {
+			std::cout << names[threaded] << ": not built" << std::endl;
+			continue;
+		}
+
+		std::cout << names[threaded] << ": " << std::fixed << std::setprecision(3) << best[threaded] << " s, "
+			<< std::setprecision(1) << frames / best[threaded] << " fps, cycles: " << cycles[threaded]
+			<< ", framebuffer: " << std::hex << std::setw(16) << std::setfill('0') << hashes[threaded] << std::dec << std::setfill(' ') << std::endl;
+	}
+
+	// both ran the same machine, so anything else is a bug in one of them
+	if (built[1] && (cycles[0] != cycles[1] || hashes[0] != hashes[1])) {
+		std::cerr << "the interpreters disagree" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <rom> [--frames n] [--speed n] [--boot file] [--no-idle-skip] [--run-ahead n] [--render-thread] [--frame-skip n|auto] [--bench] [--repeat n]" << std::endl;
+		return -1;
+	}
+
+	std::string rom = argv[1];
+	std::string boot_rom = "bootstrap.bin";
+	unsigned long frames = 600;
+	dromaiusgb::dword speed = dromaiusgb::FramePacer::uncapped;
+	bool idle_skip = true;
+	dromaiusgb::dword run_ahead = 0;
+	bool render_thread = false;
+	dromaiusgb::dword frame_skip = 0;
+	bool bench = false;
+	unsigned long repeat = 3;
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			frames = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+			speed = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--boot") && i + 1 < argc)
+			boot_rom = argv[++i];
+		else if (!strcmp(argv[i], "--no-idle-skip"))
+			idle_skip = false;
+		else if (!strcmp(argv[i], "--run-ahead") && i + 1 < argc)
+			run_ahead = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--render-thread"))
+			render_thread = true;
+		else if (!strcmp(argv[i], "--frame-skip") && i + 1 < argc) {
+			i += 1;
+			frame_skip = strcmp(argv[i], "auto") ? std::strtoul(argv[i], nullptr, 10) : dromaiusgb::GameBoy::adaptive_frame_skip;
+		}
+		else if (!strcmp(argv[i], "--bench"))
+			bench = true;
+		else if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+			repeat = std::strtoul(argv[++i], nullptr, 10);
+		else {
+			std::cerr << "unknown argument: " << argv[i] << std::endl;
+			return -1;
+		}
+	}
+
+	// powered on with everything the arguments asked for
+	auto start_gameboy = [&]() {
+		auto gameboy = std::make_unique<dromaiusgb::GameBoy>();
+
+		gameboy->LoadBootROM(boot_rom);
+		gameboy->LoadCartridge(rom);
+
+		gameboy->GetCPU().SetIdleLoopDetection(idle_skip);
+		gameboy->SetRunAhead(run_ahead);
+		gameboy->SetThreadedRendering(render_thread);
+		gameboy->SetFrameSkip(frame_skip);
+		gameboy->SetSpeed(speed);
+		return gameboy;
+	};
+
+	std::unique_ptr<dromaiusgb::GameBoy> gameboy;
+
+	try {
+		if (bench)
+			return Bench(start_gameboy, frames, repeat ? repeat : 1);
+
+		gameboy = start_gameboy();
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned long i = 0; i < frames; i++)
+		gameboy->RunPacedFrame();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	gameboy->UpdateFramebuffer();
+
+	std::cout << std::dec << frames << " frames (" << gameboy->GetFrameCount() << " drawn) in " << elapsed.count() << " s, "
+		<< std::fixed << std::setprecision(1) << frames / elapsed.count() << " fps" << std::endl;
+	std::cout << "cycles: " << gameboy->GetCycles() << std::endl;
+	if (speed != dromaiusgb::FramePacer::uncapped)
+		std::cout << "cpu load: " << gameboy->GetPacer().GetHostLoad() * 100 << "%" << std::endl;
+	std::cout << "framebuffer: " << std::hex << std::setw(16) << std::setfill('0') << HashFramebuffer(gameboy->GetFramebuffer()) << std::endl;
+
+	return 0;
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "bus.hpp"
+#include "state.hpp"
 #include <istream>
 
 namespace dromaiusgb
@@ -12,6 +13,12 @@ namespace dromaiusgb
 		virtual void Set(bus_address_t addr, byte val) = 0;
 		virtual byte Get(bus_address_t addr) const = 0;
 		virtual byte *GetBlock(bus_address_t addr) = 0;
+		virtual byte *GetReadBlock(bus_address_t addr) = 0;
+		virtual byte *GetWriteBlock(bus_address_t addr) = 0;
 		virtual void LoadROM(std::istream &) = 0;
+
+		// ram and banking, the rom never changes
+		virtual void SaveState(State &) const = 0;
+		virtual void LoadState(State &) = 0;
 	};
 }
\ No newline at end of file
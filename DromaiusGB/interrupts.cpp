@@ -16,6 +16,8 @@ namespace dromaiusgb
 			case 0xFF0F: interrupt_flags = val; break;
 			case 0xFFFF: interrupt_enable = val; break;
 		}
+
+		UpdatePending();
 	}
 
 	byte InterruptController::Get(bus_address_t addr) const
@@ -27,8 +29,33 @@ namespace dromaiusgb
 		}
 	}
 
+	void InterruptController::SaveState(State &state) const
+	{
+		state.Write(interrupt_enable);
+		state.Write(interrupt_flags);
+	}
+
+	void InterruptController::LoadState(State &state)
+	{
+		state.Read(interrupt_enable);
+		state.Read(interrupt_flags);
+		UpdatePending();
+	}
+
 	void InterruptController::RequestInterrupt(InterruptFlags interrupt)
 	{
 		interrupt_flags = interrupt_flags | (byte)interrupt;
+		UpdatePending();
+	}
+
+	void InterruptController::AcknowledgeInterrupt(InterruptFlags interrupt)
+	{
+		interrupt_flags = interrupt_flags & ~(byte)interrupt;
+		UpdatePending();
+	}
+
+	void InterruptController::UpdatePending()
+	{
+		pending = (interrupt_enable & interrupt_flags) != 0;
 	}
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "types.hpp"
 #include "addressable.hpp"
 #include "bus.hpp"
+#include "state.hpp"
 
 namespace dromaiusgb
 {
@@ -41,12 +42,29 @@ namespace dromaiusgb
 		interrupt_flags_t interrupt_enable;
 		interrupt_flags_t interrupt_flags;
 
+	private:
+		// interrupt_enable & interrupt_flags is non-zero, checked after every instruction
+		bool pending = false;
+
+	private:
+		void UpdatePending();
+
 	public:
 		InterruptController(Bus &);
 
 		void Set(bus_address_t, byte);
 		byte Get(bus_address_t) const;
 
+		void SaveState(State &) const;
+		void LoadState(State &);
+
 		void RequestInterrupt(InterruptFlags);
+		void AcknowledgeInterrupt(InterruptFlags);
+		bool InterruptPending() const;
 	};
+
+	inline bool InterruptController::InterruptPending() const
+	{
+		return pending;
+	}
 }
\ No newline at end of file
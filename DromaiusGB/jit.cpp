@@ -0,0 +1,686 @@
+#include "jit.hpp"
+
+#ifdef DROMAIUSGB_JIT
+
+#include "cpu.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace dromaiusgb
+{
+
+	namespace
+	{
+		const std::size_t code_buffer_size = 16 * 1024 * 1024;
+
+		enum : int { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R12 = 12, R13 = 13, R14 = 14, R15 = 15 };
+
+		// opcode extensions and opcodes used with the helpers below
+		enum : byte { EXT_ADD = 0, EXT_OR = 1, EXT_AND = 4, EXT_SUB = 5, EXT_SHL = 4, EXT_SHR = 5 };
+		enum : byte { OP_ADD = 0x01, OP_OR = 0x09 };
+		enum : byte { JUMP = 0x00, JC = 0x82, JNC = 0x83, JZ = 0x84, JNZ = 0x85 };
+
+		// 8-bit add, adc, sub, sbc, and, xor, or and cmp of al with cl, in the order of the sm83 alu opcodes
+		const byte alu_opcodes[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+
+		// the host register holding an 8-bit guest register, B,C,D,E,H,L,-,A
+		struct guest_byte_t
+		{
+			int host;
+			bool high;
+		};
+
+		const guest_byte_t guest_bytes[8] = {
+			{ R13, true }, { R13, false }, { R14, true }, { R14, false }, { RBX, true }, { RBX, false }, { RAX, false }, { R12, true }
+		};
+
+		// the host register holding a 16-bit guest register, BC,DE,HL,SP
+		const int guest_words[4] = { R13, R14, RBX, RBP };
+	}
+
+	// never writable and executable at once, see Compile
+	Jit::Jit(CPU &cpu) : cpu(cpu)
+	{
+		void *buffer = mmap(nullptr, code_buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		code_buffer = (buffer == MAP_FAILED) ? nullptr : (byte *)buffer;
+
+		const byte *base = (const byte *)&cpu;
+		AF_offset = dword((const byte *)&cpu.AF - base);
+		BC_offset = dword((const byte *)&cpu.BC - base);
+		DE_offset = dword((const byte *)&cpu.DE - base);
+		HL_offset = dword((const byte *)&cpu.HL - base);
+		SP_offset = dword((const byte *)&cpu.SP - base);
+		PC_offset = dword((const byte *)&cpu.PC - base);
+	}
+
+	Jit::~Jit()
+	{
+		if (code_buffer)
+			munmap(code_buffer, code_buffer_size);
+	}
+
+	void Jit::SetLockstep(bool enable)
+	{
+		// only affects blocks compiled from now on
+		lockstep = enable;
+	}
+
+	dword Jit::GetLockstepMismatches() const
+	{
+		return lockstep_mismatches;
+	}
+
+	// ================================================
+	// ================== Assembler ===================
+	// ================================================
+
+	void Jit::Emit(byte b)
+	{
+		code.push_back(b);
+	}
+
+	void Jit::Emit32(dword d)
+	{
+		for (int i = 0; i < 4; i++) {
+			Emit(byte(d >> (i * 8)));
+		}
+	}
+
+	void Jit::Emit64(uint64_t q)
+	{
+		Emit32(dword(q));
+		Emit32(dword(q >> 32));
+	}
+
+	void Jit::EmitRex(bool wide, int reg, int rm, bool force)
+	{
+		byte rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+		if (rex != 0x40 || force)
+			Emit(rex);
+	}
+
+	// modrm for [base + disp32]
+	void Jit::EmitMemory(int reg, int base, dword displacement)
+	{
+		Emit(0x80 | ((reg & 7) << 3) | (base & 7));
+		if ((base & 7) == RSP)
+			Emit(0x24);
+		Emit32(displacement);
+	}
+
+	// returns where the rel32 to patch with BindJump is
+	std::size_t Jit::EmitJump(byte condition)
+	{
+		if (condition == JUMP) {
+			Emit(0xE9);
+		} else {
+			Emit(0x0F);
+			Emit(condition);
+		}
+
+		Emit32(0);
+		return code.size() - 4;
+	}
+
+	void Jit::BindJump(std::size_t at)
+	{
+		dword rel = dword(code.size() - (at + 4));
+		std::memcpy(&code[at], &rel, 4);
+	}
+
+	void Jit::MoveRegister(int dst, int src, bool wide)
+	{
+		EmitRex(wide, src, dst);
+		Emit(0x89);
+		Emit(0xC0 | ((src & 7) << 3) | (dst & 7));
+	}
+
+	void Jit::MoveImmediate(int dst, dword imm)
+	{
+		EmitRex(false, 0, dst);
+		Emit(0xB8 | (dst & 7));
+		Emit32(imm);
+	}
+
+	void Jit::MoveImmediate64(int dst, uint64_t imm)
+	{
+		EmitRex(true, 0, dst);
+		Emit(0xB8 | (dst & 7));
+		Emit64(imm);
+	}
+
+	void Jit::AluImmediate(byte extension, int dst, dword imm)
+	{
+		EmitRex(false, 0, dst);
+		Emit(0x81);
+		Emit(0xC0 | (extension << 3) | (dst & 7));
+		Emit32(imm);
+	}
+
+	void Jit::AluRegister(byte opcode, int dst, int src)
+	{
+		EmitRex(false, src, dst);
+		Emit(opcode);
+		Emit(0xC0 | ((src & 7) << 3) | (dst & 7));
+	}
+
+	void Jit::ShiftImmediate(byte extension, int dst, byte count)
+	{
+		EmitRex(false, 0, dst);
+		Emit(0xC1);
+		Emit(0xC0 | (extension << 3) | (dst & 7));
+		Emit(count);
+	}
+
+	// movzx dst, low byte of src
+	void Jit::ZeroExtendByte(int dst, int src)
+	{
+		EmitRex(false, dst, src, src >= RSP && src <= RDI);
+		Emit(0x0F);
+		Emit(0xB6);
+		Emit(0xC0 | ((dst & 7) << 3) | (src & 7));
+	}
+
+	// bt reg, bit, leaving the bit in the carry flag
+	void Jit::TestBit(int reg, byte bit)
+	{
+		EmitRex(false, 0, reg);
+		Emit(0x0F);
+		Emit(0xBA);
+		Emit(0xE0 | (reg & 7));
+		Emit(bit);
+	}
+
+	void Jit::CallFunction(const void *function)
+	{
+		MoveImmediate64(RAX, (uint64_t)function);
+		Emit(0xFF);
+		Emit(0xD0);
+	}
+
+	// ================================================
+	// =============== Guest registers ================
+	// ================================================
+
+	void Jit::LoadRegisters()
+	{
+		const int hosts[5] = { R12, R13, R14, RBX, RBP };
+		const dword offsets[5] = { AF_offset, BC_offset, DE_offset, HL_offset, SP_offset };
+
+		for (int i = 0; i < 5; i++) {
+			// movzx host, word [r15 + offset]
+			EmitRex(false, hosts[i], R15);
+			Emit(0x0F);
+			Emit(0xB7);
+			EmitMemory(hosts[i], R15, offsets[i]);
+		}
+	}
+
+	void Jit::StoreRegisters()
+	{
+		const int hosts[5] = { R12, R13, R14, RBX, RBP };
+		const dword offsets[5] = { AF_offset, BC_offset, DE_offset, HL_offset, SP_offset };
+
+		for (int i = 0; i < 5; i++) {
+			// mov word [r15 + offset], host
+			Emit(0x66);
+			EmitRex(false, hosts[i], R15);
+			Emit(0x89);
+			EmitMemory(hosts[i], R15, offsets[i]);
+		}
+	}
+
+	void Jit::StorePC(word pc)
+	{
+		Emit(0x66);
+		EmitRex(false, 0, R15);
+		Emit(0xC7);
+		EmitMemory(0, R15, PC_offset);
+		Emit(byte(pc));
+		Emit(byte(pc >> 8));
+	}
+
+	void Jit::LoadGuestByte(int dst, byte r)
+	{
+		const guest_byte_t &guest = guest_bytes[r];
+
+		if (guest.high) {
+			MoveRegister(dst, guest.host);
+			ShiftImmediate(EXT_SHR, dst, 8);
+		} else {
+			ZeroExtendByte(dst, guest.host);
+		}
+	}
+
+	// clobbers src
+	void Jit::StoreGuestByte(byte r, int src)
+	{
+		const guest_byte_t &guest = guest_bytes[r];
+
+		ZeroExtendByte(src, src);
+
+		if (guest.high) {
+			AluImmediate(EXT_AND, guest.host, 0x00FF);
+			ShiftImmediate(EXT_SHL, src, 8);
+		} else {
+			AluImmediate(EXT_AND, guest.host, 0xFF00);
+		}
+
+		AluRegister(OP_OR, guest.host, src);
+	}
+
+	// builds F from the host flags left in ah by lahf. zero and, with from_host 0x50, half carry come from
+	// the host, carry too if asked, set is or'd in and the bits in preserve keep their old value
+	void Jit::StoreFlags(byte from_host, bool carry, byte set, byte preserve)
+	{
+		// movzx ecx, ah
+		Emit(0x0F);
+		Emit(0xB6);
+		Emit(0xCC);
+
+		if (carry) {
+			MoveRegister(RDX, RCX);
+			AluImmediate(EXT_AND, RDX, 0x01);
+			ShiftImmediate(EXT_SHL, RDX, 4);
+		}
+
+		// host ZF (bit 6) and AF (bit 4) move up to zf (bit 7) and h (bit 5)
+		AluImmediate(EXT_AND, RCX, from_host);
+		AluRegister(OP_ADD, RCX, RCX);
+
+		if (carry)
+			AluRegister(OP_OR, RCX, RDX);
+		if (set)
+			AluImmediate(EXT_OR, RCX, set);
+
+		AluImmediate(EXT_AND, R12, 0xFF00 | preserve);
+		AluRegister(OP_OR, R12, RCX);
+	}
+
+	// ================================================
+	// ================= Translation ==================
+	// ================================================
+
+	// cycles of the instructions with a native translation, 0 for the rest
+	dword Jit::NativeCycles(opcode_t opcode)
+	{
+		byte r = (opcode >> 3) & 0x07;
+		byte s = opcode & 0x07;
+
+		if (opcode == 0x00) // nop
+			return 4;
+		if (opcode >= 0x40 && opcode < 0x80 && r != 6 && s != 6) // ld reg,reg
+			return 4;
+		if (opcode >= 0x80 && opcode < 0xC0 && s != 6) // alu a,reg
+			return 4;
+		if ((opcode & 0xC7) == 0xC6) // alu a,n
+			return 8;
+
+		if (opcode < 0x40 && r != 6) {
+			switch (s) {
+				case 0x04: case 0x05: return 4; // inc/dec reg
+				case 0x06: return 8; // ld reg,n
+			}
+		}
+
+		if (opcode < 0x40 && (opcode & 0x07) == 0x03) // inc/dec wreg
+			return 8;
+
+		return 0;
+	}
+
+	void Jit::EmitOperation(const instruction_t &instruction)
+	{
+		opcode_t opcode = instruction.opcode;
+		byte r = (opcode >> 3) & 0x07;
+		byte s = opcode & 0x07;
+
+		if (opcode == 0x00)
+			return;
+
+		if (opcode >= 0x40 && opcode < 0x80) {
+			if (r != s) {
+				LoadGuestByte(RAX, s);
+				StoreGuestByte(r, RAX);
+			}
+			return;
+		}
+
+		if (opcode >= 0x80) {
+			byte op = r;
+
+			LoadGuestByte(RAX, 7);
+			if (opcode >= 0xC0)
+				MoveImmediate(RCX, byte(instruction.operand));
+			else
+				LoadGuestByte(RCX, s);
+
+			// adc/sbc take the guest carry
+			if (op == 1 || op == 3)
+				TestBit(R12, 4);
+
+			Emit(alu_opcodes[op]);
+			Emit(0xC8);
+
+			// lahf
+			Emit(0x9F);
+
+			switch (op) {
+				case 0: case 1: StoreFlags(0x50, true, 0x00, 0x0F); break; // add, adc
+				case 2: case 3: case 7: StoreFlags(0x50, true, 0x40, 0x0F); break; // sub, sbc, cp
+				case 4: StoreFlags(0x40, false, 0x20, 0x0F); break; // and
+				default: StoreFlags(0x40, false, 0x00, 0x0F); break; // xor, or
+			}
+
+			if (op != 7)
+				StoreGuestByte(7, RAX);
+			return;
+		}
+
+		switch (s) {
+			case 0x03: // inc/dec wreg
+				AluImmediate((opcode & 0x08) ? EXT_SUB : EXT_ADD, guest_words[r >> 1], 1);
+				AluImmediate(EXT_AND, guest_words[r >> 1], 0xFFFF);
+				return;
+
+			case 0x04: case 0x05: // inc/dec reg, the guest carry is left alone
+				LoadGuestByte(RAX, r);
+				Emit(0xFE);
+				Emit(s == 0x04 ? 0xC0 : 0xC8);
+				Emit(0x9F);
+				StoreFlags(0x50, false, s == 0x05 ? 0x40 : 0x00, 0x1F);
+				StoreGuestByte(r, RAX);
+				return;
+
+			case 0x06: // ld reg,n
+				MoveImmediate(RAX, byte(instruction.operand));
+				StoreGuestByte(r, RAX);
+				return;
+		}
+	}
+
+	// calls Tick with the cycles of the instruction just run, leaving the block with PC at pc if it says so.
+	// the first instruction of a block also ticks the cycles spent on interrupts before the block
+	void Jit::EmitTick(dword cycles, bool first, word pc, std::vector<std::size_t> &exits)
+	{
+		MoveRegister(RDI, R15, true);
+
+		if (first) {
+			// mov esi, [rsp] / add esi, cycles / mov dword [rsp], 0
+			Emit(0x8B); Emit(0x34); Emit(0x24);
+			AluImmediate(EXT_ADD, RSI, cycles);
+			Emit(0xC7); Emit(0x04); Emit(0x24); Emit32(0);
+		} else {
+			MoveImmediate(RSI, cycles);
+		}
+
+		CallFunction((const void *)&Jit::Tick);
+
+		// test al, al
+		Emit(0x84);
+		Emit(0xC0);
+
+		std::size_t next = EmitJump(JNZ);
+		StorePC(pc);
+		exits.push_back(EmitJump(JUMP));
+		BindJump(next);
+	}
+
+	// hands the guest registers to Verify, with PC as the native code left it, and continues from the
+	// interpreter's result. StoreRegisters must have saved the state before the instruction
+	void Jit::EmitLockstep(const instruction_t &instruction, dword cycles, word pc)
+	{
+		const int hosts[5] = { R12, R13, R14, RBX, RBP };
+
+		MoveImmediate64(RAX, (uint64_t)lockstep_registers);
+		for (int i = 0; i < 5; i++) {
+			Emit(0x66);
+			EmitRex(false, hosts[i], RAX);
+			Emit(0x89);
+			EmitMemory(hosts[i], RAX, i * 2);
+		}
+
+		Emit(0x66);
+		Emit(0xC7);
+		EmitMemory(0, RAX, 10);
+		Emit(byte(pc));
+		Emit(byte(pc >> 8));
+
+		MoveRegister(RDI, R15, true);
+		MoveImmediate64(RSI, (uint64_t)&instruction);
+		MoveImmediate(RDX, cycles);
+		CallFunction((const void *)&Jit::Verify);
+
+		LoadRegisters();
+	}
+
+	// jr/jp, conditional or not. both ways out of the block go through Tick, and a jump back to the
+	// start of the block stays in native code
+	bool Jit::EmitBranch(const instruction_t &instruction, word next, address_t start, bool first, std::vector<std::size_t> &exits, std::size_t top)
+	{
+		opcode_t opcode = instruction.opcode;
+		bool relative = opcode < 0x40;
+		bool conditional = relative ? (opcode != 0x18) : (opcode != 0xC3);
+
+		if (!(opcode == 0x18 || opcode == 0x20 || opcode == 0x28 || opcode == 0x30 || opcode == 0x38 ||
+			opcode == 0xC2 || opcode == 0xC3 || opcode == 0xCA || opcode == 0xD2 || opcode == 0xDA))
+			return false;
+
+		word target = relative ? word(next + sbyte(instruction.operand)) : instruction.operand;
+		dword taken_cycles = relative ? 12 : 16;
+		dword not_taken_cycles = relative ? 8 : 12;
+
+		if (lockstep) {
+			StoreRegisters();
+			StorePC(next);
+		}
+
+		std::size_t not_taken = 0;
+		if (conditional) {
+			byte cc = (opcode >> 3) & 0x03;
+
+			// zf is bit 7 and cy bit 4 of F. NZ/NC are taken with the bit clear, Z/C with it set
+			TestBit(R12, cc < 2 ? 7 : 4);
+			not_taken = EmitJump((cc & 1) ? JNC : JC);
+		}
+
+		if (lockstep)
+			EmitLockstep(instruction, taken_cycles, target);
+
+		EmitTick(taken_cycles, first, target, exits);
+
+		if (target == start) {
+			Emit(0xE9);
+			Emit32(dword(top - (code.size() + 4)));
+		} else {
+			StorePC(target);
+			exits.push_back(EmitJump(JUMP));
+		}
+
+		if (conditional) {
+			BindJump(not_taken);
+
+			if (lockstep)
+				EmitLockstep(instruction, not_taken_cycles, next);
+
+			EmitTick(not_taken_cycles, first, next, exits);
+			StorePC(next);
+			exits.push_back(EmitJump(JUMP));
+		}
+
+		return true;
+	}
+
+	jit_code_t Jit::Compile(const basic_block_t &block, address_t start)
+	{
+		if (!code_buffer)
+			return nullptr;
+
+		code.clear();
+		std::vector<std::size_t> exits;
+
+		// push rbx, rbp, r12-r15, keep the stack aligned and put the pending cycles at [rsp]
+		const int saved[6] = { RBX, RBP, R12, R13, R14, R15 };
+		for (int reg : saved) {
+			EmitRex(false, 0, reg);
+			Emit(0x50 | (reg & 7));
+		}
+
+		Emit(0x48); Emit(0x83); Emit(0xEC); Emit(0x08); // sub rsp, 8
+		MoveRegister(R15, RDI, true);
+		Emit(0x89); Emit(0x34); Emit(0x24); // mov [rsp], esi
+		LoadRegisters();
+
+		std::size_t top = code.size();
+		word pc = start;
+		bool pc_stored = true;
+
+		for (std::size_t i = 0; i < block.instructions.size(); i++) {
+			const instruction_t &instruction = block.instructions[i];
+			word next = pc + instruction.length;
+			bool first = (i == 0);
+
+			if (EmitBranch(instruction, next, start, first, exits, top)) {
+				pc_stored = true;
+
+			} else if (dword cycles = NativeCycles(instruction.opcode)) {
+				if (lockstep) {
+					StoreRegisters();
+					StorePC(next);
+				}
+
+				EmitOperation(instruction);
+
+				if (lockstep)
+					EmitLockstep(instruction, cycles, next);
+
+				EmitTick(cycles, first, next, exits);
+				pc_stored = false;
+
+			} else {
+				// everything else runs through the interpreter handler
+				StoreRegisters();
+				StorePC(next);
+
+				MoveRegister(RDI, R15, true);
+				MoveImmediate64(RSI, (uint64_t)&instruction);
+				if (first) {
+					Emit(0x8B); Emit(0x14); Emit(0x24); // mov edx, [rsp]
+					Emit(0xC7); Emit(0x04); Emit(0x24); Emit32(0); // mov dword [rsp], 0
+				} else {
+					MoveImmediate(RDX, 0);
+				}
+				CallFunction((const void *)&Jit::Interpret);
+
+				LoadRegisters();
+				Emit(0x84); // test al, al
+				Emit(0xC0);
+				exits.push_back(EmitJump(JZ));
+				pc_stored = true;
+			}
+
+			pc = next;
+		}
+
+		if (!pc_stored)
+			StorePC(pc);
+
+		for (std::size_t exit : exits) {
+			BindJump(exit);
+		}
+
+		StoreRegisters();
+		Emit(0x48); Emit(0x83); Emit(0xC4); Emit(0x08); // add rsp, 8
+		for (int i = 5; i >= 0; i--) {
+			EmitRex(false, 0, saved[i]);
+			Emit(0x58 | (saved[i] & 7));
+		}
+		Emit(0xC3); // ret
+
+		if (code_buffer_used + code.size() > code_buffer_size)
+			return nullptr;
+
+		// the pages written to are made writable only while they are, the last of them may already
+		// hold code. nothing runs native code while a block is compiled
+		std::size_t page_size = std::size_t(sysconf(_SC_PAGESIZE));
+		std::size_t first_page = code_buffer_used / page_size * page_size;
+		std::size_t end_page = (code_buffer_used + code.size() + page_size - 1) / page_size * page_size;
+
+		if (mprotect(code_buffer + first_page, end_page - first_page, PROT_READ | PROT_WRITE))
+			return nullptr;
+
+		byte *native = code_buffer + code_buffer_used;
+		std::memcpy(native, code.data(), code.size());
+
+		if (mprotect(code_buffer + first_page, end_page - first_page, PROT_READ | PROT_EXEC))
+			return nullptr;
+
+		code_buffer_used += code.size();
+		return (jit_code_t)native;
+	}
+
+	void Jit::Run(const basic_block_t &block, dword cycles)
+	{
+		// native code works on F directly, so lazily evaluated flags have to be settled first
+		cpu.Flags();
+		block_generation = cpu.block_cache.Generation();
+		block.native(&cpu, cycles);
+	}
+
+	// ================================================
+	// ============ Called from native code ===========
+	// ================================================
+
+	// the work done between two instructions, as in CPU::FinishInstruction. returns false to leave the block,
+	// which is also done when an interrupt is about to be dispatched so that the interpreter can do it
+	bool Jit::Tick(CPU *cpu, dword cycles)
+	{
+		cpu->scheduler.Advance(cycles);
+
+		if (!cpu->running)
+			return false;
+
+		return !(cpu->interrupt_master_enable_flag && cpu->interrupt_controller.InterruptPending());
+	}
+
+	// runs an instruction without a native translation. the block is also left if it switched banks or
+	// wrote over cached code
+	bool Jit::Interpret(CPU *cpu, const instruction_t *instruction, dword cycles)
+	{
+		cpu->operand = instruction->operand;
+		cycles += instruction->handler(*cpu);
+		cpu->Flags();
+
+		if (!Tick(cpu, cycles))
+			return false;
+
+		return cpu->block_cache.Generation() == cpu->jit.block_generation && !cpu->halted;
+	}
+
+	void Jit::Verify(CPU *cpu, const instruction_t *instruction, dword native_cycles)
+	{
+		Jit &jit = cpu->jit;
+
+		cpu->operand = instruction->operand;
+		dword cycles = instruction->handler(*cpu);
+		cpu->Flags();
+
+		const word expected[6] = { cpu->AF, cpu->BC, cpu->DE, cpu->HL, cpu->SP, cpu->PC };
+		if (std::memcmp(expected, jit.lockstep_registers, sizeof(expected)) == 0 && cycles == native_cycles)
+			return;
+
+		jit.lockstep_mismatches++;
+
+		const char *names[6] = { "AF", "BC", "DE", "HL", "SP", "PC" };
+		std::cout << std::hex << "jit mismatch on opcode " << (int)instruction->opcode << ":";
+		for (int i = 0; i < 6; i++) {
+			std::cout << " " << names[i] << " " << expected[i] << "/" << jit.lockstep_registers[i];
+		}
+		std::cout << " cycles " << cycles << "/" << native_cycles << std::dec << std::endl;
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "types.hpp"
+#include "block_cache.hpp"
+
+#include <vector>
+
+#if defined(DROMAIUSGB_JIT) && !(defined(__x86_64__) && defined(__linux__))
+#error "the jit only targets x86-64 linux"
+#endif
+
+
+namespace dromaiusgb
+{
+
+	// translates hot blocks of rom code to x86-64. while a block runs the guest registers live in
+	// host registers: r15 = CPU, r12 = AF, r13 = BC, r14 = DE, rbx = HL, rbp = SP.
+	// instructions without a native translation call their interpreter handler instead. every
+	// instruction is followed by a call to Tick, so the scheduler advances exactly as it does in the
+	// interpreter, and the block is left as soon as an interrupt is due or the cpu stops
+	class Jit
+	{
+	public:
+		// executions of a block before it is compiled
+		static const dword threshold = 16;
+
+	private:
+		CPU &cpu;
+
+		// compiled code is never freed, not even once its block is dropped from the cache. when the
+		// buffer is full nothing more is compiled, and blocks not compiled by then stay interpreted
+		byte *code_buffer;
+		std::size_t code_buffer_used = 0;
+		std::vector<byte> code;
+
+		// offsets of the cpu state the generated code touches
+		dword AF_offset, BC_offset, DE_offset, HL_offset, SP_offset, PC_offset;
+
+		// the block cache generation when the running block was entered
+		dword block_generation = 0;
+
+		// in lockstep mode every native instruction is re-run by the interpreter and compared
+		bool lockstep = false;
+		dword lockstep_mismatches = 0;
+		word lockstep_registers[6];
+
+	private:
+		void Emit(byte);
+		void Emit32(dword);
+		void Emit64(uint64_t);
+		void EmitRex(bool, int, int, bool = false);
+		void EmitMemory(int, int, dword);
+		std::size_t EmitJump(byte);
+		void BindJump(std::size_t);
+
+		void MoveRegister(int, int, bool = false);
+		void MoveImmediate(int, dword);
+		void MoveImmediate64(int, uint64_t);
+		void AluImmediate(byte, int, dword);
+		void AluRegister(byte, int, int);
+		void ShiftImmediate(byte, int, byte);
+		void ZeroExtendByte(int, int);
+		void TestBit(int, byte);
+		void CallFunction(const void *);
+
+		void LoadRegisters();
+		void StoreRegisters();
+		void StorePC(word);
+		void LoadGuestByte(int, byte);
+		void StoreGuestByte(byte, int);
+		void StoreFlags(byte, bool, byte, byte);
+
+		static dword NativeCycles(opcode_t);
+		void EmitOperation(const instruction_t &);
+		void EmitTick(dword, bool, word, std::vector<std::size_t> &);
+		void EmitLockstep(const instruction_t &, dword, word);
+		bool EmitBranch(const instruction_t &, word, address_t, bool, std::vector<std::size_t> &, std::size_t);
+
+		static bool Tick(CPU *, dword);
+		static bool Interpret(CPU *, const instruction_t *, dword);
+		static void Verify(CPU *, const instruction_t *, dword);
+
+	public:
+		Jit(CPU &);
+		~Jit();
+
+		jit_code_t Compile(const basic_block_t &, address_t);
+		void Run(const basic_block_t &, dword);
+
+		void SetLockstep(bool);
+		dword GetLockstepMismatches() const;
+	};
+}
\ No newline at end of file
@@ -1,14 +1,18 @@
 #include "joypad.hpp"
 
+#include <algorithm>
+
 
 namespace dromaiusgb
 {
 
-	Joypad::Joypad(Bus &bus, InterruptController &ic) : Addressable(bus), interrupt_controller(ic)
+	Joypad::Joypad(Bus &bus, Scheduler &scheduler, InterruptController &ic) : Addressable(bus), interrupt_controller(ic), scheduler(scheduler)
 	{
 		for (bool &b : button_states) {
 			b = false;
 		}
+
+		scheduler.Register(Event::Joypad, this);
 	}
 
 	void Joypad::Set(bus_address_t addr, byte val)
@@ -44,4 +48,64 @@ namespace dromaiusgb
 
 		button_states[(int)button] = pressed;
 	}
+
+	void Joypad::SaveState(State &state) const
+	{
+		state.Write(button_states);
+		state.Write(joypad_flags);
+		state.Write(pending_input.size());
+		state.Write(pending_input.data(), pending_input.size() * sizeof(input_event_t));
+	}
+
+	void Joypad::LoadState(State &state)
+	{
+		std::size_t pending;
+
+		state.Read(button_states);
+		state.Read(joypad_flags);
+		state.Read(pending);
+		pending_input.resize(pending);
+		state.Read(pending_input.data(), pending * sizeof(input_event_t));
+	}
+
+	bool Joypad::QueueButtonState(JoypadButton button, bool pressed, cycle_t cycle)
+	{
+		return input_queue.Push({ cycle, button, pressed });
+	}
+
+	// moves queued input over to pending_input. input given for a cycle that has already passed, asap
+	// included, happens now. so where it lands only depends on when this is called
+	void Joypad::ProcessInput()
+	{
+		input_event_t input;
+
+		while (input_queue.Pop(input)) {
+			input.cycle = std::max(input.cycle, scheduler.Now());
+
+			// after any pending input for the same cycle, so input keeps its order
+			auto position = std::upper_bound(pending_input.begin(), pending_input.end(), input, [](const input_event_t &a, const input_event_t &b) {
+				return a.cycle < b.cycle;
+			});
+			pending_input.insert(position, input);
+		}
+
+		ApplyInput();
+	}
+
+	void Joypad::ApplyInput()
+	{
+		cycle_t now = scheduler.Now();
+
+		auto due = pending_input.begin();
+		for (; due != pending_input.end() && due->cycle <= now; ++due)
+			SetButtonState(due->button, due->pressed);
+
+		pending_input.erase(pending_input.begin(), due);
+		scheduler.Schedule(Event::Joypad, pending_input.empty() ? Scheduler::never : pending_input.front().cycle);
+	}
+
+	void Joypad::CatchUp()
+	{
+		ApplyInput();
+	}
 }
\ No newline at end of file
@@ -3,6 +3,11 @@
 #include "types.hpp"
 #include "addressable.hpp"
 #include "interrupts.hpp"
+#include "scheduler.hpp"
+#include "spsc_queue.hpp"
+#include "state.hpp"
+
+#include <vector>
 
 namespace dromaiusgb
 {
@@ -38,19 +43,49 @@ namespace dromaiusgb
 		operator byte() const { return value; }
 	};
 
-	class Joypad : public Addressable
+	// a button press or release, and the cycle it happens on
+	struct input_event_t
+	{
+		cycle_t cycle;
+		JoypadButton button;
+		bool pressed;
+	};
+
+	class Joypad : public Addressable, public Scheduled
 	{
+	public:
+		// the cycle of input that happens as soon as the emulation picks it up
+		static const cycle_t asap = 0;
+
 	private:
 		bool button_states[8];
 		InterruptController &interrupt_controller;
+		Scheduler &scheduler;
 		joypad_control_t joypad_flags;
 
+		// input from other threads, and the input picked up from there that isn't due yet, by cycle
+		SPSCQueue<input_event_t, 256> input_queue;
+		std::vector<input_event_t> pending_input;
+
+	private:
+		void SetButtonState(JoypadButton, bool);
+		void ApplyInput();
+
 	public:
-		Joypad(Bus &, InterruptController &);
+		Joypad(Bus &, Scheduler &, InterruptController &);
 
 		void Set(bus_address_t, byte);
 		byte Get(bus_address_t) const;
 
-		void SetButtonState(JoypadButton, bool);
+		// input still in the queue isn't part of the state
+		void SaveState(State &) const;
+		void LoadState(State &);
+
+		// from the one thread feeding input. false if the queue is full
+		bool QueueButtonState(JoypadButton, bool, cycle_t = asap);
+
+		// from the emulation thread, between runs
+		void ProcessInput();
+		void CatchUp();
 	};
 }
\ No newline at end of file
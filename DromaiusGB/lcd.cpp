@@ -2,39 +2,98 @@
 #include "bus.hpp"
 #include "interrupts.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 
 namespace dromaiusgb
 {
 
-	LCD::LCD(Bus &bus, InterruptController &ic) : Addressable(bus), interrupt_controller(ic)
+	ScanlinePPU::ScanlinePPU()
 	{
-		screen_buffer = new uint32_t[160 * 144];
-		priority_buffer = new int[160 * 144];
-		screen_texture.create(160, 144);
+		pending_start = 0;
+		pending_end = 0;
+		line_piece_count = 0;
+	}
+
+	void ScanlinePPU::SaveState(State &state) const
+	{
+		state.Write(pending_start);
+		state.Write(pending_end);
+		state.Write(pending_sprites + pending_start, (pending_end - pending_start) * sizeof(line_sprites_t));
+		state.Write(line_piece_count);
+		state.Write(line_pieces, line_piece_count * sizeof(line_piece_t));
+	}
+
+	void ScanlinePPU::LoadState(State &state)
+	{
+		state.Read(pending_start);
+		state.Read(pending_end);
+		state.Read(pending_sprites + pending_start, (pending_end - pending_start) * sizeof(line_sprites_t));
+		state.Read(line_piece_count);
+		state.Read(line_pieces, line_piece_count * sizeof(line_piece_t));
+	}
+
+	template <typename PPU>
+	BasicLCD<PPU>::BasicLCD(Bus &bus, Scheduler &scheduler, InterruptController &ic) : Addressable(bus), interrupt_controller(ic), scheduler(scheduler)
+	{
+		frame_count = 0;
+		rendering = true;
+		watched_vram = nullptr;
+		watched_oam = nullptr;
+		line_sprites.count = 0;
 
 		cycle = 0;
 		ly = 0;
 		scroll_y = 0;
 		scroll_x = 0;
 		mode = LCDMode::HBlank;
+		last_update = 0;
+
+		scheduler.Register(Event::LCD, this);
+		Reschedule();
+
+		bus.AddWatcher(this);
 	}
 
-	LCD::~LCD()
+	template <typename PPU>
+	BasicLCD<PPU>::~BasicLCD()
 	{
+		if (watched_vram) {
+			for (unsigned int page = 0; page < 0x20; page++)
+				bus.UnwatchWrites(watched_vram + page * 0x100);
+		}
 
+		if (watched_oam)
+			bus.UnwatchWrites(watched_oam);
+
+		bus.RemoveWatcher(this);
 	}
 
-	void LCD::Set(bus_address_t addr, byte val)
+	template <typename PPU>
+	void BasicLCD<PPU>::Set(bus_address_t addr, byte val)
 	{
+		Update();
+
 		switch (addr.address)
 		{
-		case 0xFF40: lcd_control = val; break;
+		case 0xFF41: case 0xFF44: case 0xFF45: case 0xFF46: break;
+		default:
+			if (Get(addr) != val)
+				RegisterChanging();
+			break;
+		}
+
+		bool display_enabled = lcd_control.lcd_display_enable;
+
+		switch (addr.address)
+		{
+		case 0xFF40: lcd_control = val; sprite_index.SetHeight(8 << lcd_control.obj_size); break;
 		case 0xFF41: lcd_status = val; break;
 		case 0xFF42: scroll_y = val; break;
 		case 0xFF43: scroll_x = val; break;
-		case 0xFF44: ly = val; break;
+		case 0xFF44: break; // read only, the line being drawn indexes per line tables
 		case 0xFF45: lyc = val; break;
 		case 0xFF46: LaunchDMA(val); break;
 		case 0xFF47: bg_palette = val; break;
@@ -43,9 +102,15 @@ namespace dromaiusgb
 		case 0xFF4A: window_x = val; break;
 		case 0xFF4B: window_y = val; break;
 		}
+
+		if (lcd_control.lcd_display_enable != display_enabled)
+			DisplaySwitched();
+
+		Reschedule();
 	}
 
-	byte LCD::Get(bus_address_t addr) const
+	template <typename PPU>
+	byte BasicLCD<PPU>::Get(bus_address_t addr) const
 	{
 		switch (addr.address)
 		{
@@ -65,214 +130,297 @@ namespace dromaiusgb
 		}
 	}
 
-	std::uint32_t LCD::GetShadeColor(byte shade_index)
+	template <typename PPU>
+	line_registers_t BasicLCD<PPU>::GetLineRegisters() const
 	{
-		switch (shade_index) {
-			case 0: default: return 0xFF06978A; // white
-			case 1: return 0xFF025137; // light gray
-			case 2: return 0xFF047461; // dark gray
-			case 3: return 0xFF002F0E; // black
-		}
-
-		//switch (shade_index) {
-		//	case 0: default: return 0xFFFFFFFF; // white
-		//	case 1: return 0xFF555555; // light gray
-		//	case 2: return 0xFFAAAAAA; // dark gray
-		//	case 3: return 0xFF000000; // black
-		//}
+		return { lcd_control, scroll_y, scroll_x, bg_palette, obj_palette_0, obj_palette_1, window_y, window_x };
 	}
 
-	void LCD::ClearScanLine(byte sy, std::uint32_t color)
+	// as a new line starts
+	template <typename PPU>
+	void BasicLCD<PPU>::CheckCoincidence()
 	{
-		for (unsigned int sx = 0; sx < 160; sx++)
-		{
-			screen_buffer[sx + sy * 160] = color;
-			priority_buffer[sx + sy * 160] = 0;
+		if (ly == lyc) {
+			lcd_status.coincidence_flag = 1;
+
+			if (lcd_status.coincidence_interrupt)
+				interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
+		} else {
+			lcd_status.coincidence_flag = 0;
 		}
 	}
 
-	void LCD::DrawBGScanLine(byte sy, byte start_x, byte *bg_map, tile_data_t *tile_data)
+	template <typename PPU>
+	void BasicLCD<PPU>::SwapBuffers()
 	{
-		byte scrolled_y = scroll_y + sy;
-		byte tile_y = scrolled_y / 8;
-		byte pixel_y = scrolled_y % 8;
-
-		for (unsigned int sx = start_x; sx < 160; sx++)
-		{
-			// get which background tile coord and pixel we are on
-			byte scrolled_x = scroll_x + sx;
-			byte tile_x = scrolled_x / 8;
-			byte pixel_x = scrolled_x % 8;
-
-			// get the background tile to draw from the background map
-			byte tile_number = bg_map[32 * tile_y + tile_x];
-
-			// get the tile from the tile data;
-			tile_data_t tile;
-			if (lcd_control.bg_and_window_tile_data_select == 0)
-				tile = *(tile_data + (sbyte)tile_number);
-			else
-				tile = *(tile_data + tile_number);
-
-			// get the pixel palette index in the tile
-			word tile_line = tile.lines[pixel_y];
-			byte palette_index = ((tile_line >> (7 - pixel_x)) & 0x01) | (((tile_line >> (15 - pixel_x)) & 0x01) << 0x01);
-
-			// convert the palette index to a color
-			byte shade_index;
-			int priority;
-			switch (palette_index) {
-			case 0: shade_index = bg_palette.shade0; priority = 0; break;
-			case 1: shade_index = bg_palette.shade1; priority = 1; break;
-			case 2: shade_index = bg_palette.shade2; priority = 1; break;
-			case 3: shade_index = bg_palette.shade3; priority = 1; break;
-			}
+		if (rendering)
+			renderer.FinishFrame();
+		frame_count += 1;
+	}
 
-			screen_buffer[sx + sy * 160] = GetShadeColor(shade_index);
-			priority_buffer[sx + sy * 160] = priority;
-		}
+	template <typename PPU>
+	void BasicLCD<PPU>::SaveState(State &state) const
+	{
+		state.Write(lcd_control);
+		state.Write(lcd_status);
+		state.Write(scroll_y);
+		state.Write(scroll_x);
+		state.Write(ly);
+		state.Write(lyc);
+		state.Write(dma);
+		state.Write(bg_palette);
+		state.Write(obj_palette_0);
+		state.Write(obj_palette_1);
+		state.Write(window_y);
+		state.Write(window_x);
+		state.Write(cycle);
+		state.Write(mode);
+		state.Write(last_update);
+		state.Write(frame_count);
+		state.Write(line_sprites);
+		ppu.SaveState(state);
+
+		if (ly < vblank_start)
+			renderer.SaveLines(state, GetLinesDrawn());
 	}
 
-	void LCD::DrawScanLine(byte sy)
+	template <typename PPU>
+	void BasicLCD<PPU>::LoadState(State &state)
 	{
-		// clear the screen to white
-		ClearScanLine(sy, 0xFF06978A);
+		state.Read(lcd_control);
+		state.Read(lcd_status);
+		state.Read(scroll_y);
+		state.Read(scroll_x);
+		state.Read(ly);
+		state.Read(lyc);
+		state.Read(dma);
+		state.Read(bg_palette);
+		state.Read(obj_palette_0);
+		state.Read(obj_palette_1);
+		state.Read(window_y);
+		state.Read(window_x);
+		state.Read(cycle);
+		state.Read(mode);
+		state.Read(last_update);
+		state.Read(frame_count);
+		state.Read(line_sprites);
+		ppu.LoadState(state);
+
+		if (ly < vblank_start)
+			renderer.LoadLines(state, GetLinesDrawn());
+
+		// vram and oam were loaded along with the rest
+		renderer.InvalidateVRAM();
+		renderer.InvalidateOAM();
+		sprite_index.SetHeight(8 << lcd_control.obj_size);
+		sprite_index.Invalidate();
+	}
 
-		if (lcd_control.lcd_display_enable == 0)
+	// a write that changes vram or oam first draws what was due with them as they were
+	template <typename PPU>
+	void BasicLCD<PPU>::Writing(const byte *page, byte offset, byte value)
+	{
+		if (page[offset] == value)
 			return;
 
-		// load the correct bg tile map for the background
-		byte *bg_map;
-		switch (lcd_control.bg_tile_map_display_select) {
-		case 0: default:
-			bg_map = bus.GetBlock(0x9800); break;
-		case 1:
-			bg_map = bus.GetBlock(0x9C00); break;
-		}
+		if ((watched_vram && page >= watched_vram && page < watched_vram + 0x2000) || page == watched_oam)
+			DrawUpToNow();
+	}
 
-		// load the correct bg tile map for the window
-		byte *window_map;
-		switch (lcd_control.window_tile_map_display_select) {
-		case 0: default:
-			window_map = bus.GetBlock(0x9800); break;
-		case 1:
-			window_map = bus.GetBlock(0x9C00); break;
+	template <typename PPU>
+	void BasicLCD<PPU>::Written(const byte *page, byte offset)
+	{
+		if (watched_vram && page >= watched_vram && page < watched_vram + 0x1800)
+			renderer.InvalidateTile(word(page - watched_vram + offset) / 16);
+		else if (watched_vram && page >= watched_vram && page < watched_vram + 0x2000)
+			renderer.InvalidateMapEntry(word(page - watched_vram + offset) - 0x1800);
+		else if (page == watched_oam) {
+			renderer.InvalidateOAM();
+			if (offset % 4 == 0)
+				sprite_index.Move(offset / 4, page[offset]);
 		}
+	}
 
-		// load the correct tile data for bg and window
-		tile_data_t *tile_data;
-		switch (lcd_control.bg_and_window_tile_data_select)
-		{
-		case 0: default:
-			tile_data = (tile_data_t *)bus.GetBlock(0x9000); break;
-		case 1:
-			tile_data = (tile_data_t *)bus.GetBlock(0x8000); break;
+	// vram and oam aren't known to the bus yet when the lcd is made, so they are watched once they are mapped
+	template <typename PPU>
+	void BasicLCD<PPU>::Remapped()
+	{
+		const byte *vram = bus.GetBlock(0x8000);
+		if (vram != watched_vram) {
+			for (unsigned int page = 0; watched_vram && page < 0x20; page++)
+				bus.UnwatchWrites(watched_vram + page * 0x100);
+			for (unsigned int page = 0; vram && page < 0x20; page++)
+				bus.WatchWrites(vram + page * 0x100);
+
+			watched_vram = vram;
+			renderer.InvalidateVRAM();
 		}
 
-		// load the correct tile data for sprites
-		tile_data_t *sprite_tile_data = (tile_data_t *)bus.GetBlock(0x8000);
+		const byte *oam = bus.GetBlock(0xFE00);
+		if (oam != watched_oam) {
+			if (watched_oam)
+				bus.UnwatchWrites(watched_oam);
+			if (oam)
+				bus.WatchWrites(oam);
 
-		// draw the background
-		if (lcd_control.bg_display) {
-			DrawBGScanLine(sy, 0, bg_map, tile_data);
+			watched_oam = oam;
+			renderer.InvalidateOAM();
+			sprite_index.Invalidate();
 		}
+	}
 
-		// draw window
-		if (lcd_control.window_display_enable && sy >= window_y && window_x <= 167 && window_y < 144) {
-			DrawBGScanLine(sy, std::min(0, window_x - 7), window_map, tile_data);
-		}
+	template <typename PPU>
+	void BasicLCD<PPU>::SetRendering(bool enable)
+	{
+		DrawUpToNow();
+		rendering = enable;
+	}
 
-		// draw sprites
-		int sprites_left_to_draw = 10; // only 10 sprites allowed per scanline
-		if (lcd_control.obj_display_enable) {
-			byte sprite_height = 8 << (lcd_control.obj_size);
-			sprite_attribute_t *sprites = (sprite_attribute_t *)bus.GetBlock(0xFE00);
+	template <typename PPU>
+	void BasicLCD<PPU>::SetThreadedRendering(bool enable)
+	{
+		renderer.SetThreaded(enable);
+	}
 
-			for (int i = 0; i < 40; i++) {
-				sprite_attribute_t sprite = sprites[i];
+	// waits until every frame finished so far has been handed over
+	template <typename PPU>
+	void BasicLCD<PPU>::FinishRendering() const
+	{
+		renderer.Flush();
+	}
 
-				if (sprite.pos_y == 0 || sprite.pos_y >= 160)
-					continue;
+	template <typename PPU>
+	bool BasicLCD<PPU>::UpdateScreenBuffer()
+	{
+		return renderer.Update();
+	}
 
-				if (sprite.pos_x == 0 || sprite.pos_x >= 168)
-					continue;
+	template <typename PPU>
+	const byte *BasicLCD<PPU>::GetScreenBuffer() const
+	{
+		return renderer.GetFront();
+	}
 
-				int sprite_pos_x = sprite.pos_x - 8;
-				int sprite_pos_y = sprite.pos_y - 16;
-				int sprite_priority = 2 - sprite.obj_bg_priority;
+	template <typename PPU>
+	dword BasicLCD<PPU>::GetFrameCount() const
+	{
+		return frame_count;
+	}
 
-				if (sy < sprite_pos_y || sy >= sprite_height + sprite_pos_y)
-					// sprite is not on this scan line
-					continue;
+	// cycles until the next frame is finished. with the display off there are no frames, so a frame's worth
+	template <typename PPU>
+	cycle_t BasicLCD<PPU>::GetCyclesToVBlank() const
+	{
+		if (!lcd_control.lcd_display_enable)
+			return cycles_per_frame;
 
-				// get the palette for the sprite
-				color_palette_t obj_palete;
-				switch (sprite.palette_num) {
-				case 0: obj_palete = obj_palette_0; break;
-				case 1: obj_palete = obj_palette_1; break;
-				}
+		// the lcd may be behind, but never by a whole line
+		dword lines = (ly < vblank_start) ? vblank_start - 1 - ly : vlines_per_frame - 1 - ly + vblank_start;
+		return lines * cycles_per_vline + (cycles_per_vline - cycle) - (scheduler.Now() - last_update);
+	}
 
-				// get the tile that the sprite uses
-				tile_data_t tile = sprite_tile_data[sprite.tile_num];
-
-				// the y pixel to sample in the sprite tile
-				int sample_y = sy - sprite_pos_y;
-				if (sprite.flip_y)
-					sample_y = sprite_height - sample_y - 1;
-
-				for (int sx = std::max(0, sprite_pos_x); sx < sprite_pos_x + 8; sx++) {
-
-					// the x pixel to sample in the sprite tile
-					int sample_x = sx - sprite_pos_x;
-					if (sprite.flip_x)
-						sample_x = 8 - sample_x - 1;
-
-					// get the pixel palette index in the tile
-					word tile_line = tile.lines[sample_y];
-					byte palette_index = ((tile_line >> (7 - sample_x)) & 0x01) | (((tile_line >> (15 - sample_x)) & 0x01) << 0x01);
-
-					byte shade_index;
-					switch (palette_index) {
-						case 0: continue;
-						case 1: shade_index = obj_palete.shade1; break;
-						case 2: shade_index = obj_palete.shade2; break;
-						case 3: shade_index = obj_palete.shade3; break;
-					}
-
-					int current_priority = priority_buffer[sx + sy * 160];
-					if (sprite_priority > current_priority) {
-						screen_buffer[sx + sy * 160] = GetShadeColor(shade_index);
-						priority_buffer[sx + sy * 160] = sprite_priority;
-					}
-				}
+	template <typename PPU>
+	void BasicLCD<PPU>::LaunchDMA(byte request)
+	{
+		word source_addr = request << 8;
+		const byte *src = bus.GetBlock(source_addr);
+		byte *dst = bus.GetBlock(0xFE00);
 
-				sprites_left_to_draw -= 1;
-				if (sprites_left_to_draw <= 0)
-					break;
-			}
+		DrawUpToNow();
+		memcpy(dst, src, 0xA0);
+		renderer.InvalidateOAM();
+
+		for (byte sprite = 0; sprite < SpriteIndex::sprite_count; sprite++)
+			sprite_index.Move(sprite, dst[sprite * 4]);
+	}
+
+	// ticks up to the scheduler's cycle, stopping at every mode change on the way. between mode changes
+	// only the cycle count moves, so nothing can see the lcd lagging behind
+	template <typename PPU>
+	void BasicLCD<PPU>::Update()
+	{
+		cycle_t now = scheduler.Now();
+
+		while (lcd_control.lcd_display_enable && last_update < now) {
+			dword delta_cycle = (dword)std::min<cycle_t>(now - last_update, GetCyclesToNextMode());
+			Tick(delta_cycle);
+			last_update += delta_cycle;
 		}
+
+		last_update = now;
 	}
 
-	void LCD::SwapBuffers()
+	template <typename PPU>
+	void BasicLCD<PPU>::Reschedule()
 	{
-		screen_texture.update((sf::Uint8 *)screen_buffer);
+		if (lcd_control.lcd_display_enable)
+			scheduler.Schedule(Event::LCD, last_update + GetCyclesToNextMode());
+		else
+			scheduler.Schedule(Event::LCD, Scheduler::never);
 	}
 
-	const sf::Texture &LCD::GetScreenTexture() const
+	template <typename PPU>
+	void BasicLCD<PPU>::CatchUp()
 	{
-		return screen_texture;
+		Update();
+		Reschedule();
 	}
 
-	void LCD::LaunchDMA(byte request)
+	// the scanline ppu
+
+	template <>
+	void BasicLCD<ScanlinePPU>::DrawPendingLines()
 	{
-		word source_addr = request << 8;
-		const byte *src = bus.GetBlock(source_addr);
-		byte *dst = bus.GetBlock(0xFE00);
+		if (ppu.pending_start == ppu.pending_end)
+			return;
+
+		line_registers_t registers = GetLineRegisters();
+		const byte *vram = bus.GetBlock(0x8000);
+		const byte *oam = bus.GetBlock(0xFE00);
+
+		for (byte sy = ppu.pending_start; sy < ppu.pending_end; sy++)
+			renderer.DrawLine(sy, registers, ppu.pending_sprites[sy], vram, oam);
+
+		ppu.pending_start = ppu.pending_end;
+	}
+
+	// called before a register changes. once pixels of the line are out, the ones so far keep the
+	// registers they had
+	template <>
+	void BasicLCD<ScanlinePPU>::SplitLine()
+	{
+		if (!rendering || mode != LCDMode::DataTransfer || cycle <= first_pixel_cycle)
+			return;
+
+		byte x = byte(cycle - first_pixel_cycle);
+		if (ppu.line_piece_count && ppu.line_pieces[ppu.line_piece_count - 1].end_x == x)
+			return;
 
-		memcpy(dst, src, 0x9F);
+		// can't happen with the cpu's timings, but the last piece would just end late
+		if (ppu.line_piece_count == ScanlinePPU::max_line_pieces)
+			ppu.line_piece_count -= 1;
+
+		ppu.line_pieces[ppu.line_piece_count++] = { x, GetLineRegisters() };
 	}
 
-	void LCD::Tick(dword delta_cycle)
+	// the last piece has the registers the line ended with
+	template <>
+	void BasicLCD<ScanlinePPU>::DrawSplitLine(byte sy)
+	{
+		const byte *vram = bus.GetBlock(0x8000);
+		const byte *oam = bus.GetBlock(0xFE00);
+
+		byte start_x = 0;
+		for (byte piece = 0; piece < ppu.line_piece_count; piece++) {
+			renderer.DrawLinePart(sy, start_x, ppu.line_pieces[piece].end_x, ppu.line_pieces[piece].registers, ppu.pending_sprites[sy], vram, oam);
+			start_x = ppu.line_pieces[piece].end_x;
+		}
+
+		renderer.DrawLinePart(sy, start_x, 160, GetLineRegisters(), ppu.pending_sprites[sy], vram, oam);
+	}
+
+	template <>
+	void BasicLCD<ScanlinePPU>::Tick(dword delta_cycle)
 	{
 		if (!lcd_control.lcd_display_enable)
 			return;
@@ -284,31 +432,39 @@ namespace dromaiusgb
 			cycle -= cycles_per_vline;
 			ly += 1;
 
-			// check coincidence
-			if (ly == lyc) {
-				lcd_status.coincidence_flag = 1;
-
-				if (lcd_status.coincidence_interrupt)
-					interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
-			} else {
-				lcd_status.coincidence_flag = 0;
+			CheckCoincidence();
+
+			// the previous line waits to be drawn, after the ones already waiting. ly only steps one line at
+			// a time, so those always end just before it
+			if (ly <= vblank_start) {
+				if (rendering)
+					ppu.pending_sprites[ly - 1] = line_sprites;
+				else
+					ppu.pending_start = ly;
+				ppu.pending_end = ly;
+
+				// a split line doesn't wait. the lines before it were drawn when it was first split
+				if (ppu.line_piece_count) {
+					if (rendering)
+						DrawSplitLine(ly - 1);
+					ppu.pending_start = ly;
+					ppu.line_piece_count = 0;
+				}
 			}
 
 			if (ly < vblank_start) // start hblank
 			{
-				// draw the previous scanline
-				DrawScanLine(ly - 1);
-
 				mode = LCDMode::HBlank;
 				lcd_status.mode_flag = (byte)mode;
 
 				if (lcd_status.mode_0_hblank_interrupt)
 					interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
-			} 
-			else if (ly == vblank_start) // start vblank 
+			}
+			else if (ly == vblank_start) // start vblank
 			{
-				// draw the previous scanline
-				DrawScanLine(ly - 1);
+				DrawPendingLines();
+				ppu.pending_start = 0;
+				ppu.pending_end = 0;
 
 				mode = LCDMode::VBlank;
 				lcd_status.mode_flag = (byte)mode;
@@ -318,7 +474,7 @@ namespace dromaiusgb
 					interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
 
 				SwapBuffers();
-			} 
+			}
 			else if (ly >= vlines_per_frame) // end vblank
 			{
 				ly -= vlines_per_frame;
@@ -332,7 +488,7 @@ namespace dromaiusgb
 		}
 
 		// cycle between hblank, oam_search, data_transfer (when not in vblank)
-		if (mode != LCDMode::VBlank) 
+		if (mode != LCDMode::VBlank)
 		{
 			if (cycle >= data_transfer_start_cycle && mode == LCDMode::OAMSearch)
 			{
@@ -344,9 +500,183 @@ namespace dromaiusgb
 				mode = LCDMode::OAMSearch;
 				lcd_status.mode_flag = (byte)mode;
 
+				if (watched_oam)
+					sprite_index.Select(ly, watched_oam, line_sprites);
+				else
+					line_sprites.count = 0;
+
 				if (lcd_status.mode_2_oam_interrupt)
 					interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
 			}
 		}
 	}
+
+	// cycles until Tick has something to do, either a mode change or the next line
+	template <>
+	dword BasicLCD<ScanlinePPU>::GetCyclesToNextMode() const
+	{
+		dword next = cycles_per_vline;
+		if (mode == LCDMode::HBlank)
+			next = oam_search_start_cycle;
+		else if (mode == LCDMode::OAMSearch)
+			next = data_transfer_start_cycle;
+
+		return next > cycle ? next - cycle : 0;
+	}
+
+	// the lines waiting to be drawn still see the registers as they were, and so does the part of this
+	// line drawn so far
+	template <>
+	void BasicLCD<ScanlinePPU>::RegisterChanging()
+	{
+		DrawPendingLines();
+		SplitLine();
+	}
+
+	template <>
+	void BasicLCD<ScanlinePPU>::DrawUpToNow()
+	{
+		DrawPendingLines();
+	}
+
+	// a line cut short by the display going off isn't drawn
+	template <>
+	void BasicLCD<ScanlinePPU>::DisplaySwitched()
+	{
+		if (!lcd_control.lcd_display_enable)
+			ppu.line_piece_count = 0;
+	}
+
+	template <>
+	byte BasicLCD<ScanlinePPU>::GetLinesDrawn() const
+	{
+		return ppu.pending_start;
+	}
+
+	// the pixel fifo
+
+	template <>
+	void BasicLCD<FifoPPU>::Tick(dword delta_cycle)
+	{
+		if (!lcd_control.lcd_display_enable)
+			return;
+
+		// data transfer lasts until the fifo has put out the whole line
+		if (mode == LCDMode::DataTransfer && ppu.Run(delta_cycle, GetLineRegisters(), bus.GetBlock(0x8000), bus.GetBlock(0xFE00))) {
+			if (rendering)
+				renderer.CopyLine(ly, ppu.GetLine());
+
+			mode = LCDMode::HBlank;
+			lcd_status.mode_flag = (byte)mode;
+
+			if (lcd_status.mode_0_hblank_interrupt)
+				interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
+		}
+
+		cycle += delta_cycle;
+
+		if (mode == LCDMode::OAMSearch && cycle >= FifoPPU::oam_search_cycles)
+		{
+			mode = LCDMode::DataTransfer;
+			lcd_status.mode_flag = (byte)mode;
+
+			ppu.StartLine(ly, line_sprites, GetLineRegisters());
+		}
+		else if (cycle >= cycles_per_vline) // new vline
+		{
+			cycle -= cycles_per_vline;
+			ly += 1;
+
+			if (ly >= vlines_per_frame) {
+				ly -= vlines_per_frame;
+				ppu.StartFrame();
+			}
+
+			CheckCoincidence();
+
+			if (ly < vblank_start) // start oam search
+			{
+				mode = LCDMode::OAMSearch;
+				lcd_status.mode_flag = (byte)mode;
+
+				if (watched_oam)
+					sprite_index.Select(ly, watched_oam, line_sprites);
+				else
+					line_sprites.count = 0;
+
+				if (lcd_status.mode_2_oam_interrupt)
+					interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
+			}
+			else if (ly == vblank_start) // start vblank
+			{
+				mode = LCDMode::VBlank;
+				lcd_status.mode_flag = (byte)mode;
+
+				interrupt_controller.RequestInterrupt(InterruptFlags::VBlank);
+				if (lcd_status.mode_1_vblank_interrupt)
+					interrupt_controller.RequestInterrupt(InterruptFlags::LCDStat);
+
+				SwapBuffers();
+			}
+		}
+	}
+
+	// data transfer can't end before a dot for every pixel still to come
+	template <>
+	dword BasicLCD<FifoPPU>::GetCyclesToNextMode() const
+	{
+		if (mode == LCDMode::DataTransfer)
+			return ppu.GetPixelsLeft();
+
+		dword next = (mode == LCDMode::OAMSearch) ? FifoPPU::oam_search_cycles : cycles_per_vline;
+		return next > cycle ? next - cycle : 0;
+	}
+
+	// the fifo reads the registers as it goes, and Set has brought it up to date already
+	template <>
+	void BasicLCD<FifoPPU>::RegisterChanging()
+	{
+	}
+
+	// so the fifo reads vram and oam as they were up to now
+	template <>
+	void BasicLCD<FifoPPU>::DrawUpToNow()
+	{
+		CatchUp();
+	}
+
+	// the display starts again from the top of a frame when switched on, and sits at line 0 while off
+	template <>
+	void BasicLCD<FifoPPU>::DisplaySwitched()
+	{
+		ly = 0;
+		cycle = 0;
+
+		if (!lcd_control.lcd_display_enable) {
+			mode = LCDMode::HBlank;
+			lcd_status.mode_flag = (byte)mode;
+			return;
+		}
+
+		mode = LCDMode::OAMSearch;
+		lcd_status.mode_flag = (byte)mode;
+
+		ppu.StartFrame();
+		if (watched_oam)
+			sprite_index.Select(ly, watched_oam, line_sprites);
+		else
+			line_sprites.count = 0;
+
+		CheckCoincidence();
+	}
+
+	// a line is handed over as its data transfer ends
+	template <>
+	byte BasicLCD<FifoPPU>::GetLinesDrawn() const
+	{
+		return (lcd_control.lcd_display_enable && mode == LCDMode::HBlank) ? ly + 1 : ly;
+	}
+
+	template class BasicLCD<ScanlinePPU>;
+	template class BasicLCD<FifoPPU>;
 }
\ No newline at end of file
@@ -1,35 +1,21 @@
 #pragma once
 
-#include <SFML/Graphics.hpp>
+#include <cstdint>
 
 #include "types.hpp"
 #include "addressable.hpp"
+#include "bus.hpp"
 #include "interrupts.hpp"
+#include "scheduler.hpp"
+#include "renderer.hpp"
+#include "sprite_index.hpp"
+#include "pixel_fifo.hpp"
+#include "state.hpp"
 
 
 namespace dromaiusgb
 {
 
-	union lcd_control_t
-	{
-		byte value;
-		struct
-		{
-			byte bg_display : 1;
-			byte obj_display_enable : 1;
-			byte obj_size : 1;
-			byte bg_tile_map_display_select : 1;
-			byte bg_and_window_tile_data_select : 1;
-			byte window_display_enable : 1;
-			byte window_tile_map_display_select : 1;
-			byte lcd_display_enable : 1;
-		};
-
-		lcd_control_t() : value(0) {};
-		lcd_control_t(int i) : value(i) {}
-		operator byte() const { return value; };
-	};
-
 	union lcd_status_t
 	{
 		byte value;
@@ -49,61 +35,60 @@ namespace dromaiusgb
 		operator byte() const { return value; };
 	};
 
-	struct sprite_attribute_t
+	enum class LCDMode : byte
 	{
-		byte pos_y;
-		byte pos_x;
-		byte tile_num;
-		
-		struct
-		{
-			byte unused : 4;
-			byte palette_num : 1;
-			byte flip_x : 1;
-			byte flip_y : 1;
-			byte obj_bg_priority : 1;
-		};
+		HBlank = 0,
+		VBlank = 1,
+		OAMSearch = 2,
+		DataTransfer = 3,
 	};
 
-	struct tile_data_t
+	// the part of a line drawn before a register changed, up to the pixel it changed at
+	struct line_piece_t
 	{
-		word lines[8];
+		byte end_x;
+		line_registers_t registers;
 	};
 
-	union color_palette_t
+	// draws whole lines with the Renderer, at fixed timings. finished lines are drawn in one go, once
+	// vram, oam or a register they are drawn with is about to change, or at the end of the frame. until
+	// then lines pending_start up to pending_end wait with the sprites they picked
+	struct ScanlinePPU
 	{
-		byte value;
-		struct
-		{
-			byte shade0 : 2;
-			byte shade1 : 2;
-			byte shade2 : 2;
-			byte shade3 : 2;
-		};
+		// registers written during data transfer split the line being drawn, which is then drawn piece
+		// by piece as soon as it's done. writes take 8 cycles at least, so a line splits 22 times at most
+		static const byte max_line_pieces = 22;
 
-		color_palette_t() : value(0) {};
-		color_palette_t(int i) : value(i) {};
-		operator byte() const { return value; }
-	};
+		byte pending_start;
+		byte pending_end;
+		line_sprites_t pending_sprites[144];
 
-	enum class LCDMode : byte
-	{
-		HBlank = 0,
-		VBlank = 1,
-		OAMSearch = 2,
-		DataTransfer = 3,
+		line_piece_t line_pieces[max_line_pieces];
+		byte line_piece_count;
+
+		ScanlinePPU();
+
+		void SaveState(State &) const;
+		void LoadState(State &);
 	};
 
-	class LCD : public Addressable
+	// the registers, interrupts and frames of the lcd, with the lines drawn and timed by a ppu picked at
+	// compile time, either ScanlinePPU or FifoPPU. the members that depend on it are specialized for
+	// each in lcd.cpp, where both are built
+	template <typename PPU>
+	class BasicLCD : public Addressable, public Scheduled, public BusWatcher
 	{
 	private:
 		const dword cycles_per_frame = 70224; // framerate = 59.73
 		const dword vlines_per_frame = 154;
 		const dword cycles_per_vline = 456; // cycles_per_frame / vlines_per_frame;
 
+		// the scanline ppu's line. the fifo's starts with oam search, and its data transfer lasts as long
+		// as the fifo takes
 		const dword hblank_end_cycle = 204;
 		const dword oam_search_start_cycle = 204;
 		const dword data_transfer_start_cycle = 284;
+		const dword first_pixel_cycle = 296; // pixels come out after the first tile fetches
 
 		const dword vblank_start = 144; // vblank starts at vline 144
 
@@ -123,29 +108,106 @@ namespace dromaiusgb
 
 	private:
 		InterruptController &interrupt_controller;
+		Scheduler &scheduler;
 		dword cycle;
 		LCDMode mode;
 
-		sf::Uint32 *screen_buffer;
-		int *priority_buffer;
-		sf::Texture screen_texture;
+		// the scheduler cycle the lcd was last ticked up to
+		cycle_t last_update;
+
+		Renderer renderer;
+		dword frame_count;
+
+		// writes to vram go to the renderer's caches, writes to oam to the sprite index
+		const byte *watched_vram;
+		const byte *watched_oam;
+
+		// the sprites of the line, picked during its oam search
+		SpriteIndex sprite_index;
+		line_sprites_t line_sprites;
+
+		PPU ppu;
+
+		// when off, frames are still timed and counted but not drawn or handed over
+		bool rendering;
+
 	private:
-		void ClearScanLine(byte, std::uint32_t);
-		void DrawBGScanLine(byte, byte, byte *, tile_data_t *);
-		void DrawScanLine(byte);
+		line_registers_t GetLineRegisters() const;
+		void CheckCoincidence();
 		void SwapBuffers();
 
-		std::uint32_t GetShadeColor(byte);
+		// the ppu's part. before a register the picture depends on changes, before vram, oam or whether
+		// frames are drawn changes, and once the display is switched on or off
+		void RegisterChanging();
+		void DrawUpToNow();
+		void DisplaySwitched();
+		byte GetLinesDrawn() const;
+		dword GetCyclesToNextMode() const;
+		void Tick(dword delta_cycle);
+
+		// the scanline ppu's
+		void DrawPendingLines();
+		void SplitLine();
+		void DrawSplitLine(byte);
+
+		void Update();
+		void Reschedule();
 
 	public:
-		LCD(Bus &, InterruptController &);
-		~LCD();
+		BasicLCD(Bus &, Scheduler &, InterruptController &);
+		~BasicLCD();
 
 		void Set(bus_address_t, byte);
 		byte Get(bus_address_t) const;
 
-		void Tick(dword delta_cycle);
-		const sf::Texture &GetScreenTexture() const;
+		void CatchUp();
+
+		void Writing(const byte *, byte, byte);
+		void Written(const byte *, byte);
+		void Remapped();
+
+		// the lines of the frame being drawn are part of the state, finished frames aren't
+		void SaveState(State &) const;
+		void LoadState(State &);
+		void SetRendering(bool);
+
+		// draws lines on a thread of its own. frames then come out a little later than the vblank that
+		// finished them, unless the emulation thread waits for them
+		void SetThreadedRendering(bool);
+		void FinishRendering() const;
+
+		// the consumer side of frames, for a single thread
+		bool UpdateScreenBuffer();
+		const byte *GetScreenBuffer() const;
+		dword GetFrameCount() const;
+		cycle_t GetCyclesToVBlank() const;
 		void LaunchDMA(byte);
 	};
+
+	// the members specialized for each ppu, in lcd.cpp
+	template <> void BasicLCD<ScanlinePPU>::RegisterChanging();
+	template <> void BasicLCD<ScanlinePPU>::DrawUpToNow();
+	template <> void BasicLCD<ScanlinePPU>::DisplaySwitched();
+	template <> byte BasicLCD<ScanlinePPU>::GetLinesDrawn() const;
+	template <> dword BasicLCD<ScanlinePPU>::GetCyclesToNextMode() const;
+	template <> void BasicLCD<ScanlinePPU>::Tick(dword);
+	template <> void BasicLCD<ScanlinePPU>::DrawPendingLines();
+	template <> void BasicLCD<ScanlinePPU>::SplitLine();
+	template <> void BasicLCD<ScanlinePPU>::DrawSplitLine(byte);
+
+	template <> void BasicLCD<FifoPPU>::RegisterChanging();
+	template <> void BasicLCD<FifoPPU>::DrawUpToNow();
+	template <> void BasicLCD<FifoPPU>::DisplaySwitched();
+	template <> byte BasicLCD<FifoPPU>::GetLinesDrawn() const;
+	template <> dword BasicLCD<FifoPPU>::GetCyclesToNextMode() const;
+	template <> void BasicLCD<FifoPPU>::Tick(dword);
+
+	extern template class BasicLCD<ScanlinePPU>;
+	extern template class BasicLCD<FifoPPU>;
+
+#ifdef DROMAIUSGB_PIXEL_FIFO
+	typedef BasicLCD<FifoPPU> LCD;
+#else
+	typedef BasicLCD<ScanlinePPU> LCD;
+#endif
 }
\ No newline at end of file
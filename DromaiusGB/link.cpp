@@ -4,7 +4,7 @@
 namespace dromaiusgb
 {
 
-	LinkPort::LinkPort(Bus &bus, InterruptController &ic) : Addressable(bus), interrupt_controller(ic)
+	LinkPort::LinkPort(Bus &bus, InterruptController &ic) : Addressable(bus), interrupt_controller(ic), transfer_value(0), output(true)
 	{
 
 	}
@@ -23,7 +23,8 @@ namespace dromaiusgb
 				transfer_control = val;
 
 				if (transfer_control.transfer_start_flag) {
-					std::cout << transfer_value << std::flush;
+					if (output)
+						std::cout << transfer_value << std::flush;
 					transfer_control.transfer_start_flag = 0;
 					interrupt_controller.RequestInterrupt(InterruptFlags::Serial);
 				}
@@ -33,6 +34,23 @@ namespace dromaiusgb
 		}
 	}
 
+	void LinkPort::SaveState(State &state) const
+	{
+		state.Write(transfer_control);
+		state.Write(transfer_value);
+	}
+
+	void LinkPort::LoadState(State &state)
+	{
+		state.Read(transfer_control);
+		state.Read(transfer_value);
+	}
+
+	void LinkPort::SetOutput(bool enable)
+	{
+		output = enable;
+	}
+
 	byte LinkPort::Get(bus_address_t addr) const
 	{
 		switch (addr.address) {
@@ -3,6 +3,7 @@
 #include "types.hpp"
 #include "addressable.hpp"
 #include "interrupts.hpp"
+#include "state.hpp"
 
 
 namespace dromaiusgb
@@ -32,11 +33,18 @@ namespace dromaiusgb
 	private:
 		serial_transfer_control_t transfer_control;
 		byte transfer_value;
+		bool output;
 
 	public:
 		LinkPort(Bus &, InterruptController &);
 
 		void Set(bus_address_t, byte);
 		byte Get(bus_address_t) const;
+
+		void SaveState(State &) const;
+		void LoadState(State &);
+
+		// whether sent bytes go to stdout. frames run ahead are run again, and send theirs again then
+		void SetOutput(bool);
 	};
 }
\ No newline at end of file
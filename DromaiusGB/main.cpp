@@ -2,17 +2,7 @@
 #include <memory>
 #include <SFML/Graphics.hpp>
 
-#include "bus.hpp"
-#include "rom.hpp"
-#include "ram.hpp"
-#include "cartridge.hpp"
-
-#include "cpu.hpp"
-#include "lcd.hpp"
-#include "timer.hpp"
-#include "link.hpp"
-#include "joypad.hpp"
-#include "interrupts.hpp"
+#include "gameboy.hpp"
 
 
 int main(int argc, const char* argv[]) 
@@ -21,45 +11,19 @@ int main(int argc, const char* argv[])
 		return -1;
 	}
 
-	// Set up the address bus
-	dromaiusgb::Bus address_bus;
-
-	auto boot_rom = std::make_shared<dromaiusgb::ROM<0x100>>(address_bus);
-	auto boot_rom_switch = std::make_shared<dromaiusgb::ROMSwitch<0x100>>(address_bus, boot_rom);
-	auto cartridge = std::make_shared<dromaiusgb::Cartridge>(address_bus);
-	auto vram = std::make_shared<dromaiusgb::RAM<0x2000>>(address_bus);
-	auto wram = std::make_shared<dromaiusgb::RAM<0x2000>>(address_bus);
-	auto oam = std::make_shared<dromaiusgb::RAM<0x009F>>(address_bus);
-	auto interrupt_controller = std::make_shared<dromaiusgb::InterruptController>(address_bus);
-	auto timer = std::make_shared<dromaiusgb::Timer>(address_bus, *interrupt_controller);
-	auto lcd = std::make_shared<dromaiusgb::LCD>(address_bus, *interrupt_controller);
-	auto linkport = std::make_shared<dromaiusgb::LinkPort>(address_bus, *interrupt_controller);
-	auto joypad = std::make_shared<dromaiusgb::Joypad>(address_bus, *interrupt_controller);
-	auto hram = std::make_shared<dromaiusgb::RAM<0x007E>>(address_bus);
-
-	address_bus.RegisterAddressSpace(0x0000, 0x0100, boot_rom);
-	address_bus.RegisterAddressSpace(0xFF50, 0xFF50, boot_rom_switch);
-	address_bus.RegisterAddressSpace(0x0000, 0x7FFF, cartridge); // cartridge rom
-	address_bus.RegisterAddressSpace(0x8000, 0x9FFF, vram);
-	address_bus.RegisterAddressSpace(0xA000, 0xBFFF, cartridge); // cartridge ram
-	address_bus.RegisterAddressSpace(0xC000, 0xDFFF, wram);
-	address_bus.RegisterAddressSpace(0xE000, 0xFDFF, wram);
-	address_bus.RegisterAddressSpace(0xFE00, 0xFE9F, oam);
-	address_bus.RegisterAddressSpace(0xFF00, 0xFF00, joypad);
-	address_bus.RegisterAddressSpace(0xFF01, 0xFF02, linkport);
-	address_bus.RegisterAddressSpace(0xFF04, 0xFF07, timer);
-	address_bus.RegisterAddressSpace(0xFF0F, 0xFF0F, interrupt_controller);
-	address_bus.RegisterAddressSpace(0xFF40, 0xFF4B, lcd);
-	address_bus.RegisterAddressSpace(0xFF80, 0xFFFE, hram);
-	address_bus.RegisterAddressSpace(0xFFFF, 0xFFFF, interrupt_controller);
-
-	// Load the boot rom and cartridge
-	boot_rom->LoadFromFile("bootstrap.bin");
-	cartridge->LoadFromFile(argv[1]);
-
-	// start the cpu thread
-	dromaiusgb::CPU cpu(address_bus, *lcd, *timer, *interrupt_controller);
-	cpu.Start();
+	// Set up the machine and load the boot rom and cartridge
+	dromaiusgb::GameBoy gameboy;
+	gameboy.LoadBootROM("bootstrap.bin");
+	gameboy.LoadCartridge(argv[1]);
+
+	dromaiusgb::Joypad &joypad = gameboy.GetJoypad();
+
+	// start the emulation thread
+	gameboy.Start();
+
+	// the texture the gameboy screen buffer is copied to
+	sf::Texture screen_texture;
+	screen_texture.create(dromaiusgb::GameBoy::screen_width, dromaiusgb::GameBoy::screen_height);
 
 	// create a sprite to draw the gameboy screen buffer
 	sf::Sprite spr;
@@ -67,9 +31,14 @@ int main(int argc, const char* argv[])
 	spr.setPosition(240, 216);
 	spr.setScale(2.5f, 2.5f);
 
+	bool green = true;
+
 	// create a window and poll for events
 	sf::RenderWindow window(sf::VideoMode(480, 432), "DromaiusGB", sf::Style::Close);
 
+	// display waits for the monitor's refresh, so input is polled and the newest frame shown just before it
+	window.setVerticalSyncEnabled(true);
+
 	while (window.isOpen()) {
 
 		sf::Event ev;
@@ -79,16 +48,43 @@ int main(int argc, const char* argv[])
 				case sf::Event::KeyPressed:
 				{
 					switch (ev.key.code) {
-						case sf::Keyboard::Up: joypad->SetButtonState(dromaiusgb::JoypadButton::Up, true); break;
-						case sf::Keyboard::Down: joypad->SetButtonState(dromaiusgb::JoypadButton::Down, true); break;
-						case sf::Keyboard::Left: joypad->SetButtonState(dromaiusgb::JoypadButton::Left, true); break;
-						case sf::Keyboard::Right: joypad->SetButtonState(dromaiusgb::JoypadButton::Right, true); break;
-						case sf::Keyboard::Z: joypad->SetButtonState(dromaiusgb::JoypadButton::A, true); break;
-						case sf::Keyboard::X: joypad->SetButtonState(dromaiusgb::JoypadButton::B, true); break;
-						case sf::Keyboard::Escape: joypad->SetButtonState(dromaiusgb::JoypadButton::Start, true); break;
-						case sf::Keyboard::Tab: joypad->SetButtonState(dromaiusgb::JoypadButton::Select, true); break;
-
-						case sf::Keyboard::P: cpu.Toggle(); break;
+						case sf::Keyboard::Up: joypad.QueueButtonState(dromaiusgb::JoypadButton::Up, true); break;
+						case sf::Keyboard::Down: joypad.QueueButtonState(dromaiusgb::JoypadButton::Down, true); break;
+						case sf::Keyboard::Left: joypad.QueueButtonState(dromaiusgb::JoypadButton::Left, true); break;
+						case sf::Keyboard::Right: joypad.QueueButtonState(dromaiusgb::JoypadButton::Right, true); break;
+						case sf::Keyboard::Z: joypad.QueueButtonState(dromaiusgb::JoypadButton::A, true); break;
+						case sf::Keyboard::X: joypad.QueueButtonState(dromaiusgb::JoypadButton::B, true); break;
+						case sf::Keyboard::Escape: joypad.QueueButtonState(dromaiusgb::JoypadButton::Start, true); break;
+						case sf::Keyboard::Tab: joypad.QueueButtonState(dromaiusgb::JoypadButton::Select, true); break;
+
+						case sf::Keyboard::P: gameboy.Toggle(); break;
+
+						// speed multiplier
+						case sf::Keyboard::Num1: gameboy.SetSpeed(1); break;
+						case sf::Keyboard::Num2: gameboy.SetSpeed(2); break;
+						case sf::Keyboard::Num3: gameboy.SetSpeed(4); break;
+						case sf::Keyboard::Num4: gameboy.SetSpeed(dromaiusgb::FramePacer::uncapped); break;
+
+						// run-ahead: none, 1, 2 frames
+						case sf::Keyboard::R: gameboy.SetRunAhead((gameboy.GetRunAhead() + 1) % 3); break;
+						case sf::Keyboard::T: gameboy.SetThreadedRendering(!gameboy.GetThreadedRendering()); break;
+
+						// frame skip: none, 1, 3 frames, adaptive
+						case sf::Keyboard::F:
+							switch (gameboy.GetFrameSkip()) {
+								case 0: gameboy.SetFrameSkip(1); break;
+								case 1: gameboy.SetFrameSkip(3); break;
+								case 3: gameboy.SetFrameSkip(dromaiusgb::GameBoy::adaptive_frame_skip); break;
+								default: gameboy.SetFrameSkip(0); break;
+							}
+							break;
+
+						// the green of the original screen or plain grays
+						case sf::Keyboard::G:
+							green = !green;
+							gameboy.SetPalette(green ? dromaiusgb::ScreenPalette::Green() : dromaiusgb::ScreenPalette::Gray());
+							screen_texture.update((const sf::Uint8 *)gameboy.GetFramebuffer());
+							break;
 					}
 					break;
 				}
@@ -96,14 +92,14 @@ int main(int argc, const char* argv[])
 				case sf::Event::KeyReleased:
 				{
 					switch (ev.key.code) {
-						case sf::Keyboard::Up: joypad->SetButtonState(dromaiusgb::JoypadButton::Up, false); break;
-						case sf::Keyboard::Down: joypad->SetButtonState(dromaiusgb::JoypadButton::Down, false); break;
-						case sf::Keyboard::Left: joypad->SetButtonState(dromaiusgb::JoypadButton::Left, false); break;
-						case sf::Keyboard::Right: joypad->SetButtonState(dromaiusgb::JoypadButton::Right, false); break;
-						case sf::Keyboard::Z: joypad->SetButtonState(dromaiusgb::JoypadButton::A, false); break;
-						case sf::Keyboard::X: joypad->SetButtonState(dromaiusgb::JoypadButton::B, false); break;
-						case sf::Keyboard::Escape: joypad->SetButtonState(dromaiusgb::JoypadButton::Start, false); break;
-						case sf::Keyboard::Tab: joypad->SetButtonState(dromaiusgb::JoypadButton::Select, false); break;
+						case sf::Keyboard::Up: joypad.QueueButtonState(dromaiusgb::JoypadButton::Up, false); break;
+						case sf::Keyboard::Down: joypad.QueueButtonState(dromaiusgb::JoypadButton::Down, false); break;
+						case sf::Keyboard::Left: joypad.QueueButtonState(dromaiusgb::JoypadButton::Left, false); break;
+						case sf::Keyboard::Right: joypad.QueueButtonState(dromaiusgb::JoypadButton::Right, false); break;
+						case sf::Keyboard::Z: joypad.QueueButtonState(dromaiusgb::JoypadButton::A, false); break;
+						case sf::Keyboard::X: joypad.QueueButtonState(dromaiusgb::JoypadButton::B, false); break;
+						case sf::Keyboard::Escape: joypad.QueueButtonState(dromaiusgb::JoypadButton::Start, false); break;
+						case sf::Keyboard::Tab: joypad.QueueButtonState(dromaiusgb::JoypadButton::Select, false); break;
 					}
 					break;
 				}
@@ -117,14 +113,18 @@ int main(int argc, const char* argv[])
 		}
 
 		window.clear(sf::Color::Black);
-		spr.setTexture(lcd->GetScreenTexture());
+		if (gameboy.UpdateFramebuffer())
+			screen_texture.update((const sf::Uint8 *)gameboy.GetFramebuffer());
+		spr.setTexture(screen_texture);
 		window.draw(spr);
 		window.display();
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(16));
+		// show how fast the emulation is going and how busy it keeps its thread
+		const dromaiusgb::FramePacer &pacer = gameboy.GetPacer();
+		window.setTitle("DromaiusGB - " + std::to_string(int(pacer.GetFPS() + 0.5)) + " fps, " + std::to_string(int(pacer.GetHostLoad() * 100 + 0.5)) + "% cpu");
 	}
 
-	// stop the cpu thread
-	cpu.Stop();
+	// stop the emulation thread
+	gameboy.Stop();
 	return 0;
 }
\ No newline at end of file
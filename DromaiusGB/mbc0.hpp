@@ -44,9 +44,32 @@ namespace dromaiusgb
 			return nullptr;
 		}
 
+		byte *GetReadBlock(bus_address_t addr)
+		{
+			return GetBlock(addr);
+		}
+
+		byte *GetWriteBlock(bus_address_t addr)
+		{
+			if (addr.address >= 0xA000 && addr.address <= 0xBFFF)
+				return &ram[addr.offset];
+
+			return nullptr;
+		}
+
 		void LoadROM(std::istream &input)
 		{
 			input.read((char *)rom, ROMSize);
 		}
+
+		void SaveState(State &state) const
+		{
+			state.Write(ram);
+		}
+
+		void LoadState(State &state)
+		{
+			state.Read(ram);
+		}
 	};
 }
\ No newline at end of file
@@ -113,9 +113,41 @@ namespace dromaiusgb
 			return nullptr;
 		}
 
+		byte *GetReadBlock(bus_address_t addr)
+		{
+			return GetBlock(addr);
+		}
+
+		byte *GetWriteBlock(bus_address_t addr)
+		{
+			// rom writes are bank switches, they have to go through Set
+			if (addr.address >= 0xA000 && addr.address <= 0xBFFF && ram_enabled)
+				return &ram[ram_bank][addr.address - 0xA000];
+
+			return nullptr;
+		}
+
 		void LoadROM(std::istream &input)
 		{
 			input.read((char *)rom, ROMSize * ROMBanks);
 		}
+
+		void SaveState(State &state) const
+		{
+			state.Write(ram);
+			state.Write(rom_bank);
+			state.Write(ram_bank);
+			state.Write(ram_enabled);
+			state.Write(mode_select);
+		}
+
+		void LoadState(State &state)
+		{
+			state.Read(ram);
+			state.Read(rom_bank);
+			state.Read(ram_bank);
+			state.Read(ram_enabled);
+			state.Read(mode_select);
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "pacer.hpp"
+
+#include <thread>
+
+
+namespace dromaiusgb
+{
+
+	FramePacer::FramePacer() : speed(1), fps(0), host_load(0)
+	{
+		Reset();
+	}
+
+	void FramePacer::Reset()
+	{
+		clock_t::time_point now = clock_t::now();
+
+		Restart(now);
+		behind = false;
+		next_drawn = now;
+		report_start = now;
+		report_sleep = clock_t::duration::zero();
+		report_frames = 0;
+	}
+
+	void FramePacer::Restart(clock_t::time_point now)
+	{
+		origin = now;
+		cycles = 0;
+		origin_speed = speed;
+	}
+
+	// called after running the given cycles, which finished the given number of frames
+	void FramePacer::Wait(cycle_t slice_cycles, dword frames)
+	{
+		report_frames += frames;
+
+		clock_t::time_point now = clock_t::now();
+		Report(now);
+
+		if (origin_speed != speed)
+			Restart(now);
+
+		cycles += slice_cycles;
+
+		if (origin_speed == uncapped)
+			return;
+
+		clock_t::time_point due = origin + std::chrono::duration_cast<clock_t::duration>(
+			std::chrono::duration<double>(double(cycles) / (double(clock_speed) * origin_speed)));
+
+		behind = now >= due;
+		if (behind) {
+			if (now - due > max_lag)
+				Restart(now);
+			return;
+		}
+
+		if (due - now > spin_time) {
+			std::this_thread::sleep_for(due - now - spin_time);
+
+			clock_t::time_point woken = clock_t::now();
+			report_sleep += woken - now;
+			now = woken;
+		}
+
+		while (now < due) {
+			std::this_thread::yield();
+			now = clock_t::now();
+		}
+	}
+
+	void FramePacer::Report(clock_t::time_point now)
+	{
+		clock_t::duration elapsed = now - report_start;
+		if (elapsed < report_interval)
+			return;
+
+		double seconds = std::chrono::duration<double>(elapsed).count();
+		fps = report_frames / seconds;
+		host_load = 1.0 - std::chrono::duration<double>(report_sleep).count() / seconds;
+
+		report_start = now;
+		report_sleep = clock_t::duration::zero();
+		report_frames = 0;
+	}
+
+	void FramePacer::SetSpeed(dword multiplier)
+	{
+		speed = multiplier;
+	}
+
+	dword FramePacer::GetSpeed() const
+	{
+		return speed;
+	}
+
+	bool FramePacer::IsFrameWanted()
+	{
+		if (speed != uncapped)
+			return !behind;
+
+		clock_t::time_point now = clock_t::now();
+		if (now < next_drawn)
+			return false;
+
+		next_drawn = now + frame_time;
+		return true;
+	}
+
+	double FramePacer::GetFPS() const
+	{
+		return fps;
+	}
+
+	double FramePacer::GetHostLoad() const
+	{
+		return host_load;
+	}
+}
\ No newline at end of file
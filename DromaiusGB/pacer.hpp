@@ -0,0 +1,78 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <atomic>
+#include <chrono>
+
+
+namespace dromaiusgb
+{
+
+	// keeps emulated time in step with the host's monotonic clock. after each slice of emulation the
+	// caller waits until that many cycles are due, sleeping for most of the wait and spinning for the
+	// last stretch, which the os sleep is too coarse for
+	class FramePacer
+	{
+	public:
+		typedef std::chrono::steady_clock clock_t;
+
+		// speed multiplier that runs as fast as the host can
+		static const dword uncapped = 0;
+
+		static const dword clock_speed = 4194304;
+
+	private:
+		// sleeps wake up this late at worst, the rest of a wait is spun
+		const std::chrono::microseconds spin_time{ 1000 };
+
+		// falling further behind than this gives up on catching up, instead of running flat out until it has
+		const std::chrono::milliseconds max_lag{ 100 };
+
+		// how often the measurements are updated
+		const std::chrono::milliseconds report_interval{ 500 };
+
+		// a frame at the real frame rate, 70224 cycles
+		const std::chrono::microseconds frame_time{ 16742 };
+
+		std::atomic<dword> speed;
+
+		// the cycles run since origin, at the speed in use since then
+		clock_t::time_point origin;
+		cycle_t cycles;
+		dword origin_speed;
+
+		// whether the last slice ended later than it was due, and when an uncapped frame is next worth
+		// drawing
+		bool behind;
+		clock_t::time_point next_drawn;
+
+		clock_t::time_point report_start;
+		clock_t::duration report_sleep;
+		dword report_frames;
+
+		std::atomic<double> fps;
+		std::atomic<double> host_load;
+
+	private:
+		void Restart(clock_t::time_point);
+		void Report(clock_t::time_point);
+
+	public:
+		FramePacer();
+
+		void Reset();
+		void Wait(cycle_t, dword);
+
+		void SetSpeed(dword);
+		dword GetSpeed() const;
+
+		// whether the frame about to be run is worth drawing. not while behind real time, and uncapped only
+		// as often as frames come at the real frame rate
+		bool IsFrameWanted();
+
+		// emulated frames per host second, and the part of the time the emulation thread was not asleep
+		double GetFPS() const;
+		double GetHostLoad() const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "pixel_fifo.hpp"
+
+#include <cstring>
+
+
+namespace dromaiusgb
+{
+
+	FifoPPU::FifoPPU()
+	{
+		StartFrame();
+		StartLine(0, line_sprites_t(), line_registers_t());
+		memset(pixels, 0, sizeof(pixels));
+	}
+
+	void FifoPPU::StartFrame()
+	{
+		window_reached = false;
+		window_line = 0;
+	}
+
+	void FifoPPU::StartLine(byte ly, const line_sprites_t &line_sprites, const line_registers_t &registers)
+	{
+		line = ly;
+		sprites = line_sprites;
+
+		start_delay = push_step;
+		fetch_step = 0;
+		fetch_x = 0;
+		bg_count = 0;
+		memset(obj_fifo, 0, sizeof(obj_fifo));
+
+		discard = registers.scroll_x % 8;
+		x = 0;
+		next_sprite = 0;
+		sprite_dots = 0;
+
+		window = false;
+		window_shown = false;
+		if (ly == registers.window_y)
+			window_reached = true;
+	}
+
+	// the row of the map being fetched
+	byte FifoPPU::GetRow(const line_registers_t &registers) const
+	{
+		return window ? window_line : byte(line + registers.scroll_y);
+	}
+
+	// a dot of the bg fetcher
+	void FifoPPU::Fetch(const line_registers_t &registers, const byte *vram)
+	{
+		switch (fetch_step)
+		{
+		case 1: {
+			bool high_map = window ? registers.lcd_control.window_tile_map_display_select : registers.lcd_control.bg_tile_map_display_select;
+			byte column = window ? fetch_x : byte(registers.scroll_x / 8 + fetch_x) % 32;
+			tile_number = vram[(high_map ? 0x1C00 : 0x1800) + GetRow(registers) / 8 * 32 + column];
+			break;
+		}
+
+		case 3:
+		case 5: {
+			// 0x9000 takes signed tile numbers
+			word tile = registers.lcd_control.bg_and_window_tile_data_select ? tile_number : word(0x100 + (signed char)tile_number);
+			byte data = vram[tile * 16 + GetRow(registers) % 8 * 2 + (fetch_step == 5)];
+			if (fetch_step == 3)
+				tile_low = data;
+			else
+				tile_high = data;
+			break;
+		}
+
+		case push_step:
+			if (bg_count)
+				return;
+
+			for (unsigned int i = 0; i < 8; i++)
+				bg_fifo[i] = ((tile_low >> (7 - i)) & 0x01) | (((tile_high >> (7 - i)) & 0x01) << 1);
+
+			bg_count = 8;
+			fetch_x += 1;
+			fetch_step = 0;
+			return;
+		}
+
+		fetch_step += 1;
+	}
+
+	// the sprite's pixels go where the sprite fifo has none yet, so sprites further left, or first in
+	// oam at the same x, stay on top
+	void FifoPPU::FetchSprite(const line_registers_t &registers, const byte *vram, const byte *oam)
+	{
+		const sprite_attribute_t &sprite = ((const sprite_attribute_t *)oam)[sprites.indices[next_sprite++]];
+
+		// the sprite may have moved since the line's sprites were picked
+		byte height = 8 << registers.lcd_control.obj_size;
+		byte row = line + 16 - sprite.pos_y;
+		if (row >= height)
+			return;
+
+		if (sprite.flip_y)
+			row = height - 1 - row;
+
+		byte tile = height == 16 ? sprite.tile_num & 0xFE : sprite.tile_num;
+		const byte *data = vram + tile * 16 + row * 2;
+
+		for (int i = 0; i < 8; i++) {
+			int slot = sprite.pos_x - 8 + i - x;
+			if (slot < 0 || slot >= 8 || (obj_fifo[slot] & 0x03))
+				continue;
+
+			int bit = sprite.flip_x ? i : 7 - i;
+			byte color = ((data[0] >> bit) & 0x01) | (((data[1] >> bit) & 0x01) << 1);
+			if (color)
+				obj_fifo[slot] = color | (sprite.palette_num << 2) | (sprite.obj_bg_priority << 3);
+		}
+	}
+
+	bool FifoPPU::Dot(const line_registers_t &registers, const byte *vram, const byte *oam)
+	{
+		if (start_delay) {
+			start_delay -= 1;
+			return false;
+		}
+
+		if (sprite_dots) {
+			if (--sprite_dots == 0)
+				FetchSprite(registers, vram, oam);
+			return false;
+		}
+
+		// the window takes over from the pixel it starts at. left of the screen its first pixels are
+		// thrown away like the bg's scrolled ones
+		if (!window && window_reached && registers.lcd_control.window_display_enable && x + 7 >= registers.window_x) {
+			window = true;
+			window_shown = true;
+			bg_count = 0;
+			fetch_step = 0;
+			fetch_x = 0;
+			discard = x + 7 - registers.window_x;
+		}
+
+		// a sprite is fetched once its left edge, or the screen's, is next. the bg fetcher finishes the
+		// tile it's on first
+		while (next_sprite < sprites.count && oam[sprites.indices[next_sprite] * 4 + 1] <= x + 8) {
+			if (!registers.lcd_control.obj_display_enable) {
+				next_sprite += 1;
+				continue;
+			}
+
+			if (fetch_step != push_step) {
+				Fetch(registers, vram);
+				return false;
+			}
+
+			// six dots with this one, as long as a tile's fetch
+			sprite_dots = push_step - 1;
+			return false;
+		}
+
+		Fetch(registers, vram);
+		if (!bg_count)
+			return false;
+
+		byte color = bg_fifo[8 - bg_count];
+		bg_count -= 1;
+
+		if (discard) {
+			discard -= 1;
+			return false;
+		}
+
+		byte obj = obj_fifo[0];
+		memmove(obj_fifo, obj_fifo + 1, sizeof(obj_fifo) - 1);
+		obj_fifo[sizeof(obj_fifo) - 1] = 0;
+
+		// the same shades and priorities the renderer draws
+		byte pixel = 0;
+		if (registers.lcd_control.bg_display)
+			pixel = ((registers.bg_palette >> (color * 2)) & 0x03) | ((color != 0) << Renderer::priority_shift);
+		else
+			color = 0;
+
+		bool behind = obj & 0x08;
+		if ((obj & 0x03) && registers.lcd_control.obj_display_enable && !(behind && color)) {
+			byte palette = (obj & 0x04) ? registers.obj_palette_1 : registers.obj_palette_0;
+			pixel = ((palette >> ((obj & 0x03) * 2)) & 0x03) | ((behind ? 1 : 2) << Renderer::priority_shift);
+		}
+
+		pixels[x++] = pixel;
+		return x == 160;
+	}
+
+	bool FifoPPU::Run(dword dots, const line_registers_t &registers, const byte *vram, const byte *oam)
+	{
+		for (; dots; dots--) {
+			if (Dot(registers, vram, oam)) {
+				if (window_shown)
+					window_line += 1;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	dword FifoPPU::GetPixelsLeft() const
+	{
+		return 160 - x;
+	}
+
+	const byte *FifoPPU::GetLine() const
+	{
+		return pixels;
+	}
+
+	void FifoPPU::SaveState(State &state) const
+	{
+		state.Write(line);
+		state.Write(sprites);
+		state.Write(start_delay);
+		state.Write(fetch_step);
+		state.Write(fetch_x);
+		state.Write(tile_number);
+		state.Write(tile_low);
+		state.Write(tile_high);
+		state.Write(bg_fifo);
+		state.Write(bg_count);
+		state.Write(obj_fifo);
+		state.Write(discard);
+		state.Write(x);
+		state.Write(next_sprite);
+		state.Write(sprite_dots);
+		state.Write(window);
+		state.Write(window_shown);
+		state.Write(window_reached);
+		state.Write(window_line);
+		state.Write(pixels);
+	}
+
+	void FifoPPU::LoadState(State &state)
+	{
+		state.Read(line);
+		state.Read(sprites);
+		state.Read(start_delay);
+		state.Read(fetch_step);
+		state.Read(fetch_x);
+		state.Read(tile_number);
+		state.Read(tile_low);
+		state.Read(tile_high);
+		state.Read(bg_fifo);
+		state.Read(bg_count);
+		state.Read(obj_fifo);
+		state.Read(discard);
+		state.Read(x);
+		state.Read(next_sprite);
+		state.Read(sprite_dots);
+		state.Read(window);
+		state.Read(window_shown);
+		state.Read(window_reached);
+		state.Read(window_line);
+		state.Read(pixels);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "types.hpp"
+#include "renderer.hpp"
+#include "sprite_index.hpp"
+#include "state.hpp"
+
+
+namespace dromaiusgb
+{
+
+	// the dmg's pixel pipeline, a dot at a time. the fetcher takes two dots each to read a tile number
+	// and the two bytes of its row, then pushes the row's eight pixels once the bg fifo is empty, and
+	// every dot a pixel leaves the fifo for the screen. the first pixels of a tile scrolled off the left
+	// are thrown away, the window empties the fifo and starts fetching again, and a sprite stops the
+	// pixels while it's fetched, so data transfer lasts 172 dots or longer like on the hardware.
+	// registers are read as the pixels come out
+	class FifoPPU
+	{
+	public:
+		static const dword oam_search_cycles = 80;
+
+	private:
+		static const byte push_step = 6;
+
+		// what the line is drawn from
+		byte line;
+		line_sprites_t sprites;
+
+		// the fetcher. its first fetch of a line is thrown away, which is the start delay
+		byte start_delay;
+		byte fetch_step;
+		byte fetch_x;
+		byte tile_number;
+		byte tile_low;
+		byte tile_high;
+
+		// colour indices, the next pixel first. sprite pixels line up with the bg's and are a colour
+		// index with the palette above it and whether the sprite is behind the bg above that
+		byte bg_fifo[8];
+		byte bg_count;
+		byte obj_fifo[8];
+
+		byte discard;
+		byte x;
+		byte next_sprite;
+		byte sprite_dots;
+
+		// the window's own line count only moves on lines that showed it, and it only shows from the
+		// line ly was first wy on
+		bool window;
+		bool window_shown;
+		bool window_reached;
+		byte window_line;
+
+		byte pixels[160];
+
+	private:
+		byte GetRow(const line_registers_t &) const;
+		void Fetch(const line_registers_t &, const byte *);
+		void FetchSprite(const line_registers_t &, const byte *, const byte *);
+		bool Dot(const line_registers_t &, const byte *, const byte *);
+
+	public:
+		FifoPPU();
+
+		void StartFrame();
+		void StartLine(byte, const line_sprites_t &, const line_registers_t &);
+
+		// runs for the given dots, at most up to the end of the line's data transfer, and tells whether
+		// the line is done. vram starts at 0x8000
+		bool Run(dword, const line_registers_t &, const byte *, const byte *);
+
+		// data transfer lasts at least a dot for every pixel still to come
+		dword GetPixelsLeft() const;
+
+		// in the renderer's format, see Renderer
+		const byte *GetLine() const;
+
+		void SaveState(State &) const;
+		void LoadState(State &);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "gameboy.hpp"
+#include "bus.hpp"
+#include "interrupts.hpp"
+#include "lcd.hpp"
+#include "ram.hpp"
+#include "scheduler.hpp"
+
+
+// runs a rom for a while, then runs an lcd with nothing but its video memory and registers for a number
+// of frames, once with the scanline ppu and once with the pixel fifo, and reports the time per frame
+// and a hash of the last frame of each
+//   ppu_bench <rom> [--frames n] [--repeat n] [--boot bootstrap.bin]
+
+static const dromaiusgb::word registers[] = { 0xFF41, 0xFF42, 0xFF43, 0xFF45, 0xFF47, 0xFF48, 0xFF49, 0xFF4A, 0xFF4B, 0xFF40 };
+
+static uint64_t HashFramebuffer(const dromaiusgb::byte *bytes)
+{
+	// 64-bit fnv-1a
+	uint64_t hash = 14695981039346656037ull;
+
+	for (std::size_t i = 0; i < dromaiusgb::GameBoy::screen_width * dromaiusgb::GameBoy::screen_height; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+template <typename PPU>
+static void Bench(const char *name, const dromaiusgb::byte *values, const dromaiusgb::byte *vram, const dromaiusgb::byte *oam, unsigned long repeat)
+{
+	const dromaiusgb::dword cycles_per_frame = 70224;
+
+	dromaiusgb::Bus bus;
+	dromaiusgb::Scheduler scheduler;
+	auto interrupt_controller = std::make_shared<dromaiusgb::InterruptController>(bus);
+	auto video_ram = std::make_shared<dromaiusgb::RAM<0x2000>>(bus);
+	auto object_ram = std::make_shared<dromaiusgb::RAM<0x00A0>>(bus);
+	auto lcd = std::make_shared<dromaiusgb::BasicLCD<PPU>>(bus, scheduler, *interrupt_controller);
+
+	bus.RegisterAddressSpace(0x8000, 0x9FFF, video_ram);
+	bus.RegisterAddressSpace(0xFE00, 0xFE9F, object_ram);
+	bus.RegisterAddressSpace(0xFF40, 0xFF4B, lcd);
+	bus.Remap();
+
+	// through the bus, so the lcd's caches see it
+	for (dromaiusgb::word addr = 0; addr < 0x2000; addr++)
+		bus.Set(0x8000 + addr, vram[addr]);
+	for (dromaiusgb::word addr = 0; addr < 0xA0; addr++)
+		bus.Set(0xFE00 + addr, oam[addr]);
+	for (std::size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++)
+		bus.Set(registers[i], values[i]);
+
+	auto start = std::chrono::steady_clock::now();
+
+	// four cycles at a time, as often as the cpu would look at the scheduler
+	for (unsigned long frame = 0; frame < repeat; frame++) {
+		for (dromaiusgb::dword cycle = 0; cycle < cycles_per_frame; cycle += 4)
+			scheduler.Advance(4);
+	}
+
+	lcd->FinishRendering();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	lcd->UpdateScreenBuffer();
+
+	std::cout << name << ": " << std::fixed << std::setprecision(1) << elapsed.count() * 1e6 / repeat << " us/frame, "
+		<< "framebuffer: " << std::hex << std::setw(16) << std::setfill('0') << HashFramebuffer(lcd->GetScreenBuffer()) << std::dec << std::endl;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <rom> [--frames n] [--repeat n] [--boot file]" << std::endl;
+		return -1;
+	}
+
+	std::string rom = argv[1];
+	std::string boot_rom = "bootstrap.bin";
+	unsigned long frames = 300;
+	unsigned long repeat = 600;
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			frames = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+			repeat = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--boot") && i + 1 < argc)
+			boot_rom = argv[++i];
+		else {
+			std::cerr << "unknown argument: " << argv[i] << std::endl;
+			return -1;
+		}
+	}
+
+	dromaiusgb::GameBoy gameboy;
+
+	try {
+		gameboy.LoadBootROM(boot_rom);
+		gameboy.LoadCartridge(rom);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	for (unsigned long i = 0; i < frames; i++)
+		gameboy.RunFrame();
+
+	// the copies keep the lcds from seeing the emulator's memory
+	dromaiusgb::Bus &bus = gameboy.GetBus();
+	static dromaiusgb::byte vram[0x2000], oam[0xA0], values[sizeof(registers) / sizeof(registers[0])];
+	memcpy(vram, bus.GetBlock(0x8000), sizeof(vram));
+	memcpy(oam, bus.GetBlock(0xFE00), sizeof(oam));
+
+	// without the stat interrupts, which nothing would handle
+	for (std::size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++)
+		values[i] = bus.Get(registers[i]);
+	values[0] = 0;
+
+	// with the display on, even if the rom had it off just then
+	values[sizeof(values) - 1] |= 0x80;
+
+	std::cout << "lcdc " << std::hex << (int)values[sizeof(values) - 1] << std::dec << ", " << repeat << " frames" << std::endl;
+	Bench<dromaiusgb::ScanlinePPU>("scanline", values, vram, oam, repeat);
+	Bench<dromaiusgb::FifoPPU>("fifo", values, vram, oam, repeat);
+
+	return 0;
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <string>
 #include "types.hpp"
 #include "addressable.hpp"
+#include "state.hpp"
 
 namespace dromaiusgb
 {
@@ -14,7 +15,8 @@ namespace dromaiusgb
 		byte ram[Size];
 
 	public:
-		RAM(Bus &) : Addressable(bus) {}
+		// cleared, so that two machines powered on alike run alike
+		RAM(Bus &bus) : Addressable(bus), ram() {}
 
 		void Set(bus_address_t addr, byte val)
 		{
@@ -31,5 +33,25 @@ namespace dromaiusgb
 			return &ram[addr.offset];
 		}
 
+		byte *GetReadBlock(bus_address_t addr)
+		{
+			return &ram[addr.offset];
+		}
+
+		byte *GetWriteBlock(bus_address_t addr)
+		{
+			return &ram[addr.offset];
+		}
+
+		void SaveState(State &state) const
+		{
+			state.Write(ram);
+		}
+
+		void LoadState(State &state)
+		{
+			state.Read(ram);
+		}
+
 	};
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "gameboy.hpp"
+#include "renderer.hpp"
+
+
+// runs a rom for a while, then draws its video memory over and over with the plain and the vector line
+// renderers, scrolling a pixel further every line, and reports the time per line and a hash of the last
+// frame of each
+//   render_bench <rom> [--frames n] [--repeat n] [--boot bootstrap.bin]
+
+static uint64_t HashFramebuffer(const dromaiusgb::byte *bytes)
+{
+	// 64-bit fnv-1a
+	uint64_t hash = 14695981039346656037ull;
+
+	for (std::size_t i = 0; i < dromaiusgb::GameBoy::screen_width * dromaiusgb::GameBoy::screen_height; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static void Bench(const char *name, bool vectorized, const dromaiusgb::line_registers_t &registers, const dromaiusgb::byte *vram, const dromaiusgb::byte *oam, unsigned long repeat)
+{
+	dromaiusgb::Renderer renderer;
+	renderer.SetVectorized(vectorized);
+
+	if (renderer.IsVectorized() != vectorized) {
+		std::cout << name << ": not built" << std::endl;
+		return;
+	}
+
+	dromaiusgb::line_registers_t line_registers = registers;
+
+	// the lcd picks the sprites of a line before it is drawn
+	dromaiusgb::SpriteIndex sprite_index;
+	dromaiusgb::line_sprites_t sprites[dromaiusgb::GameBoy::screen_height];
+	sprite_index.SetHeight(8 << registers.lcd_control.obj_size);
+	for (dromaiusgb::byte line = 0; line < dromaiusgb::GameBoy::screen_height; line++)
+		sprite_index.Select(line, oam, sprites[line]);
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (unsigned long frame = 0; frame < repeat; frame++) {
+		for (dromaiusgb::byte line = 0; line < dromaiusgb::GameBoy::screen_height; line++) {
+			line_registers.scroll_x = registers.scroll_x + frame + line;
+			renderer.DrawLine(line, line_registers, sprites[line], vram, oam);
+		}
+
+		renderer.FinishFrame();
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	renderer.Update();
+
+	std::cout << name << ": " << std::fixed << std::setprecision(1) << elapsed.count() * 1e9 / (repeat * dromaiusgb::GameBoy::screen_height) << " ns/line, "
+		<< "framebuffer: " << std::hex << std::setw(16) << std::setfill('0') << HashFramebuffer(renderer.GetFront()) << std::dec << std::endl;
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0] << " <rom> [--frames n] [--repeat n] [--boot file]" << std::endl;
+		return -1;
+	}
+
+	std::string rom = argv[1];
+	std::string boot_rom = "bootstrap.bin";
+	unsigned long frames = 300;
+	unsigned long repeat = 2000;
+
+	for (int i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			frames = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+			repeat = std::strtoul(argv[++i], nullptr, 10);
+		else if (!strcmp(argv[i], "--boot") && i + 1 < argc)
+			boot_rom = argv[++i];
+		else {
+			std::cerr << "unknown argument: " << argv[i] << std::endl;
+			return -1;
+		}
+	}
+
+	dromaiusgb::GameBoy gameboy;
+
+	try {
+		gameboy.LoadBootROM(boot_rom);
+		gameboy.LoadCartridge(rom);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	for (unsigned long i = 0; i < frames; i++)
+		gameboy.RunFrame();
+
+	dromaiusgb::Bus &bus = gameboy.GetBus();
+	dromaiusgb::line_registers_t registers;
+	registers.lcd_control = bus.Get(0xFF40);
+	registers.scroll_y = bus.Get(0xFF42);
+	registers.scroll_x = bus.Get(0xFF43);
+	registers.bg_palette = bus.Get(0xFF47);
+	registers.obj_palette_0 = bus.Get(0xFF48);
+	registers.obj_palette_1 = bus.Get(0xFF49);
+	registers.window_y = bus.Get(0xFF4A);
+	registers.window_x = bus.Get(0xFF4B);
+
+	// the copies keep the renderers from seeing the emulator's memory change under them
+	static dromaiusgb::byte vram[0x2000], oam[0xA0];
+	memcpy(vram, bus.GetBlock(0x8000), sizeof(vram));
+	memcpy(oam, bus.GetBlock(0xFE00), sizeof(oam));
+
+	std::cout << "lcdc " << std::hex << (int)registers.lcd_control << std::dec << ", " << repeat << " frames of " << dromaiusgb::GameBoy::screen_height << " lines" << std::endl;
+	Bench("plain", false, registers, vram, oam, repeat);
+	Bench("vector", true, registers, vram, oam, repeat);
+
+	return 0;
+}
\ No newline at end of file
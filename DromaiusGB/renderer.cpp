@@ -0,0 +1,469 @@
+#include "renderer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef DROMAIUSGB_VECTOR_RENDERER
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#endif
+
+
+namespace dromaiusgb
+{
+
+	Renderer::Renderer() : frames(0), threaded(false), latest_memory(nullptr), memory_written(true), jobs_queued(0), jobs_done(0), sleeping(false)
+	{
+		screen_buffer = frames.GetBack();
+
+#ifdef DROMAIUSGB_VECTOR_RENDERER
+		vectorized = true;
+#else
+		vectorized = false;
+#endif
+	}
+
+	Renderer::~Renderer()
+	{
+		SetThreaded(false);
+	}
+
+	void Renderer::ClearScanLine(byte sy)
+	{
+		memset(screen_buffer + sy * 160, 0, 160);
+	}
+
+	// the bitmap of a tile map, see BackgroundCache
+	void Renderer::DrawBGScanLine(const line_registers_t &registers, byte sy, byte start_x, const byte *bitmap)
+	{
+		byte pixels[4] = {
+			registers.bg_palette.shade0,
+			byte(registers.bg_palette.shade1 | (1 << priority_shift)),
+			byte(registers.bg_palette.shade2 | (1 << priority_shift)),
+			byte(registers.bg_palette.shade3 | (1 << priority_shift)),
+		};
+
+		byte *line = screen_buffer + sy * 160;
+		const byte *row = bitmap + 256 * byte(registers.scroll_y + sy);
+
+		// the map wraps around where x does
+		byte x = registers.scroll_x + start_x;
+		for (unsigned int sx = start_x; sx < 160; sx++, x++)
+			line[sx] = pixels[row[x]];
+	}
+
+#ifdef DROMAIUSGB_VECTOR_RENDERER
+	// the row of the bitmap from the scroll on, then its colour indices are turned into pixels 16 or 32
+	// at a time, with a table lookup where there is a byte shuffle and compares where there isn't
+	void Renderer::DrawBGScanLineVector(const line_registers_t &registers, byte sy, byte start_x, const byte *bitmap)
+	{
+		if (start_x >= 160)
+			return;
+
+		const byte *row = bitmap + 256 * byte(registers.scroll_y + sy);
+		byte x = registers.scroll_x + start_x;
+		unsigned int count = 160 - start_x;
+		unsigned int before_wrap = std::min(count, 256u - x);
+
+		// rounded up to whole vectors
+		alignas(32) byte line_pixels[160 + 32];
+		memcpy(line_pixels, row + x, before_wrap);
+		memcpy(line_pixels + before_wrap, row, count - before_wrap);
+
+		char pixels[4] = {
+			char(registers.bg_palette.shade0),
+			char(registers.bg_palette.shade1 | (1 << priority_shift)),
+			char(registers.bg_palette.shade2 | (1 << priority_shift)),
+			char(registers.bg_palette.shade3 | (1 << priority_shift)),
+		};
+
+#ifdef __AVX2__
+		const __m256i lookup = _mm256_broadcastsi128_si256(_mm_setr_epi8(pixels[0], pixels[1], pixels[2], pixels[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0));
+
+		for (unsigned int i = 0; i < count; i += 32) {
+			__m256i indices = _mm256_load_si256((const __m256i *)(line_pixels + i));
+			_mm256_store_si256((__m256i *)(line_pixels + i), _mm256_shuffle_epi8(lookup, indices));
+		}
+#else
+#ifdef __SSSE3__
+		const __m128i lookup = _mm_setr_epi8(pixels[0], pixels[1], pixels[2], pixels[3], 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+#else
+		const __m128i lookup[4] = { _mm_set1_epi8(pixels[0]), _mm_set1_epi8(pixels[1]), _mm_set1_epi8(pixels[2]), _mm_set1_epi8(pixels[3]) };
+#endif
+
+		for (unsigned int i = 0; i < count; i += 16) {
+			__m128i indices = _mm_load_si128((const __m128i *)(line_pixels + i));
+
+#ifdef __SSSE3__
+			__m128i result = _mm_shuffle_epi8(lookup, indices);
+#else
+			__m128i result = _mm_setzero_si128();
+			for (int index = 0; index < 4; index++)
+				result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi8(indices, _mm_set1_epi8(index)), lookup[index]));
+#endif
+
+			_mm_store_si128((__m128i *)(line_pixels + i), result);
+		}
+#endif
+
+		memcpy(screen_buffer + sy * 160 + start_x, line_pixels, count);
+	}
+#endif
+
+	// vram starts at 0x8000
+	void Renderer::DrawScanLine(const line_registers_t &registers, const line_sprites_t &line_sprites, const byte *vram, const byte *oam, byte sy)
+	{
+		// clear the screen to white
+		ClearScanLine(sy);
+
+		if (registers.lcd_control.lcd_display_enable == 0)
+			return;
+
+		// 0x9000 takes signed tile numbers
+		bool signed_tiles = registers.lcd_control.bg_and_window_tile_data_select == 0;
+
+		void (Renderer::*draw_bg)(const line_registers_t &, byte, byte, const byte *) = &Renderer::DrawBGScanLine;
+#ifdef DROMAIUSGB_VECTOR_RENDERER
+		if (vectorized)
+			draw_bg = &Renderer::DrawBGScanLineVector;
+#endif
+
+		// draw the background
+		if (registers.lcd_control.bg_display) {
+			const byte *bg_map = bg_cache.Get(registers.lcd_control.bg_tile_map_display_select, signed_tiles, vram, tile_cache);
+			(this->*draw_bg)(registers, sy, 0, bg_map);
+		}
+
+		// draw window
+		if (registers.lcd_control.window_display_enable && sy >= registers.window_y && registers.window_x <= 167 && registers.window_y < 144) {
+			const byte *window_map = bg_cache.Get(registers.lcd_control.window_tile_map_display_select, signed_tiles, vram, tile_cache);
+			(this->*draw_bg)(registers, sy, std::min(0, registers.window_x - 7), window_map);
+		}
+
+		// draw sprites, the one in front first. a sprite's pixels hide those of the sprites after it, even
+		// where the bg is then drawn over them, and the sprites behind the bg only show on its colour 0
+		if (registers.lcd_control.obj_display_enable && line_sprites.count) {
+			byte sprite_height = 8 << (registers.lcd_control.obj_size);
+			const sprite_attribute_t *sprites = (const sprite_attribute_t *)oam;
+			compositor.Clear();
+
+			for (byte i = 0; i < line_sprites.count; i++) {
+				sprite_attribute_t sprite = sprites[line_sprites.indices[i]];
+
+				int sprite_pos_y = sprite.pos_y - 16;
+				int sprite_priority = 2 - sprite.obj_bg_priority;
+
+				if (sy < sprite_pos_y || sy >= sprite_height + sprite_pos_y)
+					// the sprite height changed since the sprites were picked
+					continue;
+
+				if (sprite.pos_x == 0 || sprite.pos_x >= 168)
+					// off the side of the screen
+					continue;
+
+				// get the palette for the sprite
+				color_palette_t obj_palete;
+				switch (sprite.palette_num) {
+				case 0: obj_palete = registers.obj_palette_0; break;
+				case 1: obj_palete = registers.obj_palette_1; break;
+				}
+
+				byte pixels[4] = {
+					0,
+					byte(obj_palete.shade1 | (sprite_priority << priority_shift)),
+					byte(obj_palete.shade2 | (sprite_priority << priority_shift)),
+					byte(obj_palete.shade3 | (sprite_priority << priority_shift)),
+				};
+
+				// the y pixel to sample in the sprite
+				int sample_y = sy - sprite_pos_y;
+				if (sprite.flip_y)
+					sample_y = sprite_height - sample_y - 1;
+
+				// tall sprites are an even tile on top of the odd one after it
+				word tile_index = sprite.tile_num;
+				if (sprite_height == 16)
+					tile_index = (sprite.tile_num & 0xFE) + sample_y / 8;
+
+				// the row of the sprite, already mirrored if the sprite is
+				const decoded_tile_t &tile = tile_cache.Get(tile_index);
+				const byte *row = sprite.flip_x ? tile.flipped_rows[sample_y % 8] : tile.rows[sample_y % 8];
+				byte opaque = sprite.flip_x ? tile.flipped_opaque[sample_y % 8] : tile.opaque[sample_y % 8];
+
+				byte row_pixels[8];
+				for (unsigned int x = 0; x < 8; x++)
+					row_pixels[x] = pixels[row[x]];
+
+				compositor.AddSprite(sprite.pos_x, opaque, row_pixels, sprite.obj_bg_priority);
+			}
+
+			compositor.Composite(screen_buffer + sy * 160, priority_shift);
+		}
+	}
+
+	// the whole line is drawn and only the part asked for is kept, as few lines are split
+	void Renderer::DrawScanLinePart(const line_registers_t &registers, const line_sprites_t &line_sprites, const byte *vram, const byte *oam, byte sy, byte start_x, byte end_x)
+	{
+		if (start_x == 0 && end_x == 160) {
+			DrawScanLine(registers, line_sprites, vram, oam, sy);
+			return;
+		}
+
+		byte *line = screen_buffer + sy * 160;
+		byte kept[160];
+		memcpy(kept, line, 160);
+
+		DrawScanLine(registers, line_sprites, vram, oam, sy);
+
+		memcpy(line, kept, start_x);
+		memcpy(line + end_x, kept + end_x, 160 - end_x);
+	}
+
+	void Renderer::SwapBuffers()
+	{
+		frames.Publish();
+		screen_buffer = frames.GetBack();
+	}
+
+	void Renderer::DrawLine(byte sy, const line_registers_t &registers, const line_sprites_t &sprites, const byte *vram, const byte *oam)
+	{
+		DrawLinePart(sy, 0, 160, registers, sprites, vram, oam);
+	}
+
+	void Renderer::DrawLinePart(byte sy, byte start_x, byte end_x, const line_registers_t &registers, const line_sprites_t &sprites, const byte *vram, const byte *oam)
+	{
+		if (!threaded) {
+			if (tiles_written.any() || map_written.any()) {
+				tile_cache.Invalidate(tiles_written);
+				bg_cache.Invalidate(map_written, tiles_written, vram);
+				tiles_written.reset();
+				map_written.reset();
+			}
+
+			tile_cache.Update(vram);
+
+			DrawScanLinePart(registers, sprites, vram, oam, sy, start_x, end_x);
+			return;
+		}
+
+		Queue({ CopyMemory(vram, oam), registers, sprites, sy, start_x, end_x });
+	}
+
+	// the render thread may still be drawing into the frame
+	void Renderer::CopyLine(byte sy, const byte *pixels)
+	{
+		Flush();
+		memcpy(screen_buffer + sy * 160, pixels, 160);
+	}
+
+	// from the emulation thread, as vram is written to
+	void Renderer::InvalidateTile(word index)
+	{
+		tiles_written.set(index);
+		memory_written = true;
+	}
+
+	// map entries count from 0x9800
+	void Renderer::InvalidateMapEntry(word index)
+	{
+		map_written.set(index);
+		memory_written = true;
+	}
+
+	void Renderer::InvalidateVRAM()
+	{
+		tiles_written.set();
+		map_written.set();
+		memory_written = true;
+	}
+
+	void Renderer::InvalidateOAM()
+	{
+		memory_written = true;
+	}
+
+	void Renderer::FinishFrame()
+	{
+		if (!threaded) {
+			SwapBuffers();
+			return;
+		}
+
+		Queue({ nullptr, line_registers_t(), line_sprites_t(), finish_frame, 0, 0 });
+	}
+
+	// most lines are drawn from the same video memory, which the last copy still holds unless one of
+	// the invalidations above came in since
+	video_memory_t *Renderer::CopyMemory(const byte *vram, const byte *oam)
+	{
+		if (latest_memory && !memory_written)
+			return latest_memory;
+
+		video_memory_t *memory;
+		if (!free_memory.Pop(memory)) {
+			memory_pool.push_back(std::make_unique<video_memory_t>());
+			memory = memory_pool.back().get();
+		}
+
+		memcpy(memory->vram, vram, sizeof(memory->vram));
+		memcpy(memory->oam, oam, sizeof(memory->oam));
+		memory->tiles_written = tiles_written;
+		memory->map_written = map_written;
+		tiles_written.reset();
+		map_written.reset();
+		memory_written = false;
+		latest_memory = memory;
+		return memory;
+	}
+
+	void Renderer::Queue(const job_t &job)
+	{
+		while (!jobs.Push(job))
+			std::this_thread::yield();
+
+		jobs_queued += 1;
+
+		// pairs with the fence in WaitForJob, so either the render thread sees the job or we see it asleep
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			wake.notify_one();
+		}
+	}
+
+	void Renderer::WaitForJob(job_t &job)
+	{
+		// lines come in every few microseconds when running flat out, don't go to sleep between them
+		auto spin_until = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+		do {
+			if (jobs.Pop(job))
+				return;
+			std::this_thread::yield();
+		} while (std::chrono::steady_clock::now() < spin_until);
+
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		while (!jobs.Pop(job))
+			wake.wait(lock);
+
+		sleeping.store(false, std::memory_order_relaxed);
+	}
+
+	void Renderer::RenderThread()
+	{
+		video_memory_t *memory = nullptr;
+		job_t job;
+
+		for (;;) {
+			WaitForJob(job);
+
+			if (job.line == stop)
+				break;
+
+			if (job.line == finish_frame) {
+				SwapBuffers();
+			} else {
+				// the emulation thread only copies memory again after we've seen its last copy
+				if (job.memory != memory) {
+					if (memory)
+						free_memory.Push(memory);
+					memory = job.memory;
+
+					tile_cache.Invalidate(memory->tiles_written);
+					bg_cache.Invalidate(memory->map_written, memory->tiles_written, memory->vram);
+					tile_cache.Update(memory->vram);
+				}
+
+				DrawScanLinePart(job.registers, job.sprites, memory->vram, memory->oam, job.line, job.start_x, job.end_x);
+			}
+
+			jobs_done.store(jobs_done.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	}
+
+	void Renderer::Flush() const
+	{
+		while (jobs_done.load(std::memory_order_acquire) != jobs_queued)
+			std::this_thread::yield();
+	}
+
+	// the frame being drawn carries over
+	void Renderer::SetThreaded(bool enable)
+	{
+		if (enable == threaded)
+			return;
+
+		if (enable) {
+			tile_cache.InvalidateAll();
+			bg_cache.InvalidateAll();
+			threaded = true;
+			thread = std::thread([this] { RenderThread(); });
+			return;
+		}
+
+		Queue({ nullptr, line_registers_t(), line_sprites_t(), stop, 0, 0 });
+		thread.join();
+		threaded = false;
+
+		// the render thread leaves the caches as of the last copy it drew from
+		tile_cache.InvalidateAll();
+		bg_cache.InvalidateAll();
+
+		// every copy is back now, or was in use when the thread stopped
+		video_memory_t *memory;
+		while (free_memory.Pop(memory));
+		memory_pool.clear();
+		latest_memory = nullptr;
+		jobs_queued = 0;
+		jobs_done = 0;
+	}
+
+	bool Renderer::IsThreaded() const
+	{
+		return threaded;
+	}
+
+	// the render thread picks it up with the next line it is given
+	void Renderer::SetVectorized(bool enable)
+	{
+#ifdef DROMAIUSGB_VECTOR_RENDERER
+		Flush();
+		vectorized = enable;
+#endif
+	}
+
+	bool Renderer::IsVectorized() const
+	{
+		return vectorized;
+	}
+
+	void Renderer::SaveLines(State &state, byte lines) const
+	{
+		Flush();
+		state.Write(screen_buffer, lines * 160);
+	}
+
+	void Renderer::LoadLines(State &state, byte lines)
+	{
+		Flush();
+		state.Read(screen_buffer, lines * 160);
+	}
+
+	bool Renderer::Update()
+	{
+		return frames.Update();
+	}
+
+	const byte *Renderer::GetFront() const
+	{
+		return frames.GetFront();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.hpp"
+#include "state.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+#include "tile_cache.hpp"
+#include "bg_cache.hpp"
+#include "sprite_index.hpp"
+#include "compositor.hpp"
+
+// the vector line renderer needs sse2, which every x86-64 cpu has. it uses ssse3 or avx2 when they are
+// enabled
+#if defined(__SSE2__) || defined(_M_X64)
+#define DROMAIUSGB_VECTOR_RENDERER
+#endif
+
+namespace dromaiusgb
+{
+
+	union lcd_control_t
+	{
+		byte value;
+		struct
+		{
+			byte bg_display : 1;
+			byte obj_display_enable : 1;
+			byte obj_size : 1;
+			byte bg_tile_map_display_select : 1;
+			byte bg_and_window_tile_data_select : 1;
+			byte window_display_enable : 1;
+			byte window_tile_map_display_select : 1;
+			byte lcd_display_enable : 1;
+		};
+
+		lcd_control_t() : value(0) {};
+		lcd_control_t(int i) : value(i) {}
+		operator byte() const { return value; };
+	};
+
+	struct sprite_attribute_t
+	{
+		byte pos_y;
+		byte pos_x;
+		byte tile_num;
+
+		struct
+		{
+			byte unused : 4;
+			byte palette_num : 1;
+			byte flip_x : 1;
+			byte flip_y : 1;
+			byte obj_bg_priority : 1;
+		};
+	};
+
+	union color_palette_t
+	{
+		byte value;
+		struct
+		{
+			byte shade0 : 2;
+			byte shade1 : 2;
+			byte shade2 : 2;
+			byte shade3 : 2;
+		};
+
+		color_palette_t() : value(0) {};
+		color_palette_t(int i) : value(i) {};
+		operator byte() const { return value; }
+	};
+
+	// the registers a line is drawn with, as they were when the lcd finished the line
+	struct line_registers_t
+	{
+		lcd_control_t lcd_control;
+		byte scroll_y;
+		byte scroll_x;
+		color_palette_t bg_palette;
+		color_palette_t obj_palette_0;
+		color_palette_t obj_palette_1;
+		byte window_y;
+		byte window_x;
+	};
+
+	// a copy of vram (from 0x8000) and oam, for drawing lines on another thread, and the tiles and map
+	// entries written to since the copy before
+	struct video_memory_t
+	{
+		byte vram[0x2000];
+		byte oam[0xA0];
+		TileCache::tile_set_t tiles_written;
+		BackgroundCache::entry_set_t map_written;
+	};
+
+	// draws lines into frames, either right away on the emulation thread or on a render thread of its
+	// own. a queued line carries the registers it is drawn with, and a copy of video memory that is
+	// only made again once video memory was written to after the last copy. the render thread hands
+	// copies back once it has moved on to a newer one
+	class Renderer
+	{
+	private:
+		struct job_t
+		{
+			video_memory_t *memory;
+			line_registers_t registers;
+			line_sprites_t sprites;
+			byte line;
+			byte start_x;
+			byte end_x;
+		};
+
+		static const byte finish_frame = 0xFE;
+		static const byte stop = 0xFF;
+
+	private:
+		// finished frames go to the front-end through frames, screen_buffer is the one being drawn
+		TripleBuffer<byte, 160 * 144> frames;
+		byte *screen_buffer;
+
+		// tiles and map entries written to since they were last handed to the caches
+		TileCache tile_cache;
+		TileCache::tile_set_t tiles_written;
+		BackgroundCache bg_cache;
+		BackgroundCache::entry_set_t map_written;
+
+		LineCompositor compositor;
+		bool vectorized;
+
+		std::thread thread;
+		bool threaded;
+
+		// the emulation thread queues jobs and takes copies back, the render thread the other way round
+		SPSCQueue<job_t, 256> jobs;
+		SPSCQueue<video_memory_t *, 512> free_memory;
+		std::vector<std::unique_ptr<video_memory_t>> memory_pool;
+		video_memory_t *latest_memory;
+		bool memory_written;
+		std::size_t jobs_queued;
+		std::atomic<std::size_t> jobs_done;
+
+		// the render thread sleeps once it has run out of lines for a while
+		std::mutex wake_mutex;
+		std::condition_variable wake;
+		std::atomic<bool> sleeping;
+
+	private:
+		void ClearScanLine(byte);
+		void DrawBGScanLine(const line_registers_t &, byte, byte, const byte *);
+#ifdef DROMAIUSGB_VECTOR_RENDERER
+		void DrawBGScanLineVector(const line_registers_t &, byte, byte, const byte *);
+#endif
+		void DrawScanLine(const line_registers_t &, const line_sprites_t &, const byte *, const byte *, byte);
+		void DrawScanLinePart(const line_registers_t &, const line_sprites_t &, const byte *, const byte *, byte, byte, byte);
+		void SwapBuffers();
+
+		video_memory_t *CopyMemory(const byte *, const byte *);
+		void Queue(const job_t &);
+		void WaitForJob(job_t &);
+		void RenderThread();
+
+	public:
+		// pixels are a shade in the low two bits with the priority it was drawn with above them. the bg's
+		// colour 0 has priority 0, the rest of the bg and window 1 and sprites 1 behind the bg or 2 above
+		static const byte shade_mask = 0x03;
+		static const byte priority_shift = 2;
+
+	public:
+		Renderer();
+		~Renderer();
+
+		// from the emulation thread. vram and oam are read before the call returns. a part of a line is
+		// from start_x up to end_x, for lines whose registers changed while they were drawn
+		void DrawLine(byte, const line_registers_t &, const line_sprites_t &, const byte *, const byte *);
+		void DrawLinePart(byte, byte, byte, const line_registers_t &, const line_sprites_t &, const byte *, const byte *);
+		// a line drawn by the caller, in the same format
+		void CopyLine(byte, const byte *);
+		void FinishFrame();
+		void InvalidateTile(word);
+		void InvalidateMapEntry(word);
+		void InvalidateVRAM();
+		void InvalidateOAM();
+
+		// waits for the render thread to draw every line queued so far
+		void Flush() const;
+		void SetThreaded(bool);
+		bool IsThreaded() const;
+
+		// draws the bg and window several tiles at a time when built with the vector renderer, which is
+		// the default. the plain renderer stays for comparison
+		void SetVectorized(bool);
+		bool IsVectorized() const;
+
+		// the lines of the frame being drawn, up to the given line
+		void SaveLines(State &, byte) const;
+		void LoadLines(State &, byte);
+
+		// the consumer side of frames, for a single thread
+		bool Update();
+		const byte *GetFront() const;
+	};
+}
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <fstream>
 #include "types.hpp"
 #include "addressable.hpp"
+#include "state.hpp"
 
 namespace dromaiusgb
 {
@@ -15,7 +16,7 @@ namespace dromaiusgb
 		byte rom[Size];
 
 	public:
-		ROM(Bus &) : Addressable(bus), rom_enabled(true) {};
+		ROM(Bus &bus) : Addressable(bus), rom_enabled(true) {};
 
 		bool Enabled() const 
 		{ 
@@ -34,6 +35,11 @@ namespace dromaiusgb
 			return &rom[addr.offset];
 		}
 
+		byte *GetReadBlock(bus_address_t addr)
+		{
+			return &rom[addr.offset];
+		}
+
 		void LoadFromFile(std::string name)
 		{
 			std::ifstream input(name, std::ios::binary);
@@ -48,6 +54,17 @@ namespace dromaiusgb
 		{
 			rom_enabled = false;
 		}
+
+		// the contents come from a file, only whether the rom is still mapped changes
+		void SaveState(State &state) const
+		{
+			state.Write(rom_enabled);
+		}
+
+		void LoadState(State &state)
+		{
+			state.Read(rom_enabled);
+		}
 	};
 
 	template <word Size>
@@ -59,7 +76,11 @@ namespace dromaiusgb
 	public:
 		ROMSwitch(Bus &bus, std::shared_ptr<ROM<Size>> rom) : Addressable(bus), rom(rom) {}
 
-		void Set(bus_address_t, byte) { rom->Disable(); }
+		void Set(bus_address_t, byte) 
+		{ 
+			rom->Disable(); 
+			bus.Remap();
+		}
 		byte Get(bus_address_t) const { return 0xFF; }
 	};
 }
\ No newline at end of file
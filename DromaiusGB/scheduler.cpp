@@ -0,0 +1,59 @@
+#include "scheduler.hpp"
+
+
+namespace dromaiusgb
+{
+
+	Scheduler::Scheduler()
+	{
+		events.fill(never);
+		handlers.fill(nullptr);
+	}
+
+	void Scheduler::UpdateNextEvent()
+	{
+		next_event = never;
+		for (cycle_t event : events) {
+			if (event < next_event)
+				next_event = event;
+		}
+	}
+
+	void Scheduler::RunEvents()
+	{
+		for (std::size_t i = 0; i < events.size(); i++) {
+			if (events[i] > now)
+				continue;
+
+			// the handler schedules its next event itself
+			events[i] = never;
+			handlers[i]->CatchUp();
+		}
+
+		UpdateNextEvent();
+	}
+
+	void Scheduler::Register(Event event, Scheduled *handler)
+	{
+		handlers[(std::size_t)event] = handler;
+	}
+
+	void Scheduler::Schedule(Event event, cycle_t cycle)
+	{
+		events[(std::size_t)event] = cycle;
+		UpdateNextEvent();
+	}
+
+	void Scheduler::SaveState(State &state) const
+	{
+		state.Write(now);
+		state.Write(events);
+	}
+
+	void Scheduler::LoadState(State &state)
+	{
+		state.Read(now);
+		state.Read(events);
+		UpdateNextEvent();
+	}
+}
\ No newline at end of file
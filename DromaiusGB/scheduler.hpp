@@ -0,0 +1,80 @@
+#pragma once
+
+#include "types.hpp"
+#include "state.hpp"
+
+#include <array>
+
+
+namespace dromaiusgb
+{
+
+	// one slot per component, handled in this order when several are due at once
+	enum class Event : byte
+	{
+		Timer,
+		LCD,
+		Joypad,
+		Stop,
+		Count,
+	};
+
+	// brought up to date by the scheduler when its event is due
+	class Scheduled
+	{
+	public:
+		virtual ~Scheduled() {}
+
+		virtual void CatchUp() =0;
+	};
+
+	// the global cycle count and the cycle of the next event of each component. the cpu runs without
+	// ticking anything until the earliest event is due, in between components catch up on their own
+	// when their registers are accessed
+	class Scheduler
+	{
+	public:
+		static constexpr cycle_t never = ~cycle_t(0);
+
+	private:
+		cycle_t now = 0;
+		cycle_t next_event = never;
+		std::array<cycle_t, (std::size_t)Event::Count> events;
+		std::array<Scheduled *, (std::size_t)Event::Count> handlers;
+
+	private:
+		void UpdateNextEvent();
+		void RunEvents();
+
+	public:
+		Scheduler();
+
+		cycle_t Now() const;
+		cycle_t NextEvent() const;
+		void Advance(dword);
+
+		void Register(Event, Scheduled *);
+		void Schedule(Event, cycle_t);
+
+		void SaveState(State &) const;
+		void LoadState(State &);
+	};
+
+	inline cycle_t Scheduler::Now() const
+	{
+		return now;
+	}
+
+	inline cycle_t Scheduler::NextEvent() const
+	{
+		return next_event;
+	}
+
+	inline void Scheduler::Advance(dword cycles)
+	{
+		now += cycles;
+
+		if (now >= next_event)
+			RunEvents();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "screen_palette.hpp"
+
+
+namespace dromaiusgb
+{
+
+	ScreenPalette::ScreenPalette() : ScreenPalette(Green())
+	{
+	}
+
+	ScreenPalette::ScreenPalette(std::uint32_t shade0, std::uint32_t shade1, std::uint32_t shade2, std::uint32_t shade3) : colors{ shade0, shade1, shade2, shade3 }
+	{
+	}
+
+	ScreenPalette ScreenPalette::Green()
+	{
+		return ScreenPalette(0xFF06978A, 0xFF025137, 0xFF047461, 0xFF002F0E);
+	}
+
+	ScreenPalette ScreenPalette::Gray()
+	{
+		return ScreenPalette(0xFFFFFFFF, 0xFF555555, 0xFFAAAAAA, 0xFF000000);
+	}
+
+	void ScreenPalette::SetColor(byte shade, std::uint32_t color)
+	{
+		colors[shade & shade_mask] = color;
+	}
+
+	std::uint32_t ScreenPalette::GetColor(byte shade) const
+	{
+		return colors[shade & shade_mask];
+	}
+
+	void ScreenPalette::ToRGBA(const byte *pixels, std::uint32_t *out, std::size_t count) const
+	{
+		for (std::size_t i = 0; i < count; i++)
+			out[i] = colors[pixels[i] & shade_mask];
+	}
+
+	void ScreenPalette::ToRGB565(const byte *pixels, std::uint16_t *out, std::size_t count) const
+	{
+		std::uint16_t lut[4];
+		for (int shade = 0; shade < 4; shade++) {
+			std::uint32_t color = colors[shade];
+			byte r = color & 0xFF, g = (color >> 8) & 0xFF, b = (color >> 16) & 0xFF;
+			lut[shade] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+		}
+
+		for (std::size_t i = 0; i < count; i++)
+			out[i] = lut[pixels[i] & shade_mask];
+	}
+
+	void ScreenPalette::ToGrayscale(const byte *pixels, byte *out, std::size_t count) const
+	{
+		byte lut[4];
+		for (int shade = 0; shade < 4; shade++) {
+			std::uint32_t color = colors[shade];
+			dword r = color & 0xFF, g = (color >> 8) & 0xFF, b = (color >> 16) & 0xFF;
+			lut[shade] = (r * 77 + g * 150 + b * 29) >> 8;
+		}
+
+		for (std::size_t i = 0; i < count; i++)
+			out[i] = lut[pixels[i] & shade_mask];
+	}
+}
\ No newline at end of file
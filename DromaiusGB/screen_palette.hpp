@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "types.hpp"
+
+
+namespace dromaiusgb
+{
+
+	// the colours the four shades are shown in, and the conversion of finished frames to host pixels.
+	// frames hold a shade in the low two bits of each pixel, anything above is left over from drawing.
+	// colours are RGBA bytes
+	class ScreenPalette
+	{
+	public:
+		static const byte shade_mask = 0x03;
+
+	private:
+		std::uint32_t colors[4];
+
+	public:
+		// the green of the original screen
+		ScreenPalette();
+		ScreenPalette(std::uint32_t, std::uint32_t, std::uint32_t, std::uint32_t);
+
+		static ScreenPalette Green();
+		static ScreenPalette Gray();
+
+		void SetColor(byte, std::uint32_t);
+		std::uint32_t GetColor(byte) const;
+
+		void ToRGBA(const byte *, std::uint32_t *, std::size_t) const;
+		void ToRGB565(const byte *, std::uint16_t *, std::size_t) const;
+
+		// the luma of each colour
+		void ToGrayscale(const byte *, byte *, std::size_t) const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "sprite_index.hpp"
+
+
+namespace dromaiusgb
+{
+
+	SpriteIndex::SpriteIndex() : height(8)
+	{
+		Invalidate();
+	}
+
+	void SpriteIndex::Invalidate()
+	{
+		dirty = true;
+	}
+
+	void SpriteIndex::SetHeight(byte height)
+	{
+		if (height == this->height)
+			return;
+
+		this->height = height;
+		dirty = true;
+	}
+
+	// sprite y is 16 below the line the sprite starts on, so only some of its lines may be on screen
+	void SpriteIndex::Mark(byte sprite, bool on)
+	{
+		int top = sprite_y[sprite] - 16;
+		int start = top < 0 ? 0 : top;
+		int end = top + height > 144 ? 144 : top + height;
+		std::uint64_t bit = std::uint64_t(1) << sprite;
+
+		for (int line = start; line < end; line++) {
+			if (on)
+				lines[line] |= bit;
+			else
+				lines[line] &= ~bit;
+		}
+	}
+
+	void SpriteIndex::Index(const byte *oam)
+	{
+		lines.fill(0);
+
+		for (byte sprite = 0; sprite < sprite_count; sprite++) {
+			sprite_y[sprite] = oam[sprite * 4];
+			Mark(sprite, true);
+		}
+
+		dirty = false;
+	}
+
+	void SpriteIndex::Move(byte sprite, byte y)
+	{
+		if (dirty || sprite_y[sprite] == y)
+			return;
+
+		Mark(sprite, false);
+		sprite_y[sprite] = y;
+		Mark(sprite, true);
+	}
+
+	void SpriteIndex::Select(byte line, const byte *oam, line_sprites_t &selected)
+	{
+		if (dirty)
+			Index(oam);
+
+		selected.count = 0;
+
+		// the first 10 in oam order, counting those off the sides of the screen
+		std::uint64_t on_line = lines[line];
+		for (byte sprite = 0; on_line && selected.count < 10; sprite++, on_line >>= 1) {
+			if (!(on_line & 1))
+				continue;
+
+			// by x, keeping oam order for the same x
+			byte x = oam[sprite * 4 + 1];
+			byte position = selected.count++;
+			while (position > 0 && oam[selected.indices[position - 1] * 4 + 1] > x) {
+				selected.indices[position] = selected.indices[position - 1];
+				position--;
+			}
+
+			selected.indices[position] = sprite;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "types.hpp"
+
+
+namespace dromaiusgb
+{
+
+	// the sprites a line shows, at most 10, the one drawn over all others first. the dmg picks the first
+	// 10 sprites in oam on the line, then the one further left wins where they overlap, or the one first
+	// in oam at the same x
+	struct line_sprites_t
+	{
+		byte count;
+		byte indices[10];
+	};
+
+	// which sprites are on which line, kept up to date as oam is written to rather than searched for
+	// every line. sprites are indexed by their y and the sprite height. after dma or a height change the
+	// whole of oam is indexed again the next time a line is picked
+	class SpriteIndex
+	{
+	public:
+		static const byte sprite_count = 40;
+
+	private:
+		// a bit for every sprite on the line, in oam order
+		std::array<std::uint64_t, 144> lines;
+		std::array<byte, sprite_count> sprite_y;
+		byte height;
+		bool dirty;
+
+	private:
+		void Mark(byte, bool);
+		void Index(const byte *);
+
+	public:
+		SpriteIndex();
+
+		void Invalidate();
+		void SetHeight(byte);
+
+		// the sprite's y was written
+		void Move(byte, byte);
+
+		void Select(byte, const byte *, line_sprites_t &);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <atomic>
+#include <array>
+
+
+namespace dromaiusgb
+{
+
+	// a fixed size ring of items passed from one producer thread to one consumer thread without locks.
+	// each side owns one index and only reads the other's, so pushing and popping never wait
+	template <typename T, std::size_t Capacity>
+	class SPSCQueue
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+
+	private:
+		std::array<T, Capacity> items;
+
+		// head is written by the consumer only, tail by the producer only. both count up forever
+		alignas(64) std::atomic<std::size_t> head;
+		alignas(64) std::atomic<std::size_t> tail;
+
+	public:
+		SPSCQueue() : head(0), tail(0) {}
+
+		// false when the queue is full
+		bool Push(const T &item)
+		{
+			std::size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == Capacity)
+				return false;
+
+			items[t & (Capacity - 1)] = item;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		// false when the queue is empty
+		bool Pop(T &item)
+		{
+			std::size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+				return false;
+
+			item = items[h & (Capacity - 1)];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+
+namespace dromaiusgb
+{
+
+	// a snapshot of the machine in memory. components write their state in a fixed order and read it
+	// back in the same order. the buffer keeps its size between snapshots, so taking one every frame
+	// doesn't allocate
+	class State
+	{
+	private:
+		std::vector<byte> data;
+		std::size_t position = 0;
+
+	public:
+		// start a new snapshot
+		void Clear()
+		{
+			data.clear();
+			position = 0;
+		}
+
+		// start reading the snapshot from the beginning
+		void Rewind()
+		{
+			position = 0;
+		}
+
+		void Write(const void *src, std::size_t size)
+		{
+			std::size_t end = data.size();
+			data.resize(end + size);
+			memcpy(data.data() + end, src, size);
+		}
+
+		void Read(void *dst, std::size_t size)
+		{
+			if (position + size > data.size())
+				throw std::runtime_error("state ends early");
+
+			memcpy(dst, data.data() + position, size);
+			position += size;
+		}
+
+		template <typename T>
+		void Write(const T &value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+			Write(&value, sizeof(T));
+		}
+
+		template <typename T>
+		void Read(T &value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read");
+			Read(&value, sizeof(T));
+		}
+
+		std::size_t Size() const
+		{
+			return data.size();
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "tile_cache.hpp"
+
+
+namespace dromaiusgb
+{
+
+	TileCache::TileCache()
+	{
+		InvalidateAll();
+	}
+
+	void TileCache::Invalidate(const tile_set_t &tiles_written)
+	{
+		dirty |= tiles_written;
+	}
+
+	void TileCache::InvalidateAll()
+	{
+		dirty.set();
+	}
+
+	void TileCache::Update(const byte *vram)
+	{
+		if (dirty.none())
+			return;
+
+		for (word index = 0; index < tile_count; index++) {
+			if (dirty[index])
+				Decode(vram, index);
+		}
+
+		dirty.reset();
+	}
+
+	// each row is two bytes, the low bits of the eight pixels then the high bits, leftmost pixel first
+	void TileCache::Decode(const byte *vram, word index)
+	{
+		const byte *data = vram + index * 16;
+		decoded_tile_t &tile = tiles[index];
+
+		for (unsigned int y = 0; y < 8; y++) {
+			byte low = data[y * 2];
+			byte high = data[y * 2 + 1];
+
+			tile.opaque[y] = 0;
+			tile.flipped_opaque[y] = low | high;
+
+			for (unsigned int x = 0; x < 8; x++) {
+				byte color = ((low >> (7 - x)) & 0x01) | (((high >> (7 - x)) & 0x01) << 1);
+				tile.rows[y][x] = color;
+				tile.flipped_rows[y][7 - x] = color;
+				tile.opaque[y] |= (color != 0) << x;
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+
+#include "types.hpp"
+
+
+namespace dromaiusgb
+{
+
+	// the colour indices (0-3) of one tile, row by row, and mirrored left to right for sprites. opaque
+	// has a bit for every pixel of a row that isn't colour 0, the leftmost in bit 0
+	struct decoded_tile_t
+	{
+		byte rows[8][8];
+		byte flipped_rows[8][8];
+		byte opaque[8];
+		byte flipped_opaque[8];
+	};
+
+	// every tile in vram decoded ahead of drawing. tiles 0-255 are at 0x8000, 256-383 at 0x9000, so
+	// the bg's signed tile numbers map to 256 + n. a tile is only decoded again once it was written to
+	class TileCache
+	{
+	public:
+		static const word tile_count = 384;
+
+		typedef std::bitset<tile_count> tile_set_t;
+
+	private:
+		std::array<decoded_tile_t, tile_count> tiles;
+		tile_set_t dirty;
+
+	private:
+		void Decode(const byte *, word);
+
+	public:
+		TileCache();
+
+		void Invalidate(const tile_set_t &);
+		void InvalidateAll();
+
+		// decodes the tiles written to since, from vram starting at 0x8000
+		void Update(const byte *);
+
+		const decoded_tile_t &Get(word index) const
+		{
+			return tiles[index];
+		}
+	};
+}
\ No newline at end of file
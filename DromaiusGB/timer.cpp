@@ -2,18 +2,22 @@
 #include "bus.hpp"
 #include "interrupts.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 namespace dromaiusgb
 {
-	Timer::Timer(Bus &bus, InterruptController &ic) : Addressable(bus), interrupt_controller(ic), div_cycle(0), tima_cycle(0),
-		div(0), tima(0), tma(0)
+	Timer::Timer(Bus &bus, Scheduler &scheduler, InterruptController &ic) : Addressable(bus), interrupt_controller(ic), scheduler(scheduler),
+		div_cycle(0), tima_cycle(0), last_update(0), div(0), tima(0), tma(0)
 	{
-
+		scheduler.Register(Event::Timer, this);
+		Reschedule();
 	}
 
 	void Timer::Set(bus_address_t addr, byte val)
 	{
+		Update();
+
 		switch (addr.address)
 		{
 		case 0xFF04: div = val; break;
@@ -21,25 +25,63 @@ namespace dromaiusgb
 		case 0xFF06: tma = val; break;
 		case 0xFF07: tac = val; break;
 		}
+
+		Reschedule();
+	}
+
+	void Timer::SaveState(State &state) const
+	{
+		state.Write(div_cycle);
+		state.Write(tima_cycle);
+		state.Write(last_update);
+		state.Write(div);
+		state.Write(tima);
+		state.Write(tma);
+		state.Write(tac);
+	}
+
+	void Timer::LoadState(State &state)
+	{
+		state.Read(div_cycle);
+		state.Read(tima_cycle);
+		state.Read(last_update);
+		state.Read(div);
+		state.Read(tima);
+		state.Read(tma);
+		state.Read(tac);
 	}
 
 	byte Timer::Get(bus_address_t addr) const
 	{
+		// div and tima count up between events, work out how far they have got since the last update.
+		// tima can't have overflowed, that is an event
+		dword elapsed = dword(scheduler.Now() - last_update);
+
 		switch (addr.address)
 		{
-		case 0xFF04: return div;
-		case 0xFF05: return tima;
+		case 0xFF04: return div + (div_cycle + elapsed) / cycles_per_div_tick;
+		case 0xFF05: return tac.timer_enabled ? tima + (tima_cycle + elapsed) / GetCyclesPerTimaTick() : tima;
 		case 0xFF06: return tma;
 		case 0xFF07: return tac;
 		default: return 0xFF;
 		}
 	}
 
+	dword Timer::GetCyclesPerTimaTick() const
+	{
+		switch (tac.clock_select) {
+		case 0: default: return cycles_per_tima_tick_0;
+		case 1: return cycles_per_tima_tick_1;
+		case 2: return cycles_per_tima_tick_2;
+		case 3: return cycles_per_tima_tick_3;
+		};
+	}
+
 	void Timer::Tick(dword delta_cycle)
 	{
 		div_cycle += delta_cycle;
 
-		if (div_cycle >= cycles_per_div_tick) {
+		while (div_cycle >= cycles_per_div_tick) {
 			div_cycle -= cycles_per_div_tick;
 			div += 1;
 		}
@@ -47,14 +89,7 @@ namespace dromaiusgb
 		if (tac.timer_enabled) {
 			tima_cycle += delta_cycle;
 
-			dword cycles_per_tima_tick = 0;
-			switch (tac.clock_select) {
-			case 0: cycles_per_tima_tick = cycles_per_tima_tick_0; break;
-			case 1: cycles_per_tima_tick = cycles_per_tima_tick_1; break;
-			case 2: cycles_per_tima_tick = cycles_per_tima_tick_2; break;
-			case 3: cycles_per_tima_tick = cycles_per_tima_tick_3; break;
-			};
-
+			dword cycles_per_tima_tick = GetCyclesPerTimaTick();
 			while (tima_cycle >= cycles_per_tima_tick) {
 				tima_cycle -= cycles_per_tima_tick;
 				tima += 1;
@@ -67,4 +102,34 @@ namespace dromaiusgb
 			}
 		}
 	}
+
+	void Timer::Update()
+	{
+		cycle_t now = scheduler.Now();
+		Tick(dword(now - last_update));
+		last_update = now;
+	}
+
+	// the next tima overflow, or the next time div wraps so that catching up never spans too many cycles
+	void Timer::Reschedule()
+	{
+		cycle_t next = last_update + (0x100 - div) * cycles_per_div_tick - div_cycle;
+
+		if (tac.timer_enabled) {
+			int64_t cycles_per_tima_tick = GetCyclesPerTimaTick();
+			int64_t until_overflow = (0x100 - tima) * cycles_per_tima_tick - tima_cycle;
+			cycle_t overflow = last_update + std::max<int64_t>(until_overflow, 0);
+
+			if (overflow < next)
+				next = overflow;
+		}
+
+		scheduler.Schedule(Event::Timer, next);
+	}
+
+	void Timer::CatchUp()
+	{
+		Update();
+		Reschedule();
+	}
 }
\ No newline at end of file
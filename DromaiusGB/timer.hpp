@@ -3,6 +3,8 @@
 #include "types.hpp"
 #include "addressable.hpp"
 #include "interrupts.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
 
 
 namespace dromaiusgb
@@ -23,7 +25,7 @@ namespace dromaiusgb
 		operator byte() const { return value; }
 	};
 
-	class Timer : public Addressable
+	class Timer : public Addressable, public Scheduled
 	{
 	private:
 		const dword cycles_per_div_tick = 256;
@@ -34,21 +36,35 @@ namespace dromaiusgb
 
 	private:
 		InterruptController &interrupt_controller;
+		Scheduler &scheduler;
 		dword div_cycle;
 		dword tima_cycle;
 
+		// the scheduler cycle div_cycle and tima_cycle were last brought up to
+		cycle_t last_update;
+
 	private:
 		byte div;
 		byte tima;
 		byte tma;
 		timer_control_t tac;
 
+	private:
+		dword GetCyclesPerTimaTick() const;
+		void Tick(dword delta_cycle);
+		void Update();
+		void Reschedule();
+
 	public:
-		Timer(Bus &, InterruptController &);
+		Timer(Bus &, Scheduler &, InterruptController &);
 
 		void Set(bus_address_t, byte);
 		byte Get(bus_address_t) const;
 
-		void Tick(dword delta_cycle);
+		// the timer's event is part of the scheduler's state
+		void SaveState(State &) const;
+		void LoadState(State &);
+
+		void CatchUp();
 	};
 }
\ No newline at end of file
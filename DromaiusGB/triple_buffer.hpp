@@ -0,0 +1,65 @@
+#pragma once
+
+#include "types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+
+namespace dromaiusgb
+{
+
+	// hands whole buffers from one producer thread to one consumer thread without locks. the producer
+	// fills the back buffer and publishes it by swapping it with the middle one, the consumer takes the
+	// middle one by swapping it with its front buffer. neither side ever waits, and the consumer only
+	// ever sees complete buffers, skipping any it was too slow for
+	template <typename T, std::size_t Size>
+	class TripleBuffer
+	{
+	private:
+		// marks the middle buffer as published since the consumer last took it
+		static const byte fresh = 0x04;
+
+		std::unique_ptr<T[]> buffers[3];
+
+		// only the producer touches back, only the consumer front
+		alignas(64) byte back = 0;
+		alignas(64) std::atomic<byte> middle;
+		alignas(64) byte front = 2;
+
+	public:
+		TripleBuffer(T value) : middle(1)
+		{
+			for (auto &buffer : buffers) {
+				buffer.reset(new T[Size]);
+				std::fill(buffer.get(), buffer.get() + Size, value);
+			}
+		}
+
+		T *GetBack()
+		{
+			return buffers[back].get();
+		}
+
+		void Publish()
+		{
+			back = middle.exchange(back | fresh, std::memory_order_acq_rel) & ~fresh;
+		}
+
+		// takes the newest published buffer, if there is one the consumer hasn't seen yet
+		bool Update()
+		{
+			if (!(middle.load(std::memory_order_relaxed) & fresh))
+				return false;
+
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~fresh;
+			return true;
+		}
+
+		const T *GetFront() const
+		{
+			return buffers[front].get();
+		}
+	};
+}
\ No newline at end of file
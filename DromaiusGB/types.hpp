@@ -10,7 +10,10 @@ namespace dromaiusgb
 
 	typedef int8_t sbyte;
 
+	typedef byte opcode_t;
+
 	typedef uint16_t address_t;
+	typedef uint64_t cycle_t;
 
 	struct bus_address_t
 	{
@@ -0,0 +1,106 @@
+#include "test_rom.hpp"
+
+
+// code that changes under blocks already decoded from it: routines in wram written over, one writing
+// the instruction after its own store, and rom banks switched under code cached from another bank,
+// once between calls and once by the block itself
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+// 0xFF80 on, in the order the rom stores them
+static const byte expected[] = { 0x01, 0x01, 0x02, 0x00, 0x01, 0x05, 0x11, 0x11, 0x22, 0x11, 0x25, 0x25 };
+
+static TestROM MakeROM()
+{
+	TestROM rom(4);
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, 0xFFFE);                     // ld sp,0xFFFE
+
+	// ld a,1; ret at 0xC000, called before and after its operand is written over
+	rom.Emit(0x21, 0xC000);                     // ld hl,0xC000
+	rom.Emit({ 0x36, 0x3E, 0x23 });             // ld (hl),0x3E; inc hl
+	rom.Emit({ 0x36, 0x01, 0x23 });             // ld (hl),0x01; inc hl
+	rom.Emit({ 0x36, 0xC9 });                   // ld (hl),0xC9
+	rom.Emit(0xCD, 0xC000);                     // call 0xC000
+	rom.Emit({ 0xE0, 0x80 });                   // ldh (0x80),a
+	rom.Emit(0xCD, 0xC000);                     // call 0xC000
+	rom.Emit({ 0xE0, 0x81 });                   // ldh (0x81),a
+	rom.Emit({ 0x3E, 0x02 });                   // ld a,2
+	rom.Emit(0xEA, 0xC001);                     // ld (0xC001),a
+	rom.Emit(0xCD, 0xC000);                     // call 0xC000
+	rom.Emit({ 0xE0, 0x82 });                   // ldh (0x82),a
+
+	// ld (hl),b; nop; ret at 0xC010, with hl pointing at the nop
+	rom.Emit(0x21, 0xC010);                     // ld hl,0xC010
+	rom.Emit({ 0x36, 0x70, 0x23 });             // ld (hl),0x70; inc hl
+	rom.Emit({ 0x36, 0x00, 0x23 });             // ld (hl),0x00; inc hl
+	rom.Emit({ 0x36, 0xC9 });                   // ld (hl),0xC9
+	rom.Emit(0x21, 0xC011);                     // ld hl,0xC011
+	rom.Emit({ 0x06, 0x00, 0xAF });             // ld b,0 (nop); xor a
+	rom.Emit(0xCD, 0xC010);                     // call 0xC010
+	rom.Emit({ 0xE0, 0x83 });                   // ldh (0x83),a
+	rom.Emit({ 0x06, 0x3C });                   // ld b,0x3C (inc a)
+	rom.Emit(0xCD, 0xC010);                     // call 0xC010
+	rom.Emit({ 0xE0, 0x84 });                   // ldh (0x84),a
+
+	// through the echo of wram
+	rom.Emit({ 0x3E, 0x05 });                   // ld a,5
+	rom.Emit(0xEA, 0xE001);                     // ld (0xE001),a
+	rom.Emit(0xCD, 0xC000);                     // call 0xC000
+	rom.Emit({ 0xE0, 0x85 });                   // ldh (0x85),a
+
+	// the same call in to banks 1, 1, 2 and 1
+	const byte banks[] = { 1, 1, 2, 1 };
+	for (byte i = 0; i < 4; i++) {
+		rom.Emit({ 0x3E, banks[i] });           // ld a,bank
+		rom.Emit(0xEA, 0x2000);                 // ld (0x2000),a
+		rom.Emit(0xCD, 0x4000);                 // call 0x4000
+		rom.Emit({ 0xE0, byte(0x86 + i) });     // ldh (0x86 + i),a
+	}
+
+	// bank 3 switching to bank 2 half way through its block, twice
+	for (byte i = 0; i < 2; i++) {
+		rom.Emit({ 0x3E, 0x03 });               // ld a,3
+		rom.Emit(0xEA, 0x2000);                 // ld (0x2000),a
+		rom.Emit(0xCD, 0x4000);                 // call 0x4000
+		rom.Emit({ 0xE0, byte(0x8A + i) });     // ldh (0x8A + i),a
+	}
+
+	rom.JR(0x18, rom.Here());                   // jr $
+
+	rom.Org(0x4000, 1);
+	rom.Emit({ 0x3E, 0x11, 0xC9 });             // ld a,0x11; ret
+
+	rom.Org(0x4000, 2);
+	rom.Emit({ 0x3E, 0x22, 0xC9 });             // ld a,0x22; ret
+	rom.Org(0x4005, 2);
+	rom.Emit({ 0x3E, 0x25, 0xC9 });             // ld a,0x25; ret
+
+	rom.Org(0x4000, 3);
+	rom.Emit({ 0x3E, 0x02 });                   // ld a,2
+	rom.Emit(0xEA, 0x2000);                     // ld (0x2000),a
+	rom.Emit({ 0x3E, 0x33, 0xC9 });             // ld a,0x33; ret
+
+	return rom;
+}
+
+int main()
+{
+	TestROM rom = MakeROM();
+
+	for (bool threaded : Interpreters()) {
+		std::cout << InterpreterName(threaded) << std::endl;
+
+		auto gameboy = PowerOn(rom, "block_cache_test", threaded);
+		gameboy->RunCycles(20000);
+
+		for (byte i = 0; i < sizeof(expected); i++) {
+			if (!CHECK_EQUAL(gameboy->GetBus().Get(0xFF80 + i), expected[i]))
+				std::cerr << "  at 0x" << std::hex << 0xFF80 + i << std::dec << std::endl;
+		}
+	}
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
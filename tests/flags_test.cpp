@@ -0,0 +1,296 @@
+#include "test_rom.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+// the same code on a cpu that works out F after every instruction and on one that waits until F is read,
+// built twice from this file. the eager one saves what it did and the lazy one has to do the same:
+//   flags_test --save <file>      every register after every instruction, then the log of a whole run
+//   flags_test --compare <file>
+// stepping works F out after every instruction, so the run without steps, whose push af's log flags
+// still pending when the next instruction reads them, is what checks the lazy reads in between. the
+// snapshot at the end of that run has to match byte for byte too
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+// operands for every operation, with the half carry, sign and bcd edges in between
+static const byte values[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0x99, 0x9A, 0xF0, 0xFF };
+static const word table = 0x3F00;
+
+// the log grows down from the top of wram, one push af at a time
+static const word log_start = 0xC000;
+static const word log_end = 0xE000;
+
+static void EmitCarry(TestROM &rom, bool carry)
+{
+	if (carry)
+		rom.Emit({ 0x37 });                     // scf
+	else
+		rom.Emit({ 0x37, 0x3F });               // scf; ccf
+}
+
+// inc and dec of D, with the carry they have to leave alone set and clear. hl points at 0xFF90
+static void EmitIncDec(TestROM &rom)
+{
+	for (bool carry : { true, false }) {
+		for (byte op : { 0x3C, 0x3D }) {
+			rom.Emit({ 0x7A });                 // ld a,d
+			EmitCarry(rom, carry);
+			rom.Emit({ op, 0xF5 });             // inc/dec a; push af
+		}
+
+		// the carry, kept in bit 8 of a pending inc or dec, read by adc
+		rom.Emit({ 0x7A });                     // ld a,d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0x3C, 0xCE, 0x00, 0xF5 });   // inc a; adc a,0; push af
+		rom.Emit({ 0x7A });                     // ld a,d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0x3D, 0x28, 0x02 });         // dec a; jr z,+2
+		rom.Emit({ 0xCE, 0x00, 0xF5 });         // adc a,0; push af
+
+		rom.Emit({ 0x42 });                     // ld b,d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0x04, 0x05, 0x05 });         // inc b; dec b; dec b
+		rom.Emit({ 0xF5, 0xC5 });               // push af; push bc
+
+		rom.Emit({ 0x72 });                     // ld (hl),d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0x34, 0xF5, 0x35, 0x35 });   // inc (hl); push af; dec (hl); dec (hl)
+		rom.Emit({ 0xF5 });                     // push af
+
+		// the carry of an alu operation still pending when inc or dec takes it over
+		rom.Emit({ 0x7A });                     // ld a,d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0x82, 0x3C, 0xF5 });         // add a,d; inc a; push af
+		rom.Emit({ 0x7A });                     // ld a,d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0xD6, 0x81, 0x3D });         // sub 0x81; dec a
+		rom.Emit({ 0xCE, 0x00, 0xF5 });         // adc a,0; push af
+	}
+}
+
+// every alu operation, add hl, daa and pop af on D and E
+static void EmitPair(TestROM &rom)
+{
+	for (byte op = 0; op < 8; op++) {
+		// the carry in only matters to adc and sbc
+		for (bool carry : { true, false }) {
+			if (!carry && op != 1 && op != 3)
+				continue;
+
+			rom.Emit({ 0x7A });                 // ld a,d
+			EmitCarry(rom, carry);
+			rom.Emit({ byte(0x83 | op << 3), 0xF5 }); // op a,e; push af
+		}
+
+		// zf and cy read while the operation is pending
+		rom.Emit({ 0x7A, 0x37 });               // ld a,d; scf
+		rom.Emit({ byte(0x83 | op << 3) });     // op a,e
+		rom.Emit({ 0x28, 0x02, 0xCE, 0x00 });   // jr z,+2; adc a,0
+		rom.Emit({ 0xF5 });                     // push af
+	}
+
+	for (bool carry : { true, false }) {
+		rom.Emit({ 0x62, 0x6B, 0x43, 0x4A });   // ld h,d; ld l,e; ld b,e; ld c,d
+		EmitCarry(rom, carry);
+		rom.Emit({ 0x09, 0xF5, 0xE5 });         // add hl,bc; push af; push hl
+	}
+
+	// add hl keeps the zf of a cp still pending
+	rom.Emit({ 0x62, 0x6B, 0x43, 0x4A });       // ld h,d; ld l,e; ld b,e; ld c,d
+	rom.Emit({ 0x7A, 0xBB, 0x09 });             // ld a,d; cp e; add hl,bc
+	rom.Emit({ 0x20, 0x02, 0xCE, 0x00 });       // jr nz,+2; adc a,0
+	rom.Emit({ 0xF5 });                         // push af
+	rom.Emit(0x21, 0xFF90);                     // ld hl,0xFF90
+
+	rom.Emit({ 0x7A, 0x83, 0x27, 0xF5 });       // ld a,d; add a,e; daa; push af
+	rom.Emit({ 0x7A, 0x93, 0x27, 0xF5 });       // ld a,d; sub e; daa; push af
+	rom.Emit({ 0x7A, 0x37, 0x8B, 0x27 });       // ld a,d; scf; adc a,e; daa
+	rom.Emit({ 0xCE, 0x00, 0xF5 });             // adc a,0; push af
+
+	// F as popped, over an operation still pending
+	rom.Emit({ 0xD5, 0xF1, 0xF5 });             // push de; pop af; push af
+	rom.Emit({ 0xD5, 0xF1, 0x27, 0xF5 });       // push de; pop af; daa; push af
+	rom.Emit({ 0xD5, 0xF1, 0x3C, 0xF5 });       // push de; pop af; inc a; push af
+	rom.Emit({ 0x7A, 0x83, 0xD5, 0xF1 });       // ld a,d; add a,e; push de; pop af
+	rom.Emit({ 0x8A, 0xF5 });                   // adc a,d; push af
+}
+
+// runs EmitIncDec for every value in D, and EmitPair for every pair of them in D and E
+static TestROM MakeROM(word &done)
+{
+	TestROM rom;
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, log_end);                    // ld sp,log_end
+	rom.Emit({ 0xAF, 0xE0, 0x80 });             // xor a; ldh (0x80),a
+
+	word outer = rom.Here();
+	rom.Emit({ 0xF0, 0x80, 0x6F });             // ldh a,(0x80); ld l,a
+	rom.Emit({ 0x26, byte(table >> 8), 0x56 }); // ld h,table; ld d,(hl)
+	rom.Emit(0x21, 0xFF90);                     // ld hl,0xFF90
+	EmitIncDec(rom);
+	rom.Emit({ 0xAF, 0xE0, 0x81 });             // xor a; ldh (0x81),a
+
+	word inner = rom.Here();
+	rom.Emit({ 0xF0, 0x81, 0x6F });             // ldh a,(0x81); ld l,a
+	rom.Emit({ 0x26, byte(table >> 8), 0x5E }); // ld h,table; ld e,(hl)
+	rom.Emit(0x21, 0xFF90);                     // ld hl,0xFF90
+	EmitPair(rom);
+
+	rom.Emit({ 0xF0, 0x81, 0x3C, 0xE0, 0x81 }); // ldh a,(0x81); inc a; ldh (0x81),a
+	rom.Emit({ 0xFE, byte(sizeof(values)) });   // cp count
+	rom.Emit(0xC2, inner);                      // jp nz,inner
+	rom.Emit({ 0xF0, 0x80, 0x3C, 0xE0, 0x80 }); // ldh a,(0x80); inc a; ldh (0x80),a
+	rom.Emit({ 0xFE, byte(sizeof(values)) });   // cp count
+	rom.Emit(0xC2, outer);                      // jp nz,outer
+
+	done = rom.Here();
+	rom.JR(0x18, done);                         // jr $
+
+	rom.Org(table);
+	for (byte value : values)
+		rom.Emit({ value });
+
+	return rom;
+}
+
+// what one interpreter did with the rom
+struct run_t
+{
+	std::vector<registers_t> steps;
+	std::vector<byte> log;
+	registers_t end;
+	std::vector<byte> snapshot;
+};
+
+static run_t Run(const TestROM &rom, word done, bool threaded)
+{
+	const std::size_t max_steps = 1000000;
+	run_t run;
+
+	auto stepped = PowerOn(rom, "flags_test", threaded);
+	while (run.steps.size() < max_steps && (run.steps.empty() || run.steps.back().PC != done)) {
+		stepped->RunCycles(1);
+		run.steps.push_back(GetRegisters(stepped->GetCPU()));
+	}
+
+	auto whole = PowerOn(rom, "flags_test", threaded);
+	whole->RunCycles(cycle_t(run.steps.size()) * 24);
+
+	for (dword address = log_start; address < log_end; address++)
+		run.log.push_back(whole->GetBus().Get(address));
+	run.end = GetRegisters(whole->GetCPU());
+	run.snapshot = Snapshot(*whole);
+
+	CHECK_EQUAL(run.end.PC, done);
+	CHECK(run.end.SP >= log_start);
+	return run;
+}
+
+template <typename T>
+static void Write(std::ofstream &output, const std::vector<T> &items)
+{
+	std::size_t size = items.size();
+	output.write((const char *)&size, sizeof(size));
+	output.write((const char *)items.data(), size * sizeof(T));
+}
+
+template <typename T>
+static bool Read(std::ifstream &input, std::vector<T> &items)
+{
+	std::size_t size = 0;
+	if (!input.read((char *)&size, sizeof(size)) || size > 0x1000000)
+		return false;
+
+	items.resize(size);
+	return bool(input.read((char *)items.data(), size * sizeof(T)));
+}
+
+static void Compare(const run_t &run, const run_t &saved)
+{
+	std::size_t steps = std::min(run.steps.size(), saved.steps.size());
+	CHECK_EQUAL(run.steps.size(), saved.steps.size());
+
+	for (std::size_t i = 0; i < steps; i++) {
+		const registers_t &actual = run.steps[i];
+		const registers_t &expected = saved.steps[i];
+
+		if (!(actual == expected)) {
+			word pc = i ? saved.steps[i - 1].PC : 0;
+			CHECK_EQUAL(actual.AF, expected.AF);
+			CHECK(actual == expected);
+			std::cerr << "  after the instruction at 0x" << std::hex << pc << std::dec << ", step " << i << std::endl;
+			break;
+		}
+	}
+
+	for (std::size_t i = 0; i < run.log.size() && i < saved.log.size(); i++) {
+		if (!CHECK_EQUAL(run.log[i], saved.log[i])) {
+			std::cerr << "  at 0x" << std::hex << log_start + i << std::dec << " of the log" << std::endl;
+			break;
+		}
+	}
+
+	CHECK(run.end == saved.end);
+
+	// the whole machine, which saves F as it reads whether or not its flags are pending
+	CHECK_EQUAL(run.snapshot.size(), saved.snapshot.size());
+	CHECK(run.snapshot == saved.snapshot);
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc != 3 || (strcmp(argv[1], "--save") && strcmp(argv[1], "--compare"))) {
+		std::cerr << "usage: " << argv[0] << " --save|--compare <file>" << std::endl;
+		return -1;
+	}
+
+	bool save = !strcmp(argv[1], "--save");
+	word done;
+	TestROM rom = MakeROM(done);
+
+#ifdef DROMAIUSGB_LAZY_FLAGS
+	std::cout << "lazy flags" << std::endl;
+#else
+	std::cout << "eager flags" << std::endl;
+#endif
+
+	std::ofstream output;
+	std::ifstream input;
+
+	if (save)
+		output.open(argv[2], std::ios::binary);
+	else
+		input.open(argv[2], std::ios::binary);
+
+	if (!output.is_open() && !input.is_open()) {
+		std::cerr << "can't open " << argv[2] << std::endl;
+		return -1;
+	}
+
+	for (bool threaded : Interpreters()) {
+		run_t run = Run(rom, done, threaded);
+		std::cout << std::dec << InterpreterName(threaded) << ": " << run.steps.size() << " instructions" << std::endl;
+
+		if (save) {
+			Write(output, run.steps);
+			Write(output, run.log);
+			output.write((const char *)&run.end, sizeof(run.end));
+			Write(output, run.snapshot);
+			continue;
+		}
+
+		run_t saved;
+		if (!Read(input, saved.steps) || !Read(input, saved.log) || !input.read((char *)&saved.end, sizeof(saved.end)) || !Read(input, saved.snapshot)) {
+			CHECK(!"the saved file ends early");
+			break;
+		}
+
+		Compare(run, saved);
+	}
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
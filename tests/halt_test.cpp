@@ -0,0 +1,124 @@
+#include "test_rom.hpp"
+
+
+// halt with interrupts disabled and one already pending (the halt bug), with interrupts disabled until
+// one comes in, and with interrupts enabled until vblank. in between, writes to IF and IE that have to
+// dispatch straight away. run in one go and in runs of a few cycles each
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+static const word results = 0xFF80;
+static const byte result_count = 8;
+
+static TestROM MakeROM(word &done)
+{
+	TestROM rom;
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, 0xFFFE);                     // ld sp,0xFFFE
+	rom.Emit({ 0x3E, 0x91, 0xE0, 0x40 });       // ld a,0x91; ldh (0x40),a
+
+	// halt with ime off and the timer already in IE and IF doesn't halt, and reads the inc twice
+	rom.Emit({ 0x3E, 0x04, 0xE0, 0xFF });       // ld a,4; ldh (0xFF),a
+	rom.Emit({ 0xE0, 0x0F });                   // ldh (0x0F),a
+	rom.Emit({ 0xAF, 0x76, 0x3C, 0xE0, 0x80 }); // xor a; halt; inc a; ldh (0x80),a
+	rom.Emit({ 0xF0, 0x90, 0xE0, 0x81 });       // ldh a,(0x90); ldh (0x81),a
+
+	// halt with ime off until tima overflows, which wakes the cpu without dispatching
+	rom.Emit({ 0xAF, 0xE0, 0x0F, 0xE0, 0x06 }); // xor a; ldh (0x0F),a; ldh (0x06),a
+	rom.Emit({ 0x3E, 0xF0, 0xE0, 0x05 });       // ld a,0xF0; ldh (0x05),a
+	rom.Emit({ 0x3E, 0x05, 0xE0, 0x07 });       // ld a,5; ldh (0x07),a
+	rom.Emit({ 0x76, 0x00 });                   // halt; nop
+	rom.Emit({ 0xF0, 0x0F, 0xE6, 0x04 });       // ldh a,(0x0F); and 4
+	rom.Emit({ 0xE0, 0x82 });                   // ldh (0x82),a
+	rom.Emit({ 0xF0, 0x90, 0xE0, 0x83 });       // ldh a,(0x90); ldh (0x83),a
+	rom.Emit({ 0xF0, 0x05, 0xE0, 0x84 });       // ldh a,(0x05); ldh (0x84),a
+	rom.Emit({ 0xAF, 0xE0, 0x07 });             // xor a; ldh (0x07),a
+
+	// IF written with ime on
+	rom.Emit({ 0xAF, 0xE0, 0x0F, 0xFB });       // xor a; ldh (0x0F),a; ei
+	rom.Emit({ 0x3E, 0x04, 0xE0, 0x0F });       // ld a,4; ldh (0x0F),a
+	rom.Emit({ 0x00, 0xF3 });                   // nop; di
+	rom.Emit({ 0xF0, 0x90, 0xE0, 0x85 });       // ldh a,(0x90); ldh (0x85),a
+
+	// IE written with the timer already in IF
+	rom.Emit({ 0xAF, 0xE0, 0xFF });             // xor a; ldh (0xFF),a
+	rom.Emit({ 0x3E, 0x04, 0xE0, 0x0F });       // ld a,4; ldh (0x0F),a
+	rom.Emit({ 0xFB, 0x00, 0x00 });             // ei; nop; nop
+	rom.Emit({ 0xF0, 0x90, 0xE0, 0x86 });       // ldh a,(0x90); ldh (0x86),a
+	rom.Emit({ 0x3E, 0x04, 0xE0, 0xFF });       // ld a,4; ldh (0xFF),a
+	rom.Emit({ 0x00, 0xF3 });                   // nop; di
+	rom.Emit({ 0xF0, 0x90, 0xE0, 0x87 });       // ldh a,(0x90); ldh (0x87),a
+
+	// halt with ime on until vblank
+	rom.Emit({ 0x3E, 0x01, 0xE0, 0xFF });       // ld a,1; ldh (0xFF),a
+	rom.Emit({ 0xAF, 0xE0, 0x0F });             // xor a; ldh (0x0F),a
+	rom.Emit({ 0xFB, 0x76, 0x00, 0xF3 });       // ei; halt; nop; di
+
+	done = rom.Here();
+	rom.JR(0x18, done);                         // jr $
+
+	// vblank keeps the line and mode it was dispatched in
+	rom.Org(0x40);
+	rom.Emit(0xC3, 0x0070);                     // jp 0x0070
+	rom.Org(0x70);
+	rom.Emit({ 0xF5, 0xF0, 0x44, 0xE0, 0x91 }); // push af; ldh a,(0x44); ldh (0x91),a
+	rom.Emit({ 0xF0, 0x41, 0xE6, 0x03 });       // ldh a,(0x41); and 3
+	rom.Emit({ 0xE0, 0x92, 0xF1, 0xD9 });       // ldh (0x92),a; pop af; reti
+
+	// the timer counts its interrupts
+	rom.Org(0x50);
+	rom.Emit({ 0xF5, 0xF0, 0x90, 0x3C });       // push af; ldh a,(0x90); inc a
+	rom.Emit({ 0xE0, 0x90, 0xF1, 0xD9 });       // ldh (0x90),a; pop af; reti
+
+	return rom;
+}
+
+static std::vector<byte> Results(GameBoy &gameboy)
+{
+	std::vector<byte> read;
+	for (byte i = 0; i < result_count; i++)
+		read.push_back(gameboy.GetBus().Get(results + i));
+	for (word address = 0xFF90; address <= 0xFF92; address++)
+		read.push_back(gameboy.GetBus().Get(address));
+	return read;
+}
+
+static void CheckResults(const std::vector<byte> &r)
+{
+	CHECK_EQUAL(r[0], 2);
+	CHECK_EQUAL(r[1], 0);
+	CHECK_EQUAL(r[2], 0x04);
+	CHECK_EQUAL(r[3], 0);
+	// tima went back to tma, 0, when it woke the cpu and can't have got far since
+	CHECK(r[4] < 8);
+	CHECK_EQUAL(r[5], 1);
+	CHECK_EQUAL(r[6], 1);
+	CHECK_EQUAL(r[7], 2);
+	CHECK_EQUAL(r[9], 144);
+	CHECK_EQUAL(r[10], 1);
+}
+
+int main()
+{
+	word done;
+	TestROM rom = MakeROM(done);
+
+	for (bool threaded : Interpreters()) {
+		std::cout << InterpreterName(threaded) << std::endl;
+
+		auto whole = PowerOn(rom, "halt_test", threaded);
+		whole->RunCycles(100000);
+		CHECK_EQUAL(GetRegisters(whole->GetCPU()).PC, done);
+		CheckResults(Results(*whole));
+
+		Random random(11);
+		auto sliced = PowerOn(rom, "halt_test", threaded);
+		RunInSlices(*sliced, 100000, random);
+		CHECK_EQUAL(GetRegisters(sliced->GetCPU()).PC, done);
+		CHECK(Results(*sliced) == Results(*whole));
+	}
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
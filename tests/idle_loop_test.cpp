@@ -0,0 +1,135 @@
+#include "test_rom.hpp"
+
+
+// loops that poll ly, a flag set by the vblank handler, div, tima and the joypad, each followed by a
+// note of div, tima and ly as the loop was left. skipping idle loops may only save time: with it on,
+// the machine has to end up as it does with it off, with cycles skipped in the loops
+// that only wait on the lcd, and none in the ones that poll the timer or the joypad
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+static const word results = 0xFF80;
+static const byte result_count = 15;
+static const word record = 0x3000;
+static const cycle_t cycles = 300000;
+
+// the button goes down a few frames in
+static const cycle_t press = 250000;
+
+static TestROM MakeROM(word &done)
+{
+	TestROM rom;
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, 0xFFFE);                     // ld sp,0xFFFE
+	rom.Emit({ 0x3E, 0x91, 0xE0, 0x40 });       // ld a,0x91; ldh (0x40),a
+	rom.Emit({ 0x3E, 0x05, 0xE0, 0x07 });       // ld a,5; ldh (0x07),a
+
+	// ly up to 0x90
+	word loop = rom.Here();
+	rom.Emit({ 0xF0, 0x44, 0xFE, 0x90 });       // ldh a,(0x44); cp 0x90
+	rom.JR(0x20, loop);                         // jr nz,loop
+	rom.Emit({ 0x0E, 0x80 });                   // ld c,0x80
+	rom.Emit(0xCD, record);                     // call record
+
+	// a flag in wram, set in vblank
+	rom.Emit({ 0xAF, 0xEA, 0x00, 0xC0 });       // xor a; ld (0xC000),a
+	rom.Emit({ 0xE0, 0x0F, 0x3C, 0xE0, 0xFF }); // ldh (0x0F),a; inc a; ldh (0xFF),a
+	rom.Emit({ 0xFB });                         // ei
+	loop = rom.Here();
+	rom.Emit({ 0xFA, 0x00, 0xC0, 0xA7 });       // ld a,(0xC000); and a
+	rom.JR(0x28, loop);                         // jr z,loop
+	rom.Emit({ 0xF3, 0x0E, 0x83 });             // di; ld c,0x83
+	rom.Emit(0xCD, record);                     // call record
+
+	// still in vblank, so the lcd can go off. from here on only the timer and the joypad have events
+	// coming up, and a pass skipped that shouldn't have been runs on to the next one of those
+	rom.Emit({ 0xAF, 0xE0, 0x40 });             // xor a; ldh (0x40),a
+
+	// 0x20 div ticks on
+	rom.Emit({ 0xF0, 0x04, 0x47 });             // ldh a,(0x04); ld b,a
+	loop = rom.Here();
+	rom.Emit({ 0xF0, 0x04, 0x90, 0xFE, 0x20 }); // ldh a,(0x04); sub b; cp 0x20
+	rom.JR(0x38, loop);                         // jr c,loop
+	rom.Emit({ 0x0E, 0x86 });                   // ld c,0x86
+	rom.Emit(0xCD, record);                     // call record
+
+	// 0x40 tima ticks on, which a pass takes more than one of
+	rom.Emit({ 0xAF, 0xE0, 0x05, 0x47 });       // xor a; ldh (0x05),a; ld b,a
+	loop = rom.Here();
+	rom.Emit({ 0xF0, 0x05, 0x90, 0xFE, 0x40 }); // ldh a,(0x05); sub b; cp 0x40
+	rom.JR(0x38, loop);                         // jr c,loop
+	rom.Emit({ 0x0E, 0x89 });                   // ld c,0x89
+	rom.Emit(0xCD, record);                     // call record
+
+	// a pressed
+	rom.Emit({ 0x3E, 0x10, 0xE0, 0x00 });       // ld a,0x10; ldh (0x00),a
+	loop = rom.Here();
+	rom.Emit({ 0xF0, 0x00, 0xE6, 0x01 });       // ldh a,(0x00); and 1
+	rom.JR(0x20, loop);                         // jr nz,loop
+	rom.Emit({ 0x0E, 0x8C });                   // ld c,0x8C
+	rom.Emit(0xCD, record);                     // call record
+
+	done = rom.Here();
+	rom.JR(0x18, done);                         // jr $
+
+	// div, tima and ly from 0xFF00 + c on
+	rom.Org(record);
+	rom.Emit({ 0xF0, 0x04, 0xE2, 0x0C });       // ldh a,(0x04); ldh (c),a; inc c
+	rom.Emit({ 0xF0, 0x05, 0xE2, 0x0C });       // ldh a,(0x05); ldh (c),a; inc c
+	rom.Emit({ 0xF0, 0x44, 0xE2, 0xC9 });       // ldh a,(0x44); ldh (c),a; ret
+
+	rom.Org(0x40);
+	rom.Emit({ 0xF5, 0x3E, 0x01 });             // push af; ld a,1
+	rom.Emit({ 0xEA, 0x00, 0xC0 });             // ld (0xC000),a
+	rom.Emit({ 0xF1, 0xD9 });                   // pop af; reti
+
+	return rom;
+}
+
+static std::unique_ptr<GameBoy> Start(const TestROM &rom, bool idle_loop_detection)
+{
+	auto gameboy = PowerOn(rom, "idle_loop_test");
+	gameboy->GetCPU().SetIdleLoopDetection(idle_loop_detection);
+	gameboy->GetJoypad().QueueButtonState(JoypadButton::A, true, press);
+	return gameboy;
+}
+
+static std::vector<byte> Results(GameBoy &gameboy)
+{
+	std::vector<byte> read;
+	for (byte i = 0; i < result_count; i++)
+		read.push_back(gameboy.GetBus().Get(results + i));
+	return read;
+}
+
+int main()
+{
+	word done;
+	TestROM rom = MakeROM(done);
+
+	auto off = Start(rom, false);
+	off->RunCycles(cycles);
+	CHECK_EQUAL(GetRegisters(off->GetCPU()).PC, done);
+	CHECK_EQUAL(off->GetCPU().GetIdleCyclesSkipped(), 0);
+
+	// ly and the flag were left in vblank, the joypad loop once the button went down
+	std::vector<byte> r = Results(*off);
+	CHECK_EQUAL(r[2], 0x90);
+	CHECK(r[5] >= 0x90);
+	CHECK(byte(r[12] - press / 256) <= 1);
+
+	auto on = Start(rom, true);
+	on->RunCycles(cycles);
+	CHECK(on->GetCPU().GetIdleCyclesSkipped() > 0);
+	CHECK(Results(*on) == Results(*off));
+	CHECK(Snapshot(*on) == Snapshot(*off));
+
+	Random random(13);
+	auto sliced = Start(rom, true);
+	RunInSlices(*sliced, cycles, random);
+	CHECK(Results(*sliced) == Results(*off));
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
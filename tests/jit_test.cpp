@@ -0,0 +1,169 @@
+#include "test_rom.hpp"
+
+
+// a loop of random instructions in rom, interrupted by the timer, calling in to two switched banks. the
+// jit runs it with every native instruction checked against the interpreter, then without the checks,
+// and both have to leave the machine, checksum of the registers included, as the threaded interpreter,
+// which never compiles anything, does
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+static const cycle_t cycles = 2000000;
+
+// anything but jumps and calls. only B, C, D, E and A are written, so HL keeps pointing at 0xC4xx
+static void EmitRandomInstruction(TestROM &rom, Random &random)
+{
+	static const byte written[] = { 0, 1, 2, 3, 7 };
+	byte r = written[random.Below(5)];
+	byte s = random.Below(8);
+	byte op = random.Below(8);
+
+	switch (random.Below(20)) {
+		case 0: rom.Emit({ byte(0x40 | r << 3 | s) }); break;                      // ld r,s
+		case 1: rom.Emit({ byte(0x06 | r << 3), random.Next() }); break;           // ld r,n
+		case 2: case 3: case 4: rom.Emit({ byte(0x80 | op << 3 | s) }); break;     // alu a,s
+		case 5: rom.Emit({ byte(0xC6 | op << 3), random.Next() }); break;          // alu a,n
+		case 6: rom.Emit({ byte(0x04 | r << 3 | random.Below(2)) }); break;        // inc/dec r
+		case 7: rom.Emit({ byte(0x34 | random.Below(2)) }); break;                 // inc/dec (hl)
+
+		case 8: // daa, cpl, scf, ccf, the rotates on A and nop
+		{
+			static const byte opcodes[] = { 0x27, 0x2F, 0x37, 0x3F, 0x07, 0x0F, 0x17, 0x1F, 0x00 };
+			rom.Emit({ opcodes[random.Below(9)] });
+			break;
+		}
+
+		case 9: case 10: // every cb operation on r or (hl)
+			rom.Emit({ 0xCB, byte(random.Below(32) << 3 | (random.Below(6) ? written[random.Below(5)] : 6)) });
+			break;
+
+		case 11: rom.Emit({ byte(0x03 | random.Below(2) << 3 | random.Below(2) << 4) }); break; // inc/dec bc/de
+
+		case 12: // add hl,rr, then back in to 0xC4xx
+			rom.Emit({ byte(0x09 | random.Below(4) << 4) });
+			rom.Emit({ 0x21, random.Next(), 0xC4 });
+			break;
+
+		case 13: // push anything, pop in to anything but hl
+		{
+			static const byte pops[] = { 0xC1, 0xD1, 0xF1 };
+			rom.Emit({ byte(0xC5 | random.Below(4) << 4), pops[random.Below(3)] });
+			break;
+		}
+
+		case 14: // ld (hl),r or ld (hl),n
+			if (random.Below(2))
+				rom.Emit({ byte(0x70 | written[random.Below(5)]) });
+			else
+				rom.Emit({ 0x36, random.Next() });
+			break;
+
+		case 15: rom.Emit({ byte(0xE0 | random.Below(2) << 4), byte(0x80 + random.Below(0x40)) }); break; // ldh (n),a / ldh a,(n)
+		case 16: rom.Emit(byte(0xEA | random.Below(2) << 4), word(0xC800 + random.Next())); break;     // ld (nn),a / ld a,(nn)
+
+		case 17: // jr cc over an inc or dec, which splits the block
+			rom.Emit({ byte(0x20 | random.Below(4) << 3), 0x01, byte(0x04 | r << 3 | random.Below(2)) });
+			break;
+
+		case 18: // add sp,n and back
+		{
+			byte n = 1 + random.Below(16);
+			rom.Emit({ 0xE8, n, 0xE8, byte(-n) });
+			break;
+		}
+
+		case 19: // ld hl,sp+n, then back in to 0xC4xx
+			rom.Emit({ 0xF8, random.Next(), 0x21, random.Next(), 0xC4 });
+			break;
+	}
+}
+
+// adds every register, F included, in to the checksum at 0xFFC2 and leaves them as they were, so a
+// difference that the next instructions would overwrite is still there at the end
+static void EmitChecksum(TestROM &rom)
+{
+	rom.Emit({ 0xF5, 0xD5, 0xF5, 0xD1 });       // push af; push de; push af; pop de
+	rom.Emit({ 0xF0, 0xC2, 0x07, 0x83, 0xAA }); // ldh a,(0xC2); rlca; add a,e; xor d
+	rom.Emit({ 0x80, 0xA9, 0x85 });             // add a,b; xor c; add a,l
+	rom.Emit({ 0xE0, 0xC2, 0xD1, 0xF1 });       // ldh (0xC2),a; pop de; pop af
+}
+
+static TestROM MakeROM()
+{
+	TestROM rom(4);
+	Random random(5);
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, 0xDFF0);                     // ld sp,0xDFF0
+	rom.Emit(0x21, 0xC400);                     // ld hl,0xC400
+	rom.Emit({ 0x3E, 0x05, 0xE0, 0x07 });       // ld a,5; ldh (0x07),a
+	rom.Emit({ 0x3E, 0x04, 0xE0, 0xFF });       // ld a,4; ldh (0xFF),a
+	rom.Emit({ 0xFB });                         // ei
+
+	word outer = rom.Here();
+	rom.Emit({ 0x3E, 0x20, 0xE0, 0xC0 });       // ld a,32; ldh (0xC0),a
+
+	word inner = rom.Here();
+	for (int i = 0; i < 150; i++) {
+		EmitRandomInstruction(rom, random);
+		if (i % 4 == 3)
+			EmitChecksum(rom);
+	}
+
+	rom.Emit({ 0xF0, 0xC0, 0x3D, 0xE0, 0xC0 }); // ldh a,(0xC0); dec a; ldh (0xC0),a
+	rom.Emit(0xC2, inner);                      // jp nz,inner
+
+	for (byte bank = 1; bank <= 2; bank++) {
+		rom.Emit({ 0x3E, bank });               // ld a,bank
+		rom.Emit(0xEA, 0x2000);                 // ld (0x2000),a
+		rom.Emit(0xCD, 0x4000);                 // call 0x4000
+	}
+
+	rom.Emit(0xC3, outer);                      // jp outer
+
+	for (byte bank = 1; bank <= 2; bank++) {
+		rom.Org(0x4000, bank);
+		for (int i = 0; i < 20; i++) {
+			EmitRandomInstruction(rom, random);
+			if (i % 4 == 3)
+				EmitChecksum(rom);
+		}
+		rom.Emit({ 0xC9 });                     // ret
+	}
+
+	// counts timer interrupts
+	rom.Org(0x50);
+	rom.Emit({ 0xF5, 0xF0, 0xC1, 0x3C });       // push af; ldh a,(0xC1); inc a
+	rom.Emit({ 0xE0, 0xC1, 0xF1, 0xD9 });       // ldh (0xC1),a; pop af; reti
+
+	return rom;
+}
+
+int main()
+{
+	TestROM rom = MakeROM();
+
+	auto lockstep = PowerOn(rom, "jit_test");
+	lockstep->GetCPU().SetJitLockstep(true);
+	lockstep->RunCycles(cycles);
+	CHECK_EQUAL(lockstep->GetCPU().GetJitLockstepMismatches(), 0);
+
+	auto native = PowerOn(rom, "jit_test");
+	native->RunCycles(cycles);
+
+	// the interrupt handler ran, so blocks were left for it
+	CHECK(native->GetBus().Get(0xFFC1) != 0);
+
+	if (Interpreters().size() > 1) {
+		auto threaded = PowerOn(rom, "jit_test", true);
+		threaded->RunCycles(cycles);
+
+		// the jit works lazy flags out at every block and the interpreters don't, which only stays out of
+		// the snapshots because the cpu saves F as it reads
+		CHECK(Snapshot(*lockstep) == Snapshot(*threaded));
+		CHECK(Snapshot(*native) == Snapshot(*threaded));
+	}
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "test_rom.hpp"
+
+#include <sstream>
+
+
+// a byte sent over the link port every vblank. frames run ahead are run again once the real frame
+// catches up with them, so only the real ones may send: run ahead or not, the same bytes come out once
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+static const dword frames = 20;
+
+static TestROM MakeROM()
+{
+	TestROM rom;
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, 0xFFFE);                     // ld sp,0xFFFE
+	rom.Emit({ 0x3E, 0x91, 0xE0, 0x40 });       // ld a,0x91; ldh (0x40),a
+	rom.Emit({ 0x06, 0x41 });                   // ld b,'A'
+
+	word frame = rom.Here();
+	rom.Emit({ 0xF0, 0x44, 0xFE, 0x90 });       // ldh a,(0x44); cp 0x90
+	rom.JR(0x20, frame);                        // jr nz,frame
+	rom.Emit({ 0x78, 0xE0, 0x01, 0x04 });       // ld a,b; ldh (0x01),a; inc b
+	rom.Emit({ 0x3E, 0x81, 0xE0, 0x02 });       // ld a,0x81; ldh (0x02),a
+
+	word vblank = rom.Here();
+	rom.Emit({ 0xF0, 0x44, 0xFE, 0x90 });       // ldh a,(0x44); cp 0x90
+	rom.JR(0x28, vblank);                       // jr z,vblank
+	rom.JR(0x18, frame);                        // jr frame
+
+	return rom;
+}
+
+// what the link port sent over a number of frames
+static std::string Run(GameBoy &gameboy)
+{
+	std::ostringstream sent;
+	std::streambuf *stdout_buffer = std::cout.rdbuf(sent.rdbuf());
+
+	for (dword frame = 0; frame < frames; frame++)
+		gameboy.RunFrame();
+
+	std::cout.rdbuf(stdout_buffer);
+	return sent.str();
+}
+
+int main()
+{
+	TestROM rom = MakeROM();
+
+	auto plain = PowerOn(rom, "run_ahead_test");
+	std::string expected = Run(*plain);
+	CHECK(expected.size() >= frames - 1);
+	CHECK(expected.substr(0, 3) == "ABC");
+
+	for (dword run_ahead = 1; run_ahead <= 2; run_ahead++) {
+		auto ahead = PowerOn(rom, "run_ahead_test");
+		ahead->SetRunAhead(run_ahead);
+		CHECK(Run(*ahead) == expected);
+		CHECK(Snapshot(*ahead) == Snapshot(*plain));
+	}
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
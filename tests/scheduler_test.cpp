@@ -0,0 +1,110 @@
+#include "test_rom.hpp"
+
+
+// ly, div and tima read twice a known number of cycles apart, which only comes out right if the lcd
+// and the timer catch up to the cycle they are read at. the same rom run in one go and in runs of a
+// few cycles each has to read the same values
+
+using namespace dromaiusgb;
+using namespace dromaiusgb::test;
+
+static const word results = 0xFF80;
+static const byte result_count = 12;
+
+// reads 0xFF00 + reg, then again distance cycles after the first read started, and stores both reads
+// from 0xFF00 + result on. ldh takes 12 cycles, ld c,a 4, ld b,n 8 and dec b; jr nz 16, 12 the last time
+static void EmitReads(TestROM &rom, byte reg, dword distance, byte result)
+{
+	dword loop = distance - 20;
+	byte passes = byte(loop / 16);
+
+	rom.Emit({ 0xF0, reg, 0x4F, 0x06, passes }); // ldh a,(reg); ld c,a; ld b,passes
+	word top = rom.Here();
+	rom.Emit({ 0x05 });                         // dec b
+	rom.JR(0x20, top);                          // jr nz,top
+	for (dword nop = 0; nop < loop % 16 / 4; nop++)
+		rom.Emit({ 0x00 });                     // nop
+
+	rom.Emit({ 0xF0, reg, 0xE0, byte(result + 1) }); // ldh a,(reg); ldh (result + 1),a
+	rom.Emit({ 0x79, 0xE0, result });           // ld a,c; ldh (result),a
+}
+
+static TestROM MakeROM(word &done)
+{
+	TestROM rom;
+
+	rom.Emit({ 0xF3 });                         // di
+	rom.Emit(0x31, 0xFFFE);                     // ld sp,0xFFFE
+	rom.Emit({ 0x3E, 0x91, 0xE0, 0x40 });       // ld a,0x91; ldh (0x40),a
+
+	// one line, then nine
+	EmitReads(rom, 0x44, 456, 0x80);
+	EmitReads(rom, 0x44, 456 * 9, 0x82);
+
+	// eight div ticks
+	EmitReads(rom, 0x04, 256 * 8, 0x84);
+
+	// 64 tima ticks at 16 cycles each
+	rom.Emit({ 0xAF, 0xE0, 0x06, 0xE0, 0x05 }); // xor a; ldh (0x06),a; ldh (0x05),a
+	rom.Emit({ 0x3E, 0x05, 0xE0, 0x07 });       // ld a,5; ldh (0x07),a
+	EmitReads(rom, 0x05, 16 * 64, 0x86);
+
+	// 24 tima ticks from 0xF0 with 0xC0 in tma, through one overflow, which requests the interrupt
+	rom.Emit({ 0x3E, 0xC0, 0xE0, 0x06 });       // ld a,0xC0; ldh (0x06),a
+	rom.Emit({ 0x3E, 0xF0, 0xE0, 0x05 });       // ld a,0xF0; ldh (0x05),a
+	rom.Emit({ 0xAF, 0xE0, 0x0F });             // xor a; ldh (0x0F),a
+	EmitReads(rom, 0x05, 16 * 24, 0x88);
+	rom.Emit({ 0xF0, 0x0F, 0xE6, 0x04 });       // ldh a,(0x0F); and 4
+	rom.Emit({ 0xE0, 0x8A });                   // ldh (0x8A),a
+
+	// div straight after it was written
+	rom.Emit({ 0xAF, 0xE0, 0x04 });             // xor a; ldh (0x04),a
+	rom.Emit({ 0xF0, 0x04, 0xE0, 0x8B });       // ldh a,(0x04); ldh (0x8B),a
+
+	done = rom.Here();
+	rom.JR(0x18, done);                         // jr $
+
+	return rom;
+}
+
+static std::vector<byte> Results(GameBoy &gameboy)
+{
+	std::vector<byte> read;
+	for (byte i = 0; i < result_count; i++)
+		read.push_back(gameboy.GetBus().Get(results + i));
+	return read;
+}
+
+static void CheckResults(const std::vector<byte> &r)
+{
+	CHECK_EQUAL((r[1] + 154 - r[0]) % 154, 1);
+	CHECK_EQUAL((r[3] + 154 - r[2]) % 154, 9);
+	CHECK_EQUAL(byte(r[5] - r[4]), 8);
+	CHECK_EQUAL(byte(r[7] - r[6]), 64);
+	CHECK_EQUAL(r[9], byte(0xC0 + r[8] + 24));
+	CHECK_EQUAL(r[10], 0x04);
+	CHECK_EQUAL(r[11], 0x00);
+}
+
+int main()
+{
+	word done;
+	TestROM rom = MakeROM(done);
+
+	for (bool threaded : Interpreters()) {
+		std::cout << InterpreterName(threaded) << std::endl;
+
+		auto whole = PowerOn(rom, "scheduler_test", threaded);
+		whole->RunCycles(20000);
+		CHECK_EQUAL(GetRegisters(whole->GetCPU()).PC, done);
+		CheckResults(Results(*whole));
+
+		Random random(7);
+		auto sliced = PowerOn(rom, "scheduler_test", threaded);
+		RunInSlices(*sliced, 20000, random);
+		CHECK_EQUAL(GetRegisters(sliced->GetCPU()).PC, done);
+		CHECK(Results(*sliced) == Results(*whole));
+	}
+
+	return failures ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "gameboy.hpp"
+#include "state.hpp"
+
+#include <fstream>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// what the tests share: roms put together a byte at a time, a boot rom that only switches itself off,
+// and checks that report every failure instead of stopping at the first
+namespace dromaiusgb
+{
+	namespace test
+	{
+		inline int failures = 0;
+
+		template <typename T>
+		bool CheckEqual(const T &actual, const T &expected, const char *what, const char *file, int line)
+		{
+			if (actual == expected)
+				return true;
+
+			failures += 1;
+			std::cerr << file << ":" << line << ": " << what << " is 0x" << std::hex << (unsigned long long)actual
+				<< ", expected 0x" << (unsigned long long)expected << std::dec << std::endl;
+			return false;
+		}
+
+		inline bool Check(bool condition, const char *what, const char *file, int line)
+		{
+			if (condition)
+				return true;
+
+			failures += 1;
+			std::cerr << file << ":" << line << ": failed: " << what << std::endl;
+			return false;
+		}
+
+		#define CHECK(condition) dromaiusgb::test::Check((condition), #condition, __FILE__, __LINE__)
+		#define CHECK_EQUAL(actual, expected) dromaiusgb::test::CheckEqual<unsigned long long>((actual), (expected), #actual, __FILE__, __LINE__)
+
+		// the same numbers on every platform, so every build puts the same rom together
+		class Random
+		{
+		private:
+			dword state;
+
+		public:
+			Random(dword seed) : state(seed) {}
+
+			byte Next()
+			{
+				state = state * 1664525u + 1013904223u;
+				return byte(state >> 24);
+			}
+
+			byte Below(byte limit)
+			{
+				return Next() % limit;
+			}
+		};
+
+		// a cartridge image, written a byte at a time from 0x0150 on. the interrupt vectors return
+		// straight away unless a test puts handlers there
+		class TestROM
+		{
+		private:
+			std::vector<byte> data;
+			dword offset = 0x0150;
+
+		public:
+			// plain rom for two banks, mbc1 for more
+			TestROM(byte banks = 2) : data(banks * 0x4000, 0x00)
+			{
+				for (word vector = 0x40; vector <= 0x60; vector += 8)
+					data[vector] = 0xD9; // reti
+
+				data[0x100] = 0x00; // nop
+				data[0x101] = 0xC3; // jp 0x0150
+				data[0x102] = 0x50;
+				data[0x103] = 0x01;
+
+				byte size = 0;
+				while ((2u << size) < banks)
+					size += 1;
+
+				data[0x147] = banks > 2 ? 0x01 : 0x00;
+				data[0x148] = size;
+			}
+
+			// continue at an address, in the given bank when it is in 0x4000-0x7FFF
+			void Org(word address, byte bank = 1)
+			{
+				offset = address < 0x4000 ? address : bank * 0x4000 + (address - 0x4000);
+			}
+
+			word Here() const
+			{
+				return offset < 0x4000 ? word(offset) : word(0x4000 + offset % 0x4000);
+			}
+
+			void Emit(std::initializer_list<byte> bytes)
+			{
+				for (byte b : bytes)
+					data.at(offset++) = b;
+			}
+
+			void Emit(byte opcode, word operand)
+			{
+				Emit({ opcode, byte(operand), byte(operand >> 8) });
+			}
+
+			// jr with the given opcode to an address before or after this one
+			void JR(byte opcode, word target)
+			{
+				Emit({ opcode, byte(target - (Here() + 2)) });
+			}
+
+			void Save(const std::string &filename) const
+			{
+				std::ofstream output(filename, std::ios::binary);
+				output.write((const char *)data.data(), data.size());
+			}
+		};
+
+		// jumps to its last four bytes, where it switches itself off and falls through to the cartridge
+		inline void SaveBootROM(const std::string &filename)
+		{
+			std::vector<byte> boot(0x100, 0x00);
+			boot[0x00] = 0xC3; // jp 0x00FC
+			boot[0x01] = 0xFC;
+			boot[0xFC] = 0x3E; // ld a,1
+			boot[0xFD] = 0x01;
+			boot[0xFE] = 0xE0; // ldh (0x50),a
+			boot[0xFF] = 0x50;
+
+			std::ofstream output(filename, std::ios::binary);
+			output.write((const char *)boot.data(), boot.size());
+		}
+
+		// files are named after the test, so tests can run side by side in the same directory
+		inline std::unique_ptr<GameBoy> PowerOn(const TestROM &rom, const std::string &name, bool threaded_interpreter = false)
+		{
+			rom.Save(name + ".gb");
+			SaveBootROM(name + "_boot.bin");
+
+			auto gameboy = std::make_unique<GameBoy>();
+			gameboy->LoadBootROM(name + "_boot.bin");
+			gameboy->LoadCartridge(name + ".gb");
+			gameboy->GetCPU().SetThreadedInterpreter(threaded_interpreter);
+			return gameboy;
+		}
+
+		// the interpreters a test can run under in this build
+		inline std::vector<bool> Interpreters()
+		{
+			std::vector<bool> interpreters = { false };
+
+			GameBoy probe;
+			probe.GetCPU().SetThreadedInterpreter(true);
+			if (probe.GetCPU().IsThreadedInterpreter())
+				interpreters.push_back(true);
+
+			return interpreters;
+		}
+
+		inline const char *InterpreterName(bool threaded)
+		{
+			return threaded ? "threaded" : "block cache";
+		}
+
+		struct registers_t
+		{
+			word AF, BC, DE, HL, SP, PC;
+
+			bool operator==(const registers_t &other) const
+			{
+				return AF == other.AF && BC == other.BC && DE == other.DE && HL == other.HL && SP == other.SP && PC == other.PC;
+			}
+		};
+
+		// at least the given number of cycles, run a few at a time so that the runs end all over the
+		// place, in between events as well as on them
+		inline void RunInSlices(GameBoy &gameboy, cycle_t cycles, Random &random)
+		{
+			cycle_t end = gameboy.GetCycles() + cycles;
+			while (gameboy.GetCycles() < end)
+				gameboy.RunCycles(1 + random.Below(100));
+		}
+
+		// the whole machine, to compare two of them
+		inline std::vector<byte> Snapshot(const GameBoy &gameboy)
+		{
+			State state;
+			gameboy.SaveState(state);
+			state.Rewind();
+
+			std::vector<byte> bytes(state.Size());
+			state.Read(bytes.data(), bytes.size());
+			return bytes;
+		}
+
+		// the registers lead the cpu's saved state
+		inline registers_t GetRegisters(const CPU &cpu)
+		{
+			State state;
+			cpu.SaveState(state);
+			state.Rewind();
+
+			registers_t registers;
+			state.Read(registers.AF);
+			state.Read(registers.BC);
+			state.Read(registers.DE);
+			state.Read(registers.HL);
+			state.Read(registers.SP);
+			state.Read(registers.PC);
+			return registers;
+		}
+	}
+}
\ No newline at end of file